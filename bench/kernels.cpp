@@ -0,0 +1,103 @@
+#include "yaccs/dtype.hpp"
+#include "yaccs/host/kernels.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#define FLAGS_IMPLEMENTATION
+#include "flags.hpp"
+
+
+struct KernelCase
+{
+    std::string name;
+    size_t bytes_read;
+    size_t bytes_written;
+    std::function<void(SimdLevel, char*)> run;
+}; // struct KernelCase
+
+/**
+ * @brief Best time of repeat runs of a kernel at a level, the first run is not timed.
+ * The output is left in dst for the comparison with the scalar kernel.
+ */
+static double time_kernel(const KernelCase& kc, SimdLevel level, int repeat, std::vector<char>& dst)
+{
+    double best_s{std::numeric_limits<double>::max()};
+    for (int i = 0; i <= repeat; ++i) {
+        auto begin{std::chrono::steady_clock::now()};
+        kc.run(level, dst.data());
+        auto end{std::chrono::steady_clock::now()};
+        if (i > 0) {
+            best_s = std::min(best_s, std::chrono::duration<double>(end - begin).count());
+        }
+    }
+    return best_s;
+}
+
+int main(int argc, char** argv)
+{
+    Flags::parse(argc, argv)
+        ->with_arg<std::string>("shape", 's', "4096x4096", "Weight matrix shape, given as <rows>x<cols>")
+        ->with_arg<std::string>("repeat", 'r', "10", "Timed runs per kernel")
+        ->set_help("Yaccs host kernel benchmark, prints GB/s moved per kernel and SIMD level");
+
+    uint32_t rows{0};
+    uint32_t cols{0};
+    std::string shape_str{Flags::arg<std::string>("shape")};
+    if (sscanf(shape_str.c_str(), "%ux%u", &rows, &cols) != 2 || rows == 0 || cols == 0) {
+        std::cerr << "Bad matrix shape: " << shape_str << "\nFailed.\n";
+        return 1;
+    }
+    const int repeat{std::max(1, std::stoi(Flags::arg<std::string>("repeat")))};
+
+    // the same pattern as the synthesized bench weights, with a few values that round
+    const size_t n{static_cast<size_t>(rows) * cols};
+    std::vector<char> src(n * DT_FLOAT_BYTES);
+    for (size_t i = 0; i < n; ++i) {
+        const float v{0.01f * ((i * 7 + 13) % 37) - 0.15f + (i % 3) * 1e-7f};
+        memcpy(src.data() + i * DT_FLOAT_BYTES, &v, sizeof(v));
+    }
+    const float qscale{0.002f};
+
+    const std::vector<KernelCase> cases{
+        {"scale", n * DT_FLOAT_BYTES, n * DT_FLOAT_BYTES,
+            [&](SimdLevel level, char* dst) { scale_f32(src.data(), dst, n, 0.5f, level); }},
+        {"transpose", n * DT_FLOAT_BYTES, n * DT_FLOAT_BYTES,
+            [&](SimdLevel level, char* dst) { transpose_f32(src.data(), dst, rows, cols, level); }},
+        {"f32_to_f16", n * DT_FLOAT_BYTES, n * DT_FLOAT16_BYTES,
+            [&](SimdLevel level, char* dst) { convert_f32_to_f16(src.data(), dst, n, level); }},
+        {"f32_to_bf16", n * DT_FLOAT_BYTES, n * DT_BFLOAT16_BYTES,
+            [&](SimdLevel level, char* dst) { convert_f32_to_bf16(src.data(), dst, n, level); }},
+        {"quantize_i8", n * DT_FLOAT_BYTES, n * DT_INT8_BYTES,
+            [&](SimdLevel level, char* dst) { quantize_f32_to_i8(src.data(), dst, n, qscale, 3, level); }},
+    };
+    const SimdLevel levels[]{SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2, SIMD_NEON};
+
+    printf("%ux%u floats, host %s\n", rows, cols, simd_level_name(host_simd_level()));
+    bool passed{true};
+    for (const auto& kc : cases) {
+        std::vector<char> expected(kc.bytes_written);
+        double scalar_s{0.0};
+        for (auto level : levels) {
+            if (!simd_supported(level)) {
+                continue;
+            }
+            std::vector<char> dst(kc.bytes_written);
+            const double s{time_kernel(kc, level, repeat, level == SIMD_SCALAR ? expected : dst)};
+            if (level == SIMD_SCALAR) {
+                scalar_s = s;
+            }
+            const bool same{level == SIMD_SCALAR || dst == expected};
+            printf("%-12s %-7s %8.2f GB/s %6.2fx%s\n", kc.name.c_str(), simd_level_name(level),
+                (kc.bytes_read + kc.bytes_written) / s * 1e-9, scalar_s / s, same ? "" : "  MISMATCH");
+            passed = passed && same;
+        }
+    }
+    return passed ? 0 : 1;
+}
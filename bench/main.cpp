@@ -0,0 +1,240 @@
+#include "yaccs/baker/layer3/layer3.hpp"
+#include "yaccs/graph/fusion.hpp"
+#include "yaccs/graph/graph.hpp"
+#include "yaccs/graph/memory_plan.hpp"
+#include "yaccs/onnx/parser.hpp"
+#include "yaccs/utils.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <onnx.pb.h>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define FLAGS_IMPLEMENTATION
+#include "flags.hpp"
+
+
+struct BenchCase
+{
+    int width;
+    int depth;
+    int batch;
+    bool weights_in_buffer;
+}; // struct BenchCase
+
+static std::vector<int> parse_list(const std::string& str)
+{
+    std::vector<int> result;
+    std::stringstream ss{str};
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) {
+            result.push_back(std::stoi(item));
+        }
+    }
+    return result;
+}
+
+static void add_value_info(onnx::ValueInfoProto* info, const std::string& name, int rows, int cols)
+{
+    info->set_name(name);
+    auto tensor_type{info->mutable_type()->mutable_tensor_type()};
+    tensor_type->set_elem_type(onnx::TensorProto::FLOAT);
+    tensor_type->mutable_shape()->add_dim()->set_dim_value(rows);
+    tensor_type->mutable_shape()->add_dim()->set_dim_value(cols);
+}
+
+// layer shifts the value pattern, so no two layers have equal weights the compiler could deduplicate
+static void add_initializer(onnx::GraphProto* graph, const std::string& name, const std::vector<int>& dims, int layer)
+{
+    auto tensor{graph->add_initializer()};
+    tensor->set_name(name);
+    tensor->set_data_type(onnx::TensorProto::FLOAT);
+    size_t num_elems{1};
+    for (auto it : dims) {
+        tensor->add_dims(it);
+        num_elems *= it;
+    }
+
+    std::vector<float> data(num_elems);
+    for (size_t i = 0; i < num_elems; ++i) {
+        data.at(i) = 0.0001f * ((i * 7 + layer * 13) % 3701) - 0.15f;
+    }
+    tensor->set_raw_data(data.data(), data.size() * sizeof(float));
+}
+
+/**
+ * @brief MLP of depth Gemm + Relu layers, every layer is width x width. Same layout as
+ * a PyTorch export: weights are N x K with transB set.
+ */
+static void synthesize_mlp(const BenchCase& bc, onnx::ModelProto& model)
+{
+    model.set_ir_version(8);
+    model.set_producer_name("yaccs_bench");
+    model.add_opset_import()->set_version(17);
+
+    auto graph{model.mutable_graph()};
+    graph->set_name("mlp");
+    add_value_info(graph->add_input(), "input", bc.batch, bc.width);
+
+    std::string x{"input"};
+    for (int i = 0; i < bc.depth; ++i) {
+        const auto layer{std::to_string(i)};
+        const auto weight{"layers." + layer + ".weight"};
+        const auto bias{"layers." + layer + ".bias"};
+        add_initializer(graph, weight, {bc.width, bc.width}, i);
+        add_initializer(graph, bias, {bc.width}, i);
+
+        auto gemm{graph->add_node()};
+        gemm->set_name("/layers." + layer + "/Gemm");
+        gemm->set_op_type("Gemm");
+        gemm->add_input(x);
+        gemm->add_input(weight);
+        gemm->add_input(bias);
+        gemm->add_output("/layers." + layer + "/Gemm_output_0");
+        auto trans_b{gemm->add_attribute()};
+        trans_b->set_name("transB");
+        trans_b->set_type(onnx::AttributeProto::INT);
+        trans_b->set_i(1);
+
+        const bool last{i == bc.depth - 1};
+        auto relu{graph->add_node()};
+        relu->set_name("/layers." + layer + "/Relu");
+        relu->set_op_type("Relu");
+        relu->add_input(gemm->output(0));
+        relu->add_output(last ? "output" : "/layers." + layer + "/Relu_output_0");
+        x = relu->output(0);
+    }
+    add_value_info(graph->add_output(), "output", bc.batch, bc.width);
+}
+
+/**
+ * @brief Compile one synthesized model and write its report as a JSON object. Runs in
+ * a child process, so peak RSS and the compiler's global state belong to this case only.
+ */
+static void run_case(const BenchCase& bc, std::ostream& os)
+{
+    PhaseTimer timer;
+    std::string serialized;
+    {
+        onnx::ModelProto synthesized;
+        synthesize_mlp(bc, synthesized);
+        synthesized.SerializeToString(&serialized);
+    }
+    timer.restart();
+
+    onnx::ModelProto model;
+    model.ParseFromString(serialized);
+    timer.phase_done("parse");
+
+    Graph graph;
+    graph_from_onnx(model.graph(), graph, {});
+    timer.phase_done("frontend");
+
+    fuse_gemm_relu(graph);
+    MemoryPlan memory_plan{plan_memory(graph)};
+    timer.phase_done("passes");
+
+    const auto spvasm_filename{(std::filesystem::temp_directory_path()
+        / ("yaccs_bench_" + std::to_string(getpid()) + ".spvasm")).string()};
+    Layer3 program;
+    program.set_name(spvasm_filename);
+    program.set_weights_in_buffer(bc.weights_in_buffer);
+    program.add_graph(graph, &memory_plan);
+    program.set_main();
+    timer.phase_done("bake");
+
+    std::vector<uint32_t> words;
+    program.assemble(words);
+    timer.phase_done("assemble");
+
+    program.dump_ir();
+    timer.phase_done("spvasm");
+    std::filesystem::remove(spvasm_filename);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    os << "{\"width\": " << bc.width << ", \"depth\": " << bc.depth << ", \"batch\": " << bc.batch
+        << ", \"weights_in_buffer\": " << (bc.weights_in_buffer ? "true" : "false")
+        << ", \"model_bytes\": " << serialized.size()
+        << ", \"spv_bytes\": " << words.size() * sizeof(uint32_t)
+        << ", \"phases_ms\": {";
+    const auto& phases{timer.phases()};
+    for (size_t i = 0; i < phases.size(); ++i) {
+        os << (i > 0 ? ", " : "") << "\"" << phases.at(i).first << "\": " << phases.at(i).second;
+    }
+    os << "}, \"total_ms\": " << timer.total_ms() << ", \"peak_rss_kb\": " << usage.ru_maxrss << "}";
+}
+
+static std::string fork_case(const BenchCase& bc)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return "";
+    }
+
+    auto pid{fork()};
+    if (pid == 0) {
+        close(fds[0]);
+        std::stringstream ss;
+        run_case(bc, ss);
+        const auto report{ss.str()};
+        auto written{write(fds[1], report.data(), report.size())};
+        close(fds[1]);
+        _exit(written == static_cast<ssize_t>(report.size()) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    std::string report;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+        report.append(buf, n);
+    }
+    close(fds[0]);
+
+    int status{0};
+    waitpid(pid, &status, 0);
+    if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return "";
+    }
+    return report;
+}
+
+int main(int argc, char** argv)
+{
+    Flags::parse(argc, argv)
+        ->with_arg<std::string>("widths", 'W', "64,128,256,512", "Comma separated layer widths")
+        ->with_arg<std::string>("depths", 'D', "2,4,8", "Comma separated numbers of Gemm + Relu layers")
+        ->with_arg<std::string>("batch", 'n', "1", "Batch size of the model input")
+        ->with_opt("weights", 'w', "Place initializers in a storage buffer instead of constants")
+        ->set_help("Yaccs compile time benchmark, prints a JSON report");
+
+    const int batch{std::stoi(Flags::arg<std::string>("batch"))};
+    const bool weights_in_buffer{Flags::opt("weights")};
+
+    std::cout << "[\n";
+    bool first{true};
+    for (auto depth : parse_list(Flags::arg<std::string>("depths"))) {
+        for (auto width : parse_list(Flags::arg<std::string>("widths"))) {
+            BenchCase bc{.width = width, .depth = depth, .batch = batch, .weights_in_buffer = weights_in_buffer};
+            auto report{fork_case(bc)};
+            if (report.empty()) {
+                std::stringstream ss;
+                ss << "{\"width\": " << width << ", \"depth\": " << depth << ", \"error\": \"compilation failed\"}";
+                report = ss.str();
+            }
+            std::cout << (first ? "  " : ",\n  ") << report << std::flush;
+            first = false;
+        }
+    }
+    std::cout << "\n]\n";
+    return 0;
+}
@@ -17,12 +17,13 @@ int main()
         auto instance{cov::App::new_instance()};
         instance.load_shader(shader_path);
 
-        std::vector<char> input(4 + 2 * 4 + 4 * 4);
+        // dims, shape[2], then the data at the next 16 bytes boundary
+        std::vector<char> input(16 + 4 * 4);
         uint32_t dims{2};
         uint32_t shape[2]{1, 4};
         memcpy(input.data(), &dims, sizeof(dims));
         memcpy(input.data() + 4, shape, dims * sizeof(uint32_t));
-        std::vector<char> output(4 + 2 * 4 + 4 * 4, 0);
+        std::vector<char> output(16 + 4 * 4, 0);
 
         instance.set_inputs({
             {input.data(), input.size()},
@@ -43,7 +44,7 @@ int main()
         }
         std::cout << "\ndata: ";
         for (int i = 0; i < 4; ++i) {
-            std::cout << *reinterpret_cast<float*>(output.data() + 4 * (i + 1 + 2)) << " ";
+            std::cout << *reinterpret_cast<float*>(output.data() + 16 + 4 * i) << " ";
         }
         std::cout << "\n";
     }
@@ -0,0 +1,56 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#define COV_VULKAN_VALIDATION
+#define COV_IMPLEMENTATION
+#include "cov.hpp"
+
+
+int main()
+{
+    std::string shader_path{"model.spv"};
+
+    // printed by model.py, the int8 grid makes the result exact
+    const float input_data[6]{-1.4443f, -0.5252f, 0.3939f, 1.313f, -0.7878f, 0.1313f};
+    const float expected[4]{0.44f, 0.28f, 0.66f, 0.26f};
+
+    cov::App::init("QdqMlpModel");
+
+    bool passed{true};
+    {
+        // core code
+        auto instance{cov::App::new_instance()};
+        instance.load_shader(shader_path);
+
+        // dims, shape[2], then the data at the next 16 bytes boundary
+        std::vector<char> input(16 + 6 * 4);
+        uint32_t dims{2};
+        uint32_t shape[2]{1, 6};
+        memcpy(input.data(), &dims, sizeof(dims));
+        memcpy(input.data() + 4, shape, dims * sizeof(uint32_t));
+        memcpy(input.data() + 16, input_data, sizeof(input_data));
+        std::vector<char> output(16 + 4 * 4, 0);
+
+        instance.set_inputs({
+            {input.data(), input.size()},
+        });
+        instance.def_output(output.size() * sizeof(output.at(0)));
+
+        if (!instance.execute({1, 1, 1})) {
+            std::cerr << "Execute shader program failed\n";
+        }
+        instance.get_output(output.data(), output.size());
+        // The instance will be automatically destroy here.
+
+        std::cout << "Output:\n";
+        for (int i = 0; i < 4; ++i) {
+            const auto value{*reinterpret_cast<float*>(output.data() + 16 + 4 * i)};
+            std::cout << value << " (expected " << expected[i] << ")\n";
+            passed = passed && std::fabs(value - expected[i]) < 1e-5f;
+        }
+    }
+
+    std::cout << (passed ? "Passed.\n" : "Failed.\n");
+    return passed ? 0 : 1;
+}
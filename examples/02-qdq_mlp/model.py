@@ -0,0 +1,78 @@
+import numpy as np
+import onnx
+from onnx import TensorProto, helper, numpy_helper
+
+
+# Two Linear layers in QDQ form: int8 weights, and every activation goes through a
+# QuantizeLinear -> DequantizeLinear pair, including the one between the layers.
+IN_FEATURES = 6
+HIDDEN = 4
+OUT_FEATURES = 4
+BATCH = 1
+
+
+def fake_quant(x, scale, zero_point):
+    scale = np.float32(scale)
+    q = np.clip(np.rint(x.astype(np.float32) / scale) + zero_point, -128, 127)
+    return ((q - zero_point) * scale).astype(np.float32)
+
+
+def qdq(x, y, name):
+    return [
+        helper.make_node("QuantizeLinear", [x, name + "_scale", name + "_zero_point"], [name + "_q"], name=name + "_q"),
+        helper.make_node("DequantizeLinear", [name + "_q", name + "_scale", name + "_zero_point"], [y], name=name + "_dq"),
+    ]
+
+
+if __name__ == "__main__":
+    ONNX_PATH = "model.onnx"
+
+    rng = np.random.default_rng(0)
+    w1 = rng.integers(-127, 128, (HIDDEN, IN_FEATURES)).astype(np.int8)
+    w1_scale = (0.004 + 0.001 * np.arange(HIDDEN)).astype(np.float32)
+    w2 = rng.integers(-127, 128, (OUT_FEATURES, HIDDEN)).astype(np.int8)
+    w2_scale = (0.003 + 0.0005 * np.arange(OUT_FEATURES)).astype(np.float32)
+    b2 = (0.1 * np.arange(OUT_FEATURES) - 0.15).astype(np.float32)
+    # (scale, zero point) of the activations
+    qparams = {"x": (0.02, 3), "h": (0.05, -5), "y": (0.02, 0)}
+    # int32 bias at scale x_scale * w1_scale
+    b1 = rng.integers(-1000, 1001, HIDDEN).astype(np.int32)
+    b1_scale = (w1_scale * np.float32(qparams["x"][0])).astype(np.float32)
+
+    initializers = [
+        numpy_helper.from_array(w1, "w1"),
+        numpy_helper.from_array(w1_scale, "w1_scale"),
+        numpy_helper.from_array(b1, "b1"),
+        numpy_helper.from_array(b1_scale, "b1_scale"),
+        numpy_helper.from_array(w2, "w2"),
+        numpy_helper.from_array(w2_scale, "w2_scale"),
+        numpy_helper.from_array(b2, "b2"),
+    ]
+    for name, (scale, zero_point) in qparams.items():
+        initializers.append(numpy_helper.from_array(np.array(scale, np.float32), name + "_scale"))
+        initializers.append(numpy_helper.from_array(np.array(zero_point, np.int8), name + "_zero_point"))
+
+    nodes = qdq("input", "x_dq", "x")
+    nodes.append(helper.make_node("DequantizeLinear", ["w1", "w1_scale"], ["w1_dq"], name="w1_dq", axis=0))
+    nodes.append(helper.make_node("DequantizeLinear", ["b1", "b1_scale"], ["b1_dq"], name="b1_dq", axis=0))
+    nodes.append(helper.make_node("Gemm", ["x_dq", "w1_dq", "b1_dq"], ["fc1"], name="fc1", transB=1))
+    nodes += qdq("fc1", "h_dq", "h")
+    nodes.append(helper.make_node("DequantizeLinear", ["w2", "w2_scale"], ["w2_dq"], name="w2_dq", axis=0))
+    nodes.append(helper.make_node("Gemm", ["h_dq", "w2_dq", "b2"], ["fc2"], name="fc2", transB=1))
+    nodes += qdq("fc2", "output", "y")
+
+    graph = helper.make_graph(nodes, "qdq_mlp",
+        [helper.make_tensor_value_info("input", TensorProto.FLOAT, ["batch_size", IN_FEATURES])],
+        [helper.make_tensor_value_info("output", TensorProto.FLOAT, ["batch_size", OUT_FEATURES])],
+        initializers)
+    model = helper.make_model(graph, opset_imports=[helper.make_opsetid("", 13)])
+    onnx.checker.check_model(model)
+    onnx.save(model, ONNX_PATH)
+
+    # expected output of the input main.cpp feeds
+    x = ((np.arange(BATCH * IN_FEATURES) * 7 % 23 - 11) * 0.1313).astype(np.float32).reshape(BATCH, IN_FEATURES)
+    h = fake_quant(x, *qparams["x"]) @ (w1 * w1_scale[:, None]).T + b1 * b1_scale
+    h = fake_quant(h, *qparams["h"])
+    y = fake_quant(h @ (w2 * w2_scale[:, None]).T + b2, *qparams["y"])
+    print("input:", x.flatten().tolist())
+    print("output:", y.flatten().tolist())
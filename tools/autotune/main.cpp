@@ -0,0 +1,232 @@
+#include "yaccs/baker/layer3/layer3.hpp"
+#include "yaccs/graph/graph.hpp"
+#include "yaccs/reference/reference.hpp"
+#include "yaccs/tuning/tuning_cache.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#define COV_IMPLEMENTATION
+#include "cov.hpp"
+
+#define FLAGS_IMPLEMENTATION
+#include "flags.hpp"
+
+// limits every Vulkan device supports
+#define MAX_WORKGROUP_INVOCATIONS 128
+#define MAX_WORKGROUP_SHARED_BYTES 16384
+
+
+static Tensor make_tensor(const std::string& name, uint32_t rows, uint32_t cols, bool fill)
+{
+    Tensor tensor;
+    tensor.tt.name = name;
+    tensor.tt.dtype = DT_FLOAT;
+    tensor.tt.row_major = true;
+    if (rows == 0) {
+        tensor.tt.dims = 1;
+        tensor.tt.shape[0] = cols;
+    } else {
+        tensor.tt.dims = 2;
+        tensor.tt.shape[0] = rows;
+        tensor.tt.shape[1] = cols;
+    }
+
+    if (fill) {
+        tensor.data.resize(tensor.tt.num_elems() * DT_FLOAT_BYTES);
+        for (int i = 0; i < tensor.tt.num_elems(); ++i) {
+            tensor.set<DT_FLOAT>(i, 0.01f * ((i * 7 + name.size() * 13) % 37) - 0.15f);
+        }
+    }
+    return tensor;
+}
+
+static std::vector<GemmConfig> config_grid()
+{
+    const int local_sizes[][2]{{4, 4}, {8, 4}, {4, 8}, {8, 8}, {16, 8}, {8, 16}};
+    const int micro_tiles[][2]{{1, 1}, {2, 2}, {2, 4}, {4, 2}, {4, 4}};
+    const int tile_ks[]{8, 16, 32};
+
+    std::vector<GemmConfig> grid;
+    for (const auto& ls : local_sizes) {
+        if (ls[0] * ls[1] > MAX_WORKGROUP_INVOCATIONS) {
+            continue;
+        }
+        grid.push_back({.local_size_x = ls[0], .local_size_y = ls[1], .tile = {0, 0, 0}});
+        for (const auto& mt : micro_tiles) {
+            for (auto tk : tile_ks) {
+                auto shared_bytes{(ls[0] * mt[0] * tk + tk * ls[1] * mt[1]) * DT_FLOAT_BYTES};
+                if (tk % ls[0] != 0 || tk % ls[1] != 0 || shared_bytes > MAX_WORKGROUP_SHARED_BYTES) {
+                    continue;
+                }
+                grid.push_back({.local_size_x = ls[0], .local_size_y = ls[1], .tile = {mt[0], mt[1], tk}});
+            }
+        }
+    }
+    return grid;
+}
+
+static void compile_gemm(const GemmConfig& config, const Tensor& A, const Tensor& B, const Tensor& C,
+    const Tensor& Y, const std::string& spv_filename, std::vector<char>& weights)
+{
+    OpGemm gemm;
+    gemm.name = "gemm";
+    gemm.op_type = "Gemm";
+    gemm.alpha = 1.0f;
+    gemm.beta = 1.0f;
+    gemm.trans_a = 0;
+    gemm.trans_b = 0;
+    gemm.A = A;
+    gemm.B = B;
+    gemm.C = C;
+    gemm.Y = Y;
+
+    Graph graph;
+    graph.value(graph.add_value(A.tt.name, VK_INPUT)).tt = A.tt;
+    graph.mark_input(graph.find_value(A.tt.name));
+    graph.value(graph.add_value(B.tt.name, VK_INITIALIZER)).tt = B.tt;
+    graph.value(graph.add_value(C.tt.name, VK_INITIALIZER)).tt = C.tt;
+    graph.value(graph.add_value(Y.tt.name, VK_OUTPUT)).tt = Y.tt;
+    graph.mark_output(graph.find_value(Y.tt.name));
+    graph.node(graph.add_node(gemm.name, OT_GEMM, {A.tt.name, B.tt.name, C.tt.name}, {Y.tt.name})).op = gemm;
+
+    Layer3 program;
+    program.set_name("autotune.spvasm");
+    program.set_weights_in_buffer(true);
+    program.set_local_size(config.local_size_x, config.local_size_y);
+    program.set_gemm_tile(config.tile);
+    program.add_graph(graph);
+    program.set_main();
+    program.dump_spv(spv_filename);
+    weights = program.weights();
+}
+
+static uint32_t ceil_div(uint32_t a, uint32_t b)
+{
+    return (a + b - 1) / b;
+}
+
+int main(int argc, char** argv)
+{
+    Flags::parse(argc, argv)
+        ->with_arg<std::string>("shape", 's', "256x256x256", "Gemm shape to tune, given as <M>x<N>x<K>")
+        ->with_arg<std::string>("cache", 'c', "yaccs_tuning.txt", "Tuning cache to update")
+        ->with_arg<std::string>("repeat", 'r', "5", "Timed dispatches per configuration")
+        ->set_help("Yaccs Gemm autotuner");
+
+    GemmKey key{.m = 0, .n = 0, .k = 0, .dtype = DT_FLOAT};
+    std::string shape_str{Flags::arg<std::string>("shape")};
+    if (sscanf(shape_str.c_str(), "%ux%ux%u", &key.m, &key.n, &key.k) != 3
+        || key.m == 0 || key.n == 0 || key.k == 0) {
+        std::cerr << "Bad Gemm shape: " << shape_str << "\nFailed.\n";
+        return 1;
+    }
+    const int repeat{std::max(1, std::stoi(Flags::arg<std::string>("repeat")))};
+    const std::string cache_filename{Flags::arg<std::string>("cache")};
+    const std::string spv_filename{"autotune.spv"};
+
+    TuningCache cache;
+    cache.load(cache_filename); // a missing cache is created on save
+
+    auto A{make_tensor("A", key.m, key.k, true)};
+    auto B{make_tensor("B", key.k, key.n, true)};
+    auto C{make_tensor("C", 0, key.n, true)};
+    auto Y{make_tensor("Y", key.m, key.n, false)};
+
+    std::vector<float> expected(key.m * key.n);
+    for (uint32_t i = 0; i < key.m; ++i) {
+        for (uint32_t j = 0; j < key.n; ++j) {
+            float sum{C.at<DT_FLOAT>(j)};
+            for (uint32_t k = 0; k < key.k; ++k) {
+                sum += A.at<DT_FLOAT>(i, k) * B.at<DT_FLOAT>(k, j);
+            }
+            expected.at(i * key.n + j) = sum;
+        }
+    }
+
+    auto input{pack_tensor(A)};
+    const size_t output_header_bytes{tensor_data_offset(Y.tt.dims)};
+    std::vector<char> output(output_header_bytes + key.m * key.n * DT_FLOAT_BYTES);
+
+    cov::App::init("YaccsAutotune");
+
+    TuningRecord best{.key = key, .config = {}, .time_us = std::numeric_limits<double>::max()};
+    for (const auto& config : config_grid()) {
+        std::vector<char> weights;
+        compile_gemm(config, A, B, C, Y, spv_filename, weights);
+
+        // the naive kernel has one invocation per output element, the tiled one
+        // covers a micro tile per invocation
+        const uint32_t rows_per_group{static_cast<uint32_t>(config.local_size_x * std::max(1, config.tile.micro_m))};
+        const uint32_t cols_per_group{static_cast<uint32_t>(config.local_size_y * std::max(1, config.tile.micro_n))};
+        const uint32_t groups_x{ceil_div(key.m, rows_per_group)};
+        const uint32_t groups_y{ceil_div(key.n, cols_per_group)};
+
+        double time_us{std::numeric_limits<double>::max()};
+        bool ok{true};
+        {
+            auto instance{cov::App::new_instance()};
+            instance.load_shader(spv_filename);
+            // inputs are bound to set 0 in order, the weights buffer is binding 1
+            instance.set_inputs({
+                {input.data(), input.size()},
+                {weights.data(), weights.size()},
+            });
+            instance.def_output(output.size());
+
+            // first dispatch warms up the pipeline and is not timed
+            for (int i = 0; i <= repeat && ok; ++i) {
+                auto begin{std::chrono::steady_clock::now()};
+                ok = instance.execute({groups_x, groups_y, 1});
+                auto end{std::chrono::steady_clock::now()};
+                if (i > 0) {
+                    time_us = std::min(time_us, std::chrono::duration<double, std::micro>(end - begin).count());
+                }
+            }
+            if (ok) {
+                std::fill(output.begin(), output.end(), 0);
+                instance.get_output(output.data(), output.size());
+            }
+        }
+
+        float max_err{0.0f};
+        const float* result{reinterpret_cast<const float*>(output.data() + output_header_bytes)};
+        for (size_t i = 0; ok && i < expected.size(); ++i) {
+            max_err = std::max(max_err, std::fabs(result[i] - expected.at(i)) / std::max(1.0f, std::fabs(expected.at(i))));
+        }
+        ok = ok && max_err < 1e-3f;
+
+        printf("local %2dx%-2d tile %dx%dx%-2d : ", config.local_size_x, config.local_size_y,
+            config.tile.micro_m, config.tile.micro_n, config.tile.tile_k);
+        if (!ok) {
+            printf("failed (max error %g)\n", max_err);
+            continue;
+        }
+        printf("%.1f us\n", time_us);
+        if (time_us < best.time_us) {
+            best.config = config;
+            best.time_us = time_us;
+        }
+    }
+
+    if (best.time_us == std::numeric_limits<double>::max()) {
+        std::cerr << "No configuration ran successfully\nFailed.\n";
+        return 1;
+    }
+
+    printf("Best for %ux%ux%u: local %dx%d tile %dx%dx%d, %.1f us\n", key.m, key.n, key.k,
+        best.config.local_size_x, best.config.local_size_y,
+        best.config.tile.micro_m, best.config.tile.micro_n, best.config.tile.tile_k, best.time_us);
+    cache.update(best);
+    if (!cache.save(cache_filename)) {
+        std::cerr << "Can not write tuning cache: " << cache_filename << "\nFailed.\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include "yaccs/graph/graph.hpp"
+#include "yaccs/onnx/parser.hpp"
+#include "yaccs/reference/reference.hpp"
+#include "yaccs/utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <onnx.pb.h>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define FLAGS_IMPLEMENTATION
+#include "flags.hpp"
+
+
+static std::vector<std::string> parse_list(const std::string& str)
+{
+    std::vector<std::string> result;
+    std::stringstream ss{str};
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) {
+            result.push_back(item);
+        }
+    }
+    return result;
+}
+
+static bool read_buffer(const std::string& filename, std::vector<char>& buffer)
+{
+    std::ifstream ifs{filename, std::ios::in | std::ios::binary};
+    if (!ifs.is_open()) {
+        return false;
+    }
+    buffer.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static bool write_buffer(const std::string& filename, const std::vector<char>& buffer)
+{
+    std::ofstream ofs{filename, std::ios::out | std::ios::binary};
+    if (!ofs.is_open()) {
+        return false;
+    }
+    ofs.write(buffer.data(), buffer.size());
+    return ofs.good();
+}
+
+// deterministic input in [-0.5, 0.5), the same pattern for every run
+static Tensor synthesize_input(const TensorType& tt)
+{
+    Tensor tensor;
+    tensor.tt = tt;
+    tensor.tt.dtype = DT_FLOAT;
+    tensor.tt.row_major = true;
+    tensor.data.resize(tensor.tt.num_elems() * DT_FLOAT_BYTES);
+    for (int i = 0; i < tensor.tt.num_elems(); ++i) {
+        tensor.set<DT_FLOAT>(i, ((i * 37 + 11) % 101) / 101.0f - 0.5f);
+    }
+    return tensor;
+}
+
+int main(int argc, char** argv)
+{
+    Flags::parse(argc, argv)
+        ->with_arg<std::string>("input", 'i', "",
+            "Comma separated input buffers in graph input order, synthesized when empty")
+        ->with_arg<std::string>("batch", 'b', "1", "Value of the batch_size axis")
+        ->with_arg<std::string>("expected", 'e', "",
+            "Comma separated output buffers of the shader, in graph output order, to compare against")
+        ->with_arg<std::string>("output", 'o', "", "Comma separated files to write the reference outputs to")
+        ->with_arg<std::string>("threads", 'j', "0", "Worker threads, 0 for every hardware thread")
+        ->with_arg<std::string>("repeat", 'r', "0", "Timed runs after the first one")
+        ->with_arg<std::string>("tolerance", 't', "1e-4",
+            "Largest accepted error, absolute below 1 and relative above")
+        ->set_help("Yaccs CPU reference executor");
+
+    if (Flags::raw_params().empty()) {
+        std::cerr << "yaccs_reference: fatal error: no input file\n";
+        return 1;
+    }
+
+    std::string onnx_filename{Flags::raw_params().at(0)};
+    const int batch{std::stoi(Flags::arg<std::string>("batch"))};
+    const int threads{std::stoi(Flags::arg<std::string>("threads"))};
+    const int repeat{std::max(0, std::stoi(Flags::arg<std::string>("repeat")))};
+    float tolerance{};
+    std::string tolerance_str{Flags::arg<std::string>("tolerance")};
+    if (sscanf(tolerance_str.c_str(), "%f", &tolerance) != 1 || tolerance < 0.0f) {
+        std::cerr << "Bad tolerance: " << tolerance_str << "\nFailed.\n";
+        return 1;
+    }
+    if (batch <= 0) {
+        std::cerr << "Bad batch size: " << batch << "\nFailed.\n";
+        return 1;
+    }
+
+    onnx::ModelProto model;
+    if (!load_onnx_model(onnx_filename, model)) {
+        std::cerr << "Can not load model: " << onnx_filename << "\nFailed.\n";
+        return 1;
+    }
+    ExternalData external_data{extract_dirname(onnx_filename)};
+
+    // the graph is evaluated unfused, Q/DQ pairs and Relu run as their own nodes
+    Graph graph;
+    graph_from_onnx(model.graph(), graph, {{"batch_size", batch}}, &external_data);
+
+    std::unordered_map<std::string, Tensor> inputs;
+    const auto input_filenames{parse_list(Flags::arg<std::string>("input"))};
+    if (!input_filenames.empty() && input_filenames.size() != graph.inputs().size()) {
+        std::cerr << "Expect " << graph.inputs().size() << " input buffers\nFailed.\n";
+        return 1;
+    }
+    for (size_t i = 0; i < graph.inputs().size(); ++i) {
+        const auto& value{graph.value(graph.inputs().at(i))};
+        if (input_filenames.empty()) {
+            inputs.emplace(value.name, synthesize_input(value.tt));
+            continue;
+        }
+
+        std::vector<char> buffer;
+        if (!read_buffer(input_filenames.at(i), buffer)) {
+            std::cerr << "Can not open file: " << input_filenames.at(i) << "\nFailed.\n";
+            return 1;
+        }
+        inputs.emplace(value.name, unpack_tensor(buffer, value.name));
+    }
+
+    ReferenceExecutor executor{threads};
+    executor.run(graph, inputs);
+    if (repeat > 0) {
+        auto begin{std::chrono::steady_clock::now()};
+        for (int i = 0; i < repeat; ++i) {
+            executor.run(graph, inputs);
+        }
+        auto end{std::chrono::steady_clock::now()};
+        const double ms{std::chrono::duration<double, std::milli>(end - begin).count() / repeat};
+        printf("%d threads: %.3f ms per run, %.2f GFLOP/s in Gemm\n", executor.num_threads(), ms,
+            executor.gemm_flops() / ms * 1e-6);
+    }
+
+    const auto output_filenames{parse_list(Flags::arg<std::string>("output"))};
+    const auto expected_filenames{parse_list(Flags::arg<std::string>("expected"))};
+    bool passed{true};
+    for (size_t i = 0; i < graph.outputs().size(); ++i) {
+        const auto& name{graph.value(graph.outputs().at(i)).name};
+        const auto& result{executor.value(name)};
+        if (i < output_filenames.size() && !write_buffer(output_filenames.at(i), pack_tensor(result))) {
+            std::cerr << "Can not write file: " << output_filenames.at(i) << "\nFailed.\n";
+            return 1;
+        }
+        if (i >= expected_filenames.size()) {
+            continue;
+        }
+
+        std::vector<char> buffer;
+        if (!read_buffer(expected_filenames.at(i), buffer)) {
+            std::cerr << "Can not open file: " << expected_filenames.at(i) << "\nFailed.\n";
+            return 1;
+        }
+        const auto compared{compare_tensors(result, unpack_tensor(buffer, name))};
+        if (!compared.shape_matched) {
+            printf("%s: shape mismatch\n", name.c_str());
+            passed = false;
+            continue;
+        }
+        const bool ok{compared.max_rel_error <= tolerance};
+        printf("%s: max abs error %g at %d, max rel error %g, %s\n", name.c_str(), compared.max_abs_error,
+            compared.worst_index, compared.max_rel_error, ok ? "ok" : "FAILED");
+        passed = passed && ok;
+    }
+    return passed ? 0 : 1;
+}
@@ -13,9 +13,20 @@ enum Decoration
     DECO_SPECID,
     DECO_BLOCK,
     DECO_BUFFER_BLOCK,
+    DECO_NON_WRITABLE,
     DECO_NONE,
 }; // enum Decoration
 
+// values taken from the SPIR-V specification
+enum Capability : uint32_t
+{
+    CAP_SHADER = 1,
+    CAP_FLOAT16 = 9,
+    CAP_GROUP_NON_UNIFORM = 61,
+    CAP_GROUP_NON_UNIFORM_ARITHMETIC = 63,
+    CAP_STORAGE_BUFFER_16BIT_ACCESS = 4433,
+}; // enum Capability
+
 enum Scope : uint32_t
 {
     SCOPE_CROSSDEVICE = 0,
@@ -78,13 +89,21 @@ enum StorageClass
     SC_DEVICE_ONLY_INTEL,
     SC_HOST_ONLY_INTEL,
     SC_GLOBAL_CONST,
+    SC_GLOBAL_WEIGHT,
     SC_NONE,
 }; // enum StorageClass
 
 enum BuiltIn
 {
+    BI_NUM_WORKGROUPS = 24,
     BI_WORKGROUP_SIZE = 25,
+    BI_WORKGROUP_ID = 26,
+    BI_LOCAL_INVOCATION_ID = 27,
     BI_GLOBAL_INVOCATION_ID = 28,
+    BI_LOCAL_INVOCATION_INDEX = 29,
+    BI_NUM_SUBGROUPS = 38,
+    BI_SUBGROUP_ID = 40,
+    BI_SUBGROUP_LOCAL_INVOCATION_ID = 41,
 }; // enum BuiltIn
 
 enum BinaryOperator
@@ -94,8 +113,28 @@ enum BinaryOperator
     BO_IADD,
     BO_FMUL,
     BO_FADD,
+    BO_FDIV,
+    BO_FSUB,
+    BO_ISUB,
+    BO_UDIV,
+    BO_LOGICAL_AND,
+    BO_VECTOR_TIMES_SCALAR,
 }; // enum BinaryOperator
 
+enum ConvertOp {
+    CVT_UNKNOWN = 0,
+    CVT_F_TO_F,     // float width conversion
+    CVT_F_TO_S,     // float to signed integer, rounds toward zero
+    CVT_S_TO_F,     // signed integer to float
+    CVT_U_TO_F,     // unsigned integer to float
+}; // enum ConvertOp
+
+// reduction across the invocations of a subgroup
+enum GroupOp {
+    GO_FADD = 0,
+    GO_FMAX,
+}; // enum GroupOp
+
 enum CmpOp {
     CO_UNKNOWN = 0,
     CO_GT,
@@ -120,7 +159,15 @@ struct TensorMeta
     id_t dims_type_id;
     id_t shape_type_id;
     id_t data_type_id;
+    // for weight and arena tensors, data lives in a flat buffer starting at element offset
+    std::vector<id_t> shape_ids;
+    id_t offset_id;
     StorageClass storage_class;
+    bool in_arena{false};   // intermediate placed by the memory planner
+    // descriptor of storage buffer backed tensors, set < 0 otherwise
+    int set{-1};
+    int binding{-1};
+    uint32_t vec4_offset{0};    // first data element, in vec4 units from the buffer start
 }; // struct TensorMeta
 
 struct ExtImportDef
@@ -136,6 +183,11 @@ struct ArrTypeDef {
     id_t id;
 }; // struct ArrTypeDef
 
+struct RuntimeArrTypeDef {
+    id_t dtype;
+    id_t id;
+}; // struct RuntimeArrTypeDef
+
 struct StructTypeDef {
     std::vector<id_t> fields;
     id_t id;
@@ -152,6 +204,7 @@ template<typename T>
 struct DTypeConstDef
 {
     T value;
+    DType dtype;
     id_t dtype_id;
     id_t id;
 }; // struct DtypeConstDef
@@ -188,12 +241,43 @@ struct TypePointerDef
 struct EntryDef
 {
     id_t main_id;
+    std::string name;
     std::vector<id_t> input_ids;
-    int local_size_x;
-    int local_size_y;
-    int local_size_z;
+    // ids of the (specialization) constants holding the local size
+    id_t local_size_x_id;
+    id_t local_size_y_id;
+    id_t local_size_z_id;
 }; // struct EntryDef
 
+/**
+ * @brief SpecId of the specialization constants. Fixed numbers, the host overrides
+ * them through VkSpecializationInfo at pipeline creation.
+ */
+enum SpecConstId
+{
+    SPEC_LOCAL_SIZE_X = 0,
+    SPEC_LOCAL_SIZE_Y = 1,
+    SPEC_LOCAL_SIZE_Z = 2,
+    SPEC_GEMM_TILE_K = 3,
+}; // enum SpecConstId
+
+struct SpecConstDef
+{
+    id_t id;
+    id_t dtype_id;
+    uint32_t value;     // default value
+    uint32_t spec_id;
+}; // struct SpecConstDef
+
+struct SpecConstOpDef
+{
+    id_t result_id;
+    id_t type_id;
+    id_t op1_id;
+    id_t op2_id;
+    BinaryOperator bo;
+}; // struct SpecConstOpDef
+
 
 struct DecorateSetBindingDef
 {
@@ -202,9 +286,16 @@ struct DecorateSetBindingDef
     int set;
 }; // struct SetBindingDef
 
+struct DecorateDef
+{
+    id_t target;
+    Decoration deco;
+}; // struct DecorateDef
+
 struct DecorateArrayDef
 {
     id_t array_type_id;
+    uint32_t stride{4};
 }; // struct DecorateArrayDef
 
 struct DecorateBuiltInDef
@@ -314,4 +405,64 @@ struct BinaryOpDef
     BinaryOperator bo;
 }; // struct BinaryOpDef
 
+struct CompareDef
+{
+    id_t result_id;
+    id_t bool_type_id;
+    id_t op1_id;
+    id_t op2_id;
+    CmpOp cmp_op;
+}; // struct CompareDef
+
+struct ConvertDef
+{
+    id_t result_id;
+    id_t type_id;
+    id_t value_id;
+    ConvertOp op;
+}; // struct ConvertDef
+
+struct GroupReduceDef
+{
+    id_t result_id;
+    id_t type_id;
+    id_t scope_id;
+    id_t value_id;
+    GroupOp op;
+}; // struct GroupReduceDef
+
+struct BitFieldExtractDef
+{
+    id_t result_id;
+    id_t type_id;
+    id_t base_id;
+    id_t offset_id;
+    id_t count_id;
+    bool sign_extend;
+}; // struct BitFieldExtractDef
+
+struct SelectDef
+{
+    id_t result_id;
+    id_t type_id;
+    id_t cond_id;
+    id_t obj1_id;
+    id_t obj2_id;
+}; // struct SelectDef
+
+struct CompositeConstructDef
+{
+    id_t result_id;
+    id_t type_id;
+    std::vector<id_t> constituent_ids;
+}; // struct CompositeConstructDef
+
+struct CompositeExtractDef
+{
+    id_t result_id;
+    id_t type_id;
+    id_t composite_id;
+    uint32_t index;
+}; // struct CompositeExtractDef
+
 #endif // YACCS_BAKER_LAYER3_DEF_H_
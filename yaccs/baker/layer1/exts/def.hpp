@@ -4,11 +4,29 @@
 #include "yaccs/baker/def.hpp"
 namespace ext {
 
+enum UnaryOperator
+{
+    UO_ROUND_EVEN = 0,
+    UO_EXP,
+    UO_FIND_UMSB,
+}; // enum UnaryOperator
+
 enum BinaryOperator
 {
     BO_FMAX = 0,
+    BO_FMIN,
 }; // enum BinaryOperator
 
+struct UnaryOpDef
+{
+    id_t result_id;
+    id_t func_id;
+    id_t type_id;
+    id_t op_id;
+    id_t ext_id;
+    UnaryOperator uo;
+}; // struct UnaryOpDef
+
 struct BinaryOpDef
 {
     id_t result_id;
@@ -1,7 +1,6 @@
 #include "yaccs/baker/layer1/exts/exts.hpp"
 #include "yaccs/baker/layer1/exts/def.hpp"
 #include "yaccs/baker/layer1/layer1.hpp"
-#include "yaccs/baker/utils.hpp"
 #include "yaccs/dtype.hpp"
 #include <cassert>
 
@@ -10,7 +9,7 @@ namespace ext {
 Ext::Ext(Layer1* layer1, const std::string& name)  
     : name_(name)
     , layer1_(layer1)
-    , id_(alloc_id())
+    , id_(layer1->alloc_id())
 {
     ExtImportDef eid;
     eid.id = id_;
@@ -18,19 +17,49 @@ Ext::Ext(Layer1* layer1, const std::string& name)
     layer1_->code_gen()->push_ext_import(eid);
 }
 
+Ext::Ext(Layer1* layer1, const Ext& imported)
+    : layer1_(layer1)
+    , name_(imported.name_)
+    , id_(imported.id_)
+{
+}
+
 id_t Ext::max(DType dtype, id_t func_id, id_t op1_id, id_t op2_id)
+{
+    return max(dtype, layer1_->add_dtype(dtype), func_id, op1_id, op2_id);
+}
+
+id_t Ext::max(DType dtype, id_t type_id, id_t func_id, id_t op1_id, id_t op2_id)
 {
     BinaryOpDef bod;
 
     switch (dtype) {
     case DT_FLOAT:
+    case DT_FLOAT16:
         bod.bo = BO_FMAX;
         break;
     default:
         assert(false && "Not Implement");
     }
 
-    bod.result_id = alloc_id();
+    bod.result_id = layer1_->alloc_id();
+    bod.func_id = func_id;
+    bod.type_id = type_id;
+    bod.op1_id = op1_id;
+    bod.op2_id = op2_id;
+    bod.ext_id = id();
+
+    layer1_->code_gen()->push_ext_binary_opration(bod);
+    return bod.result_id;
+}
+
+id_t Ext::min(DType dtype, id_t func_id, id_t op1_id, id_t op2_id)
+{
+    assert(dtype_is_float(dtype) && "Not Implement");
+
+    BinaryOpDef bod;
+    bod.bo = BO_FMIN;
+    bod.result_id = layer1_->alloc_id();
     bod.func_id = func_id;
     bod.type_id = layer1_->add_dtype(dtype);
     bod.op1_id = op1_id;
@@ -41,4 +70,35 @@ id_t Ext::max(DType dtype, id_t func_id, id_t op1_id, id_t op2_id)
     return bod.result_id;
 }
 
+id_t Ext::round_even(DType dtype, id_t func_id, id_t op_id)
+{
+    assert(dtype_is_float(dtype) && "Not Implement");
+    return unary_op(UO_ROUND_EVEN, layer1_->add_dtype(dtype), func_id, op_id);
+}
+
+id_t Ext::exp(DType dtype, id_t func_id, id_t op_id)
+{
+    assert(dtype_is_float(dtype) && "Not Implement");
+    return unary_op(UO_EXP, layer1_->add_dtype(dtype), func_id, op_id);
+}
+
+id_t Ext::find_umsb(id_t func_id, id_t op_id)
+{
+    return unary_op(UO_FIND_UMSB, layer1_->add_dtype(DT_UINT32), func_id, op_id);
+}
+
+id_t Ext::unary_op(UnaryOperator uo, id_t type_id, id_t func_id, id_t op_id)
+{
+    UnaryOpDef uod;
+    uod.uo = uo;
+    uod.result_id = layer1_->alloc_id();
+    uod.func_id = func_id;
+    uod.type_id = type_id;
+    uod.op_id = op_id;
+    uod.ext_id = id();
+
+    layer1_->code_gen()->push_ext_unary_opration(uod);
+    return uod.result_id;
+}
+
 } // namespace ext
@@ -2,6 +2,7 @@
 #define YACCS_EXTS_H_
 
 #include "yaccs/baker/def.hpp"
+#include "yaccs/baker/layer1/exts/def.hpp"
 #include "yaccs/dtype.hpp"
 #include <string>
 
@@ -13,8 +14,18 @@ struct Ext
 {
     Ext() : layer1_(nullptr) {}
     Ext(Layer1* layer1, const std::string& name);
+    // the instruction set imported already, used through another Layer1
+    Ext(Layer1* layer1, const Ext& imported);
 
     id_t max(DType dtype, id_t func_id, id_t op1_id, id_t op2_id);
+    // component-wise on vectors of dtype, type_id is the vector type
+    id_t max(DType dtype, id_t type_id, id_t func_id, id_t op1_id, id_t op2_id);
+    id_t min(DType dtype, id_t func_id, id_t op1_id, id_t op2_id);
+    // round half to even, the rounding of QuantizeLinear
+    id_t round_even(DType dtype, id_t func_id, id_t op_id);
+    id_t exp(DType dtype, id_t func_id, id_t op_id);
+    // index of the most significant set bit of an unsigned integer
+    id_t find_umsb(id_t func_id, id_t op_id);
 
     id_t id() const { return id_; }
     const std::string name() const { return name_; }
@@ -22,6 +33,8 @@ private:
     Layer1* layer1_;
     std::string name_;
     id_t id_;
+
+    id_t unary_op(UnaryOperator uo, id_t type_id, id_t func_id, id_t op_id);
 }; // struct Ext
 
 } // namespace ext
@@ -5,16 +5,59 @@
 
 namespace ext {
 
+const std::string& as_string(UnaryOperator uo)
+{
+    static const std::string round_even{"RoundEven"};
+    static const std::string exp{"Exp"};
+    static const std::string find_umsb{"FindUMsb"};
+
+    switch (uo) {
+    case UO_ROUND_EVEN: return round_even;
+    case UO_EXP:        return exp;
+    case UO_FIND_UMSB:  return find_umsb;
+    default:        assert(false && "Not Implement");
+    }
+
+    return round_even;  // return something to suppress compiler warning
+}
+
 const std::string& as_string(BinaryOperator bo)
 {
     static const std::string fmax{"FMax"};
+    static const std::string fmin{"FMin"};
 
     switch (bo) {
     case BO_FMAX:   return fmax;
+    case BO_FMIN:   return fmin;
     default:        assert(false && "Not Implement");
     }
 
     return fmax;    // return something to suppress compiler warning
 }
 
+uint32_t as_inst(UnaryOperator uo)
+{
+    // instruction numbers in the GLSL.std.450 extended instruction set
+    switch (uo) {
+    case UO_ROUND_EVEN: return 2;
+    case UO_EXP:        return 27;
+    case UO_FIND_UMSB:  return 75;
+    default:        assert(false && "Not Implement");
+    }
+
+    return 2;       // return something to suppress compiler warning
+}
+
+uint32_t as_inst(BinaryOperator bo)
+{
+    // instruction numbers in the GLSL.std.450 extended instruction set
+    switch (bo) {
+    case BO_FMAX:   return 40;
+    case BO_FMIN:   return 37;
+    default:        assert(false && "Not Implement");
+    }
+
+    return 40;      // return something to suppress compiler warning
+}
+
 } // namespace ext
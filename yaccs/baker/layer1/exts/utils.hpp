@@ -2,11 +2,15 @@
 #define YACCS_EXTS_UTILS_H_
 
 #include "yaccs/baker/layer1/exts/def.hpp"
+#include <cstdint>
 #include <string>
 
 namespace ext {
 
+const std::string& as_string(UnaryOperator uo);
 const std::string& as_string(BinaryOperator bo);
+uint32_t as_inst(UnaryOperator uo);
+uint32_t as_inst(BinaryOperator bo);
 
 } // namespace ext
 
@@ -1,62 +1,218 @@
 #include "yaccs/baker/layer1/layer1.hpp"
 #include "yaccs/baker/layer1/utils.hpp"
-#include "yaccs/baker/utils.hpp"
+#include <algorithm>
 #include <cstring>
 
+// forks allocate ids from here up, above every id of their parent
+#define FORK_FIRST_ID 0x80000000u
+
+
+namespace {
+
+id_t resolve_fork_id(const std::vector<id_t>& ids, id_t id)
+{
+    if (id < FORK_FIRST_ID) {
+        return id;
+    }
+    const auto resolved{ids.at(id - FORK_FIRST_ID)};
+    assert(resolved != 0 && "Fork id used before its definition");
+    return resolved;
+}
+
+std::vector<id_t> resolve_all(const IdResolver& resolve, const std::vector<id_t>& ids)
+{
+    std::vector<id_t> result;
+    result.reserve(ids.size());
+    for (auto it : ids) {
+        result.push_back(resolve(it));
+    }
+    return result;
+}
+
+} // namespace
+
 
 Layer1::Layer1()
+    : parent_(nullptr)
+    , local_size_x_(4)
+    , local_size_y_(4)
+    , local_size_z_(1)
+    , void_type_id_(0)
+    , stats_{}
 {
     code_gen_.push_header();
+    capabilities_.insert(CAP_SHADER);
     std450_ = ext::Ext(this, "GLSL.std.450");
 }
 
-void Layer1::set_entry(id_t main_id)
+Layer1::Layer1(const Layer1* parent)
+    : parent_(parent)
+    , code_gen_(FORK_FIRST_ID)
+    , local_size_x_(parent->local_size_x_)
+    , local_size_y_(parent->local_size_y_)
+    , local_size_z_(parent->local_size_z_)
+    , void_type_id_(parent->void_type_id_)
+    , stats_{}
+{
+    assert(!parent->is_fork() && parent->code_gen_.id_bound() < FORK_FIRST_ID && "Bad fork parent");
+    std450_ = ext::Ext(this, parent->std450_);
+}
+
+id_t Layer1::defer(const DeferredFn& define)
+{
+    assert(is_fork() && "Only a fork defers definitions");
+    const auto id{alloc_id()};
+    deferred_.push_back({.id = id, .position = id, .define = define});
+    return id;
+}
+
+void Layer1::defer_effect(const DeferredFn& define)
+{
+    assert(is_fork() && "Only a fork defers definitions");
+    deferred_.push_back({.id = 0, .position = code_gen_.id_bound(), .define = define});
+}
+
+IdResolver Layer1::join(const Layer1& fork)
+{
+    assert(fork.parent_ == this && "Not a fork of this Layer1");
+    std::vector<id_t> ids(fork.code_gen_.id_bound() - FORK_FIRST_ID, 0);
+    const IdResolver resolve{[&ids] (id_t id) { return resolve_fork_id(ids, id); }};
+
+    // every fork id gets the next id here, the ones of deferred definitions are
+    // replaced by what the definitions return, often an id defined before
+    id_t next{FORK_FIRST_ID};
+    auto alloc_until{[&] (id_t end) {
+        for (; next < end; ++next) {
+            ids.at(next - FORK_FIRST_ID) = alloc_id();
+        }
+    }};
+    for (const auto& it : fork.deferred_) {
+        alloc_until(it.position);
+        const auto id{it.define(*this, resolve)};
+        if (it.id != 0) {
+            ids.at(it.id - FORK_FIRST_ID) = id;
+            next = it.id + 1;
+        }
+    }
+    alloc_until(fork.code_gen_.id_bound());
+
+    code_gen_.append_functions(fork.code_gen_, resolve);
+    for (const auto& it : fork.global_funcs_) {
+        FunctionHeaderDef fh{
+            .return_type_id = resolve(it.second.return_type_id),
+            .function_type_id = resolve(it.second.function_type_id),
+            .open_label_id = resolve(it.second.open_label_id),
+            .id = resolve(it.second.id)
+        };
+        global_funcs_.emplace(fh.id, fh);
+    }
+
+    stats_.types_interned += fork.stats_.types_interned;
+    stats_.types_deduplicated += fork.stats_.types_deduplicated;
+    stats_.consts_interned += fork.stats_.consts_interned;
+    stats_.consts_deduplicated += fork.stats_.consts_deduplicated;
+    stats_.exprs_interned += fork.stats_.exprs_interned;
+    stats_.exprs_deduplicated += fork.stats_.exprs_deduplicated;
+    return [ids{std::move(ids)}] (id_t id) { return resolve_fork_id(ids, id); };
+}
+
+void Layer1::set_entry(id_t main_id, const std::string& name)
 {
     push_entry_listed_id(global_invocation_id());
 
     EntryDef ed;
-    ed.local_size_x = 4;
-    ed.local_size_y = 4;
-    ed.local_size_z = 1;
+    ed.local_size_x_id = local_size_id(0);
+    ed.local_size_y_id = local_size_id(1);
+    ed.local_size_z_id = local_size_id(2);
     ed.input_ids = entry_listed_ids_;
     ed.main_id = main_id;
+    ed.name = name;
     code_gen_.push_entry(ed);
 }
 
+void Layer1::set_local_size(int x, int y, int z)
+{
+    assert(spec_consts_.find(SPEC_LOCAL_SIZE_X) == spec_consts_.end() && "Local size already in use");
+    local_size_x_ = x;
+    local_size_y_ = y;
+    local_size_z_ = z;
+}
+
+id_t Layer1::local_size_id(int axis)
+{
+    switch (axis) {
+    case 0:     return add_spec_const(DT_UINT32, local_size_x_, SPEC_LOCAL_SIZE_X);
+    case 1:     return add_spec_const(DT_UINT32, local_size_y_, SPEC_LOCAL_SIZE_Y);
+    case 2:     return add_spec_const(DT_UINT32, local_size_z_, SPEC_LOCAL_SIZE_Z);
+    default:    assert(false && "Bad axis");
+    }
+
+    return 0; // unreachable, return something to suppress compiler warning
+}
+
 id_t Layer1::add_dtype(DType dtype)
 {
-    static std::unordered_map<DType, id_t> defs_;
-    if (defs_.find(dtype) == defs_.end()) {
-        const auto id{alloc_id()};
-        defs_.insert(std::make_pair(dtype, id));
-        code_gen_.push_dtype(dtype, id);
+    auto found{find_interned(&Layer1::dtypes_, dtype)};
+    if (found != nullptr) {
+        ++stats_.types_deduplicated;
+        return *found;
+    }
+    if (is_fork()) {
+        auto id{defer([dtype] (Layer1& parent, const IdResolver&) { return parent.add_dtype(dtype); })};
+        dtypes_.emplace(dtype, id);
+        return id;
+    }
+
+    ++stats_.types_interned;
+    const auto id{alloc_id()};
+    dtypes_.emplace(dtype, id);
+    code_gen_.push_dtype(dtype, id);
+    if (dtype == DT_FLOAT16) {
+        add_capability(CAP_FLOAT16);
     }
-    return defs_.at(dtype);
+    return id;
 }
 
 id_t Layer1::add_type_pointer(id_t type_id, StorageClass sc)
 {
-    static std::vector<TypePointerDef> dfs;
-
-    for (size_t i = 0; i < dfs.size(); ++i) {
-        const auto& df{dfs.at(i)};
-        if (df.type_id == type_id && df.storage_class == sc) {
-            return df.id;
-        }
+    const auto key{pack_key(type_id, sc)};
+    auto found{find_interned(&Layer1::type_pointers_, key)};
+    if (found != nullptr) {
+        ++stats_.types_deduplicated;
+        return *found;
+    }
+    if (is_fork()) {
+        auto id{defer([type_id, sc] (Layer1& parent, const IdResolver& resolve) {
+            return parent.add_type_pointer(resolve(type_id), sc);
+        })};
+        type_pointers_.emplace(key, id);
+        return id;
     }
 
+    ++stats_.types_interned;
     TypePointerDef tpd;
     tpd.type_id = type_id;
     tpd.id  = alloc_id();
     tpd.storage_class = sc;
-    dfs.push_back(tpd);
+    type_pointers_.emplace(key, tpd.id);
     code_gen_.push_type_pointer(tpd);
 
+    auto half{dtypes_.find(DT_FLOAT16)};
+    if (sc == SC_STORAGE_BUFFER && half != dtypes_.end() && half->second == type_id) {
+        add_capability(CAP_STORAGE_BUFFER_16BIT_ACCESS);
+    }
+
     return tpd.id;
 }
 
 id_t Layer1::add_var(id_t type_id, StorageClass sc, id_t initializer)
 {
+    if (sc != SC_FUNCTION && is_fork()) {
+        return defer([type_id, sc, initializer] (Layer1& parent, const IdResolver& resolve) {
+            return parent.add_var(resolve(type_id), sc, resolve(initializer));
+        });
+    }
+
     VarDef vd;
     vd.id = alloc_id();
     vd.initializer_id = initializer;
@@ -68,144 +224,212 @@ id_t Layer1::add_var(id_t type_id, StorageClass sc, id_t initializer)
 
 id_t Layer1::add_struct_dtype(const std::vector<id_t>& dtypes, bool reuse)
 {
-    static std::vector<StructTypeDef> defs;
-
-    auto struct_match{[&dtypes] (const StructTypeDef& std) -> bool {
-        if (std.num_fields != dtypes.size()) return false;
-        for (int i = 0; i < std.num_fields; ++i) {
-            if (std.fields[i] != dtypes.at(i)) return false;
-        }
-        return true;
-    }};
-
     if (reuse) {
-        for (const auto& it : defs) {
-            if (struct_match(it)) {
-                return it.id;
-            }
+        auto found{find_interned(&Layer1::struct_dtypes_, dtypes)};
+        if (found != nullptr) {
+            ++stats_.types_deduplicated;
+            return *found;
         }
     }
+    if (is_fork()) {
+        auto id{defer([dtypes, reuse] (Layer1& parent, const IdResolver& resolve) {
+            return parent.add_struct_dtype(resolve_all(resolve, dtypes), reuse);
+        })};
+        if (reuse) {
+            struct_dtypes_.emplace(dtypes, id);
+        }
+        return id;
+    }
 
+    ++stats_.types_interned;
     StructTypeDef std{.id = alloc_id(), .num_fields = dtypes.size()};
     std.fields.resize(std.num_fields);
     memcpy(std.fields.data(), dtypes.data(), sizeof(std.fields[0]) * std.num_fields);
     if (reuse) {
-        defs.push_back(std);
+        struct_dtypes_.emplace(dtypes, std.id);
     }
     code_gen_.push_struct_dtype(std);
     return std.id;
 }
 
-id_t Layer1::add_array_dtype(id_t dtype, uint32_t length, StorageClass sc, bool reuse)
+id_t Layer1::add_array_dtype(id_t dtype, uint32_t length, StorageClass sc, bool reuse, uint32_t stride)
 {
-    static std::vector<ArrTypeDef> defs;
-    static std::vector<DecorateArrayDef> decos;
-
-    DecorateArrayDef this_deco;
-    auto already_decorate_in{[&this_deco] (const std::vector<DecorateArrayDef>& targets) -> bool {
-        for (const auto& it : targets) {
-            if (it.array_type_id == this_deco.array_type_id) {
-                return true;
-            }
+    const auto key{pack_key(dtype, length)};
+    if (is_fork()) {
+        auto found{reuse ? find_interned(&Layer1::array_dtypes_, key) : nullptr};
+        auto id{defer_decorated_type(found, sc, [dtype, length, sc, reuse, stride] (Layer1& parent, const IdResolver& resolve) {
+            return parent.add_array_dtype(resolve(dtype), length, sc, reuse, stride);
+        })};
+        if (found == nullptr && reuse) {
+            array_dtypes_.emplace(key, id);
         }
-        return false;
-    }};
+        return id;
+    }
 
     id_t array_type_id{};
     bool should_create_array_type{true};
     if (reuse) {
-        for (const auto& it : defs) {
-            if (it.dtype == dtype && it.length == length) {
-                array_type_id = it.id;
-                should_create_array_type = false;
-                break;
-            }
+        auto found{array_dtypes_.find(key)};
+        if (found != array_dtypes_.end()) {
+            array_type_id = found->second;
+            should_create_array_type = false;
+            ++stats_.types_deduplicated;
         }
     }
 
     if (should_create_array_type) {
+        ++stats_.types_interned;
         id_t length_id{add_const(DT_UINT32, length)};
         ArrTypeDef arr{.length = length, .dtype = dtype, .length_id = length_id, .id = alloc_id()};
         array_type_id = arr.id;
 
         if (reuse) {
-            defs.push_back(arr);   
+            array_dtypes_.emplace(key, arr.id);
         }
         code_gen_.push_array_dtype(arr);
     }
 
-    this_deco.array_type_id = array_type_id;
-    if (should_decorate(sc) && !already_decorate_in(decos)) {
+    if (should_decorate(sc) && decorated_types_.insert(array_type_id).second) {
+        DecorateArrayDef this_deco;
+        this_deco.array_type_id = array_type_id;
+        this_deco.stride = stride;
         code_gen_.push_array_decorate(this_deco);
-        decos.push_back(this_deco);
     }
 
     return array_type_id;
 }
 
-id_t Layer1::add_const_array(id_t arr_type, const std::vector<id_t>& elem_ids)
+id_t Layer1::add_spec_array_dtype(id_t dtype, id_t length_id, StorageClass sc)
 {
-    static std::vector<ConstCompositeDef> dfs{};
+    const auto key{pack_key(dtype, length_id)};
+    if (is_fork()) {
+        auto found{find_interned(&Layer1::spec_array_dtypes_, key)};
+        auto id{defer_decorated_type(found, sc, [dtype, length_id, sc] (Layer1& parent, const IdResolver& resolve) {
+            return parent.add_spec_array_dtype(resolve(dtype), resolve(length_id), sc);
+        })};
+        if (found == nullptr) {
+            spec_array_dtypes_.emplace(key, id);
+        }
+        return id;
+    }
 
-    ConstCompositeDef ccd;
-    ccd.type_id = arr_type;
-    ccd.elem_ids = elem_ids;
+    id_t array_type_id{};
+    auto found{spec_array_dtypes_.find(key)};
+    if (found != spec_array_dtypes_.end()) {
+        array_type_id = found->second;
+        ++stats_.types_deduplicated;
+    } else {
+        ++stats_.types_interned;
+        ArrTypeDef arr{.length = 0, .dtype = dtype, .length_id = length_id, .id = alloc_id()};
+        array_type_id = arr.id;
+        spec_array_dtypes_.emplace(key, arr.id);
+        code_gen_.push_array_dtype(arr);
+    }
 
-    auto arr_matched{[&ccd] (const ConstCompositeDef& target) -> bool {
-        if (target.type_id != ccd.type_id) return false;
-        return target.elem_ids == ccd.elem_ids;
-    }};
-        
-    for (const auto& it : dfs) {
-        if (arr_matched(it)) {
-            return it.id;
+    if (should_decorate(sc) && decorated_types_.insert(array_type_id).second) {
+        DecorateArrayDef this_deco;
+        this_deco.array_type_id = array_type_id;
+        code_gen_.push_array_decorate(this_deco);
+    }
+
+    return array_type_id;
+}
+
+id_t Layer1::add_runtime_array_dtype(id_t dtype, StorageClass sc, uint32_t stride)
+{
+    if (is_fork()) {
+        auto found{find_interned(&Layer1::runtime_array_dtypes_, dtype)};
+        auto id{defer_decorated_type(found, sc, [dtype, sc, stride] (Layer1& parent, const IdResolver& resolve) {
+            return parent.add_runtime_array_dtype(resolve(dtype), sc, stride);
+        })};
+        if (found == nullptr) {
+            runtime_array_dtypes_.emplace(dtype, id);
         }
+        return id;
     }
 
-    ccd.id = alloc_id();
-    dfs.push_back(ccd);
-    code_gen_.push_const_composite(ccd);
-    return ccd.id;
+    id_t array_type_id{};
+    auto found{runtime_array_dtypes_.find(dtype)};
+    if (found != runtime_array_dtypes_.end()) {
+        array_type_id = found->second;
+        ++stats_.types_deduplicated;
+    } else {
+        ++stats_.types_interned;
+        RuntimeArrTypeDef arr{.dtype = dtype, .id = alloc_id()};
+        array_type_id = arr.id;
+        runtime_array_dtypes_.emplace(dtype, arr.id);
+        code_gen_.push_runtime_array_dtype(arr);
+    }
+
+    if (should_decorate(sc) && decorated_types_.insert(array_type_id).second) {
+        DecorateArrayDef this_deco;
+        this_deco.array_type_id = array_type_id;
+        this_deco.stride = stride;
+        code_gen_.push_array_decorate(this_deco);
+    }
+
+    return array_type_id;
 }
 
+id_t Layer1::add_const_array(id_t arr_type, const std::vector<id_t>& elem_ids)
+{
+    return add_const_composite(arr_type, elem_ids);
+}
 
 id_t Layer1::add_const_struct(id_t type_id, const std::vector<id_t>& elem_ids)
 {
-    static std::vector<ConstCompositeDef> dfs;
-
-    ConstCompositeDef sd;
-    sd.type_id = type_id;
-    sd.id = alloc_id();
-    sd.elem_ids = elem_ids;
+    return add_const_composite(type_id, elem_ids);
+}
 
-    auto const_struct_matched{[&sd] (const ConstCompositeDef& target) -> bool {
-        if (target.type_id != sd.type_id) {
-            return false;
-        }
-        return sd.elem_ids == target.elem_ids;
-    }};
+id_t Layer1::add_const_vector(id_t vector_type_id, const std::vector<id_t>& elem_ids)
+{
+    return add_const_composite(vector_type_id, elem_ids);
+}
 
-    bool should_create_const_tensor{true};
-    for (const auto& it : dfs) {
-        if (const_struct_matched(it)) {
-            sd.id = it.id;
-            should_create_const_tensor = false;
-            break;
-        }
+id_t Layer1::add_const_composite(id_t type_id, const std::vector<id_t>& elem_ids)
+{
+    std::vector<id_t> key;
+    key.reserve(elem_ids.size() + 1);
+    key.push_back(type_id);
+    key.insert(key.end(), elem_ids.begin(), elem_ids.end());
+
+    auto found{find_interned(&Layer1::const_composites_, key)};
+    if (found != nullptr) {
+        ++stats_.consts_deduplicated;
+        return *found;
     }
-
-    if (should_create_const_tensor) {
-        dfs.push_back(sd);
-        code_gen_.push_const_composite(sd);
+    if (is_fork()) {
+        auto id{defer([type_id, elem_ids] (Layer1& parent, const IdResolver& resolve) {
+            return parent.add_const_composite(resolve(type_id), resolve_all(resolve, elem_ids));
+        })};
+        const_composites_.emplace(std::move(key), id);
+        return id;
     }
 
-    return sd.id;
+    ++stats_.consts_interned;
+    ConstCompositeDef ccd;
+    ccd.type_id = type_id;
+    ccd.elem_ids = elem_ids;
+    ccd.id = alloc_id();
+    const_composites_.emplace(std::move(key), ccd.id);
+    code_gen_.push_const_composite(ccd);
+    return ccd.id;
 }
 
 void Layer1::add_struct_decorate(id_t type_id, Decoration deco, StorageClass sc,
     const std::vector<std::pair<uint32_t, uint32_t>>& member_deco)
 {
-    static std::vector<DecorateStructDef> decos;
+    if (!should_decorate(sc) || contains_interned(&Layer1::decorated_types_, type_id)) {
+        return;
+    }
+    decorated_types_.insert(type_id);
+    if (is_fork()) {
+        defer_effect([type_id, deco, sc, member_deco] (Layer1& parent, const IdResolver& resolve) {
+            parent.add_struct_decorate(resolve(type_id), deco, sc, member_deco);
+            return 0;
+        });
+        return;
+    }
 
     DecorateStructDef dsd;
     dsd.deco = deco;
@@ -213,22 +437,19 @@ void Layer1::add_struct_decorate(id_t type_id, Decoration deco, StorageClass sc,
     for (const auto& it : member_deco) {
         dsd.member_deco.push_back({.field = it.first, .offset = it.second});
     }
-
-    auto already_decorate_in{[&dsd] (const std::vector<DecorateStructDef>& targets) -> bool {
-        for (const auto& it : targets) {
-            if (it.struct_type_id == dsd.struct_type_id) return true;
-        }
-        return false;
-    }};
-
-    if (should_decorate(sc) && !already_decorate_in(decos)) {
-        decos.push_back(dsd);
-        code_gen_.push_struct_decorate(dsd);
-    }
+    code_gen_.push_struct_decorate(dsd);
 }
 
 void Layer1::add_binding(id_t var_id, int binding, int set)
 {
+    if (is_fork()) {
+        defer_effect([var_id, binding, set] (Layer1& parent, const IdResolver& resolve) {
+            parent.add_binding(resolve(var_id), binding, set);
+            return 0;
+        });
+        return;
+    }
+
     DecorateSetBindingDef binding_deco;
 
     binding_deco.binding = binding;
@@ -237,29 +458,57 @@ void Layer1::add_binding(id_t var_id, int binding, int set)
     code_gen_.push_decorate_set_binding(binding_deco);
 }
 
+void Layer1::add_decorate(id_t target, Decoration deco)
+{
+    if (is_fork()) {
+        defer_effect([target, deco] (Layer1& parent, const IdResolver& resolve) {
+            parent.add_decorate(resolve(target), deco);
+            return 0;
+        });
+        return;
+    }
+
+    DecorateDef dd;
+    dd.target = target;
+    dd.deco = deco;
+    code_gen_.push_decorate(dd);
+}
+
 id_t Layer1::add_void_type()
 {
-    static bool defined{false};
-    static id_t id{};
-    if (defined) return id;
+    if (void_type_id_ != 0) {
+        ++stats_.types_deduplicated;
+        return void_type_id_;
+    }
+    if (is_fork()) {
+        void_type_id_ = defer([] (Layer1& parent, const IdResolver&) { return parent.add_void_type(); });
+        return void_type_id_;
+    }
 
-    id = alloc_id();
-    code_gen_.push_void_type(id);
-    defined = true;
-    return id;
+    ++stats_.types_interned;
+    void_type_id_ = alloc_id();
+    code_gen_.push_void_type(void_type_id_);
+    return void_type_id_;
 }
 
 id_t Layer1::add_function_type(id_t return_type_id)
 {
-    static std::vector<FunctionTypeDef> defs;
-    for (auto it : defs) {
-        if (it.return_type_id == return_type_id) {
-            return it.id;
-        }
+    auto found{find_interned(&Layer1::function_types_, return_type_id)};
+    if (found != nullptr) {
+        ++stats_.types_deduplicated;
+        return *found;
+    }
+    if (is_fork()) {
+        auto id{defer([return_type_id] (Layer1& parent, const IdResolver& resolve) {
+            return parent.add_function_type(resolve(return_type_id));
+        })};
+        function_types_.emplace(return_type_id, id);
+        return id;
     }
 
+    ++stats_.types_interned;
     FunctionTypeDef ft{.return_type_id = return_type_id, .id = alloc_id()};
-    defs.push_back(ft);
+    function_types_.emplace(return_type_id, ft.id);
     code_gen_.push_function_type(ft);
     return ft.id;
 }
@@ -314,16 +563,23 @@ void Layer1::add_control_barrier(Scope exe_scope, Scope mem_scope, MemSemantic m
 
 id_t Layer1::add_vector_dtype(id_t component_type_id, int count)
 {
-    static std::vector<VectorDef> defs;
-
-    for (const auto& it : defs) {
-        if (it.component_type_id == component_type_id && it.count == count) {
-            return it.id;
-        }
+    const auto key{pack_key(component_type_id, count)};
+    auto found{find_interned(&Layer1::vector_dtypes_, key)};
+    if (found != nullptr) {
+        ++stats_.types_deduplicated;
+        return *found;
+    }
+    if (is_fork()) {
+        auto id{defer([component_type_id, count] (Layer1& parent, const IdResolver& resolve) {
+            return parent.add_vector_dtype(resolve(component_type_id), count);
+        })};
+        vector_dtypes_.emplace(key, id);
+        return id;
     }
 
+    ++stats_.types_interned;
     VectorDef vd{.id = alloc_id(), .component_type_id = component_type_id, .count = count};
-    defs.push_back(vd);
+    vector_dtypes_.emplace(key, vd.id);
     code_gen_.push_vector_dtype(vd);
 
     return vd.id;
@@ -331,20 +587,34 @@ id_t Layer1::add_vector_dtype(id_t component_type_id, int count)
 
 id_t Layer1::global_invocation_id()
 {
-    static bool has_defined{false};
-    static id_t id{0};
-    if (has_defined) {
+    return builtin_var(BI_GLOBAL_INVOCATION_ID);
+}
+
+id_t Layer1::builtin_var(BuiltIn built_in)
+{
+    auto found{find_interned(&Layer1::builtin_vars_, built_in)};
+    if (found != nullptr) {
+        return *found;
+    }
+    if (is_fork()) {
+        auto id{defer([built_in] (Layer1& parent, const IdResolver&) { return parent.builtin_var(built_in); })};
+        builtin_vars_.emplace(built_in, id);
         return id;
     }
 
+    const bool scalar{built_in == BI_LOCAL_INVOCATION_INDEX || built_in == BI_NUM_SUBGROUPS
+        || built_in == BI_SUBGROUP_ID || built_in == BI_SUBGROUP_LOCAL_INVOCATION_ID};
+    if (built_in == BI_NUM_SUBGROUPS || built_in == BI_SUBGROUP_ID || built_in == BI_SUBGROUP_LOCAL_INVOCATION_ID) {
+        add_capability(CAP_GROUP_NON_UNIFORM);
+    }
     auto uint_type_id{add_dtype(DT_UINT32)};
-    auto vec_uint_3{add_vector_dtype(uint_type_id, 3)};
-    id = add_var(vec_uint_3, SC_INPUT);
-    has_defined = true;
+    auto id{add_var(scalar ? uint_type_id : add_vector_dtype(uint_type_id, 3), SC_INPUT)};
+    builtin_vars_.emplace(built_in, id);
+    push_entry_listed_id(id);
 
     DecorateBuiltInDef deco;
     deco.var_id = id;
-    deco.built_in = BI_GLOBAL_INVOCATION_ID;
+    deco.built_in = built_in;
     code_gen_.push_builtin_decorate(deco);
 
     return id;
@@ -368,26 +638,51 @@ void Layer1::store_var(id_t pointer, id_t object)
     code_gen_.push_store(sd);
 }
 
+void Layer1::begin_scope()
+{
+    scopes_.emplace_back();
+}
+
+void Layer1::end_scope()
+{
+    assert(!scopes_.empty() && "Unbalanced scope");
+    const auto& scope{scopes_.back()};
+    for (const auto& it : scope.access_chains) {
+        access_chains_.erase(it);
+    }
+    for (const auto& it : scope.binary_ops) {
+        binary_ops_.erase(it);
+    }
+    for (const auto& it : scope.invocation_indices) {
+        invocation_indices_.erase(it);
+    }
+    scopes_.pop_back();
+}
+
 id_t Layer1::access_chain(id_t func_id, id_t type_id, id_t base_id, const std::vector<id_t>& index_ids)
 {
-    static std::vector<AccessChainDef> dfs;
-    AccessChainDef acd;
+    // reusable check
+    std::vector<id_t> key;
+    key.reserve(index_ids.size() + 2);
+    key.push_back(func_id);
+    key.push_back(base_id);
+    key.insert(key.end(), index_ids.begin(), index_ids.end());
+    auto found{access_chains_.find(key)};
+    if (found != access_chains_.end()) {
+        return found->second;
+    }
 
+    AccessChainDef acd;
     acd.index_ids = index_ids;
     acd.func_id = func_id;
     acd.base_id = base_id;
     acd.type_id = type_id;
-
-    // reusable check
-    for (const auto& it: dfs) {
-        if (it.func_id == acd.func_id && it.base_id == acd.base_id && it.index_ids == acd.index_ids) {
-            return it.id;
-        }
-    }
-
     acd.id = alloc_id();
     code_gen_.push_access_chain(acd);
-    dfs.push_back(acd);
+    if (!scopes_.empty()) {
+        scopes_.back().access_chains.push_back(key);
+    }
+    access_chains_.emplace(std::move(key), acd.id);
     return acd.id;
 }
 
@@ -404,16 +699,20 @@ id_t Layer1::access_chain_indices(id_t func_id, id_t type_id, id_t base_id, cons
 
 id_t Layer1::access_invocation_index(id_t func_id, uint32_t index)
 {
-    static std::vector<AccessInvocationEelementDef> dfs;
-    AccessInvocationEelementDef def;
+    return access_builtin_index(func_id, BI_GLOBAL_INVOCATION_ID, index);
+}
 
-    for (const auto& it: dfs) {
-        if (it.func_id == func_id && it.index == index) {
-            return it.id;
-        }
+id_t Layer1::access_builtin_index(id_t func_id, BuiltIn built_in, uint32_t index)
+{
+    const auto key{pack_key(func_id, (static_cast<uint32_t>(built_in) << 2) | index)};
+    auto found{invocation_indices_.find(key)};
+    if (found != invocation_indices_.end()) {
+        return found->second;
     }
 
-    def.invo_id = global_invocation_id();
+    AccessInvocationEelementDef def;
+
+    def.invo_id = builtin_var(built_in);
     def.invo_comp_type_id = add_dtype(DT_UINT32);
     def.invo_comp_type_ptr_id = add_type_pointer(def.invo_comp_type_id, SC_INPUT);
     def.invo_comp_ptr_id = access_chain_indices(func_id, def.invo_comp_type_ptr_id, def.invo_id, {index});
@@ -421,20 +720,45 @@ id_t Layer1::access_invocation_index(id_t func_id, uint32_t index)
     def.func_id = func_id;
     def.index = index;
 
-    dfs.push_back(def);
+    if (!scopes_.empty()) {
+        scopes_.back().invocation_indices.push_back(key);
+    }
+    invocation_indices_.emplace(key, def.id);
     return def.id;
 }
 
-id_t Layer1::binary_op(BinaryOperator bo, id_t func_id, id_t type_id, id_t op1_id, id_t op2_id)
+id_t Layer1::access_builtin(id_t func_id, BuiltIn built_in)
 {
-    static std::vector<BinaryOpDef> dfs;
+    // index 3 is never used by the vector built-ins, it marks the scalar ones
+    const auto key{pack_key(func_id, (static_cast<uint32_t>(built_in) << 2) | 3)};
+    auto found{invocation_indices_.find(key)};
+    if (found != invocation_indices_.end()) {
+        return found->second;
+    }
 
-    for (const auto& it: dfs) {
-        if (it.func_id == func_id && it.bo == bo && it.op1_id == op1_id && it.op2_id == op2_id) {
-            return it.result_id;
-        }
+    auto id{load_var(add_dtype(DT_UINT32), builtin_var(built_in))};
+    if (!scopes_.empty()) {
+        scopes_.back().invocation_indices.push_back(key);
+    }
+    invocation_indices_.emplace(key, id);
+    return id;
+}
+
+id_t Layer1::binary_op(BinaryOperator bo, id_t func_id, id_t type_id, id_t op1_id, id_t op2_id)
+{
+    // operands of commutative operations are keyed in id order
+    const bool commutative{bo == BO_IADD || bo == BO_IMUL || bo == BO_FADD || bo == BO_FMUL || bo == BO_LOGICAL_AND};
+    std::vector<id_t> key{func_id, static_cast<id_t>(bo), type_id, op1_id, op2_id};
+    if (commutative && op2_id < op1_id) {
+        std::swap(key.at(3), key.at(4));
+    }
+    auto found{binary_ops_.find(key)};
+    if (found != binary_ops_.end()) {
+        ++stats_.exprs_deduplicated;
+        return found->second;
     }
 
+    ++stats_.exprs_interned;
     BinaryOpDef bod;
     bod.result_id = alloc_id();
     bod.op1_id = op1_id;
@@ -444,9 +768,76 @@ id_t Layer1::binary_op(BinaryOperator bo, id_t func_id, id_t type_id, id_t op1_i
     bod.bo = bo;
 
     code_gen_.push_binary_operation(bod);
+    if (!scopes_.empty()) {
+        scopes_.back().binary_ops.push_back(key);
+    }
+    binary_ops_.emplace(std::move(key), bod.result_id);
     return bod.result_id;
 }
 
+id_t Layer1::compare(CmpOp cmp_op, id_t op1_id, id_t op2_id)
+{
+    CompareDef cd;
+    cd.result_id = alloc_id();
+    cd.bool_type_id = add_dtype(DT_BOOL);
+    cd.op1_id = op1_id;
+    cd.op2_id = op2_id;
+    cd.cmp_op = cmp_op;
+    code_gen_.push_compare(cd);
+    return cd.result_id;
+}
+
+id_t Layer1::select(id_t type_id, id_t cond_id, id_t obj1_id, id_t obj2_id)
+{
+    SelectDef sd;
+    sd.result_id = alloc_id();
+    sd.type_id = type_id;
+    sd.cond_id = cond_id;
+    sd.obj1_id = obj1_id;
+    sd.obj2_id = obj2_id;
+    code_gen_.push_select(sd);
+    return sd.result_id;
+}
+
+id_t Layer1::convert(ConvertOp op, id_t type_id, id_t value_id)
+{
+    ConvertDef cd{.result_id = alloc_id(), .type_id = type_id, .value_id = value_id, .op = op};
+    code_gen_.push_convert(cd);
+    return cd.result_id;
+}
+
+id_t Layer1::group_reduce(GroupOp op, id_t type_id, id_t value_id)
+{
+    add_capability(CAP_GROUP_NON_UNIFORM);
+    add_capability(CAP_GROUP_NON_UNIFORM_ARITHMETIC);
+    GroupReduceDef grd{.result_id = alloc_id(), .type_id = type_id,
+        .scope_id = add_const(DT_UINT32, static_cast<uint32_t>(SCOPE_SUBGROUP)), .value_id = value_id, .op = op};
+    code_gen_.push_group_reduce(grd);
+    return grd.result_id;
+}
+
+id_t Layer1::bit_field_extract(bool sign_extend, id_t type_id, id_t base_id, id_t offset_id, id_t count_id)
+{
+    BitFieldExtractDef bfed{.result_id = alloc_id(), .type_id = type_id, .base_id = base_id,
+        .offset_id = offset_id, .count_id = count_id, .sign_extend = sign_extend};
+    code_gen_.push_bit_field_extract(bfed);
+    return bfed.result_id;
+}
+
+id_t Layer1::composite_construct(id_t type_id, const std::vector<id_t>& constituent_ids)
+{
+    CompositeConstructDef ccd{.result_id = alloc_id(), .type_id = type_id, .constituent_ids = constituent_ids};
+    code_gen_.push_composite_construct(ccd);
+    return ccd.result_id;
+}
+
+id_t Layer1::composite_extract(id_t type_id, id_t composite_id, uint32_t index)
+{
+    CompositeExtractDef ced{.result_id = alloc_id(), .type_id = type_id, .composite_id = composite_id, .index = index};
+    code_gen_.push_composite_extract(ced);
+    return ced.result_id;
+}
+
 void Layer1::add_return()
 {
     code_gen_.push_return();
@@ -459,11 +850,101 @@ FunctionHeaderDef& Layer1::find_function_def(id_t id)
 
 void Layer1::push_entry_listed_id(id_t id)
 {
-    for (auto it : entry_listed_ids_) {
-        if (it == id) {
+    for (const Layer1* layer1{this}; layer1 != nullptr; layer1 = layer1->parent_) {
+        const auto& listed{layer1->entry_listed_ids_};
+        if (std::find(listed.begin(), listed.end(), id) != listed.end()) {
             return;
         }
     }
     entry_listed_ids_.push_back(id);
+    if (is_fork()) {
+        defer_effect([id] (Layer1& parent, const IdResolver& resolve) {
+            parent.push_entry_listed_id(resolve(id));
+            return 0;
+        });
+    }
+}
+
+void Layer1::add_capability(Capability cap)
+{
+    if (contains_interned(&Layer1::capabilities_, static_cast<uint32_t>(cap))) {
+        return;
+    }
+    capabilities_.insert(cap);
+    if (is_fork()) {
+        defer_effect([cap] (Layer1& parent, const IdResolver&) {
+            parent.add_capability(cap);
+            return 0;
+        });
+        return;
+    }
+    code_gen_.push_capability(cap);
+}
+
+id_t Layer1::defer_decorated_type(const id_t* found, StorageClass sc, const DeferredFn& define)
+{
+    if (found == nullptr) {
+        auto id{defer(define)};
+        if (should_decorate(sc)) {
+            decorated_types_.insert(id);
+        }
+        return id;
+    }
+
+    if (should_decorate(sc) && !contains_interned(&Layer1::decorated_types_, *found)) {
+        // define finds the type, counts it and only adds the decoration
+        decorated_types_.insert(*found);
+        defer_effect(define);
+    } else {
+        ++stats_.types_deduplicated;
+    }
+    return *found;
 }
 
+
+id_t Layer1::add_spec_const(DType dtype, uint32_t value, SpecConstId spec_id)
+{
+    auto found{find_interned(&Layer1::spec_consts_, static_cast<uint32_t>(spec_id))};
+    if (found != nullptr) {
+        ++stats_.consts_deduplicated;
+        return *found;
+    }
+    if (is_fork()) {
+        auto id{defer([dtype, value, spec_id] (Layer1& parent, const IdResolver&) {
+            return parent.add_spec_const(dtype, value, spec_id);
+        })};
+        spec_consts_.emplace(spec_id, id);
+        return id;
+    }
+
+    ++stats_.consts_interned;
+    SpecConstDef scd{.id = alloc_id(), .dtype_id = add_dtype(dtype), .value = value,
+        .spec_id = static_cast<uint32_t>(spec_id)};
+    code_gen_.push_spec_const(scd);
+    spec_consts_.emplace(spec_id, scd.id);
+    return scd.id;
+}
+
+id_t Layer1::spec_const_op(BinaryOperator bo, id_t type_id, id_t op1_id, id_t op2_id)
+{
+    std::vector<id_t> key{static_cast<id_t>(bo), op1_id, op2_id};
+    auto found{find_interned(&Layer1::spec_const_ops_, key)};
+    if (found != nullptr) {
+        ++stats_.consts_deduplicated;
+        return *found;
+    }
+    if (is_fork()) {
+        auto id{defer([bo, type_id, op1_id, op2_id] (Layer1& parent, const IdResolver& resolve) {
+            return parent.spec_const_op(bo, resolve(type_id), resolve(op1_id), resolve(op2_id));
+        })};
+        spec_const_ops_.emplace(std::move(key), id);
+        return id;
+    }
+
+    ++stats_.consts_interned;
+    SpecConstOpDef scod{.result_id = alloc_id(), .type_id = type_id, .op1_id = op1_id,
+        .op2_id = op2_id, .bo = bo};
+    code_gen_.push_spec_const_op(scod);
+    spec_const_ops_.emplace(std::move(key), scod.result_id);
+    return scod.result_id;
+}
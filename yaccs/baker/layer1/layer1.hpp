@@ -3,19 +3,79 @@
 
 #include "yaccs/baker/layer1/exts/exts.hpp"
 #include "yaccs/baker/layer1/utils.hpp"
-#include "yaccs/baker/utils.hpp"
 #include "yaccs/baker/def.hpp"
 #include "yaccs/code_gen/code_gen.hpp"
 #include "yaccs/dtype.hpp"
 #include <cstdint>
+#include <functional>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 
+/**
+ * @brief Intern table counters. A definition is interned when it is emitted and
+ * deduplicated when a later request returns the existing id instead.
+ */
+struct InternStats
+{
+    size_t types_interned;
+    size_t types_deduplicated;
+    size_t consts_interned;
+    size_t consts_deduplicated;
+    size_t exprs_interned;
+    size_t exprs_deduplicated;
+}; // struct InternStats
+
+/**
+ * @brief Function local keys interned inside one structured control flow scope, a
+ * loop or an if body. The values do not dominate the code after the scope, so the
+ * keys are erased when it closes.
+ */
+struct InternScope
+{
+    std::vector<std::vector<id_t>> access_chains;
+    std::vector<std::vector<id_t>> binary_ops;
+    std::vector<uint64_t> invocation_indices;
+}; // struct InternScope
+
+struct Layer1;
+
+// ids of a fork renamed to the ones they got in its parent
+using IdResolver = std::function<id_t(id_t)>;
+// replays a definition deferred by a fork on its parent, returns the id it got there
+using DeferredFn = std::function<id_t(Layer1& parent, const IdResolver& resolve)>;
+
+struct Deferred
+{
+    id_t id;            // the fork id standing for the result, 0 if there is none
+    id_t position;      // the fork ids below it were allocated before the definition
+    DeferredFn define;
+}; // struct Deferred
+
 struct Layer1
 {
     Layer1();
+    /**
+     * @brief A fork emits functions concurrently with the other forks of parent. It reads
+     * the intern tables of parent, which must not change until the fork is joined, and
+     * allocates ids from a range of its own. Module level definitions parent does not
+     * have yet are deferred, join replays them.
+     */
+    explicit Layer1(const Layer1* parent);
+    /**
+     * @brief Replay the deferred definitions of fork and append its functions. The fork
+     * ids are renamed in allocation order, so the module is the same as if the functions
+     * had been emitted here directly. Returns the renaming.
+     */
+    IdResolver join(const Layer1& fork);
+    bool is_fork() const { return parent_ != nullptr; }
+    id_t alloc_id() { return code_gen_.alloc_id(); }
+    // fork only, returns the fork id standing for the id define returns on join
+    id_t defer(const DeferredFn& define);
+    // fork only, define runs on join for its side effects
+    void defer_effect(const DeferredFn& define);
     // function component
     void add_function_epilogue();
     id_t add_function_prologue(id_t return_type_id);
@@ -26,20 +86,36 @@ struct Layer1
     void store_var(id_t pointer, id_t object);
     id_t access_chain_indices(id_t func_id, id_t type_id, id_t base_id, const std::vector<uint32_t>& indices);
     id_t access_chain(id_t func_id, id_t type_id, id_t base_id, const std::vector<id_t>& indices);
+    // values interned between begin_scope and end_scope are only reused inside it
+    void begin_scope();
+    void end_scope();
     void add_control_barrier(Scope exe_scope, Scope mem_scope, MemSemantic mem_semantics);
     id_t access_invocation_index(id_t func_id, uint32_t index);
+    id_t access_builtin_index(id_t func_id, BuiltIn built_in, uint32_t index);
+    // scalar built-ins, e.g. LocalInvocationIndex or SubgroupId
+    id_t access_builtin(id_t func_id, BuiltIn built_in);
     id_t global_invocation_id();
+    id_t builtin_var(BuiltIn built_in);
 
     // type def
     id_t add_void_type();
     id_t add_function_type(id_t return_type_id);
     id_t add_struct_dtype(const std::vector<id_t>& dtypes, bool reuse=true);
     id_t add_vector_dtype(id_t component_type_id, int count);
-    id_t add_array_dtype(id_t dtype, uint32_t length, StorageClass sc, bool reuse=true);
+    id_t add_array_dtype(id_t dtype, uint32_t length, StorageClass sc, bool reuse=true, uint32_t stride=4);
+    id_t add_runtime_array_dtype(id_t dtype, StorageClass sc, uint32_t stride=4);
+    id_t add_spec_array_dtype(id_t dtype, id_t length_id, StorageClass sc);
     id_t add_dtype(DType dtype);
 
-    void set_entry(id_t main_id);
+    void set_entry(id_t main_id, const std::string& name="main");
+    // must be called before the local size is first used
+    void set_local_size(int x, int y, int z);
+    id_t local_size_id(int axis);
+    int local_size_x() const { return local_size_x_; }
+    int local_size_y() const { return local_size_y_; }
+    int local_size_z() const { return local_size_z_; }
     void add_binding(id_t var_id, int binding, int set);
+    void add_decorate(id_t target, Decoration deco);
     void add_struct_decorate(id_t type_id, Decoration deco, StorageClass sc,
         const std::vector<std::pair<uint32_t, uint32_t>>& member_deco);
 
@@ -49,37 +125,130 @@ struct Layer1
     id_t add_type_pointer(id_t type_id, StorageClass sc);
     id_t add_const_array(id_t arr_type, const std::vector<id_t>& elem_ids);
     id_t add_const_struct(id_t struct_id, const std::vector<id_t>& elem_ids);
+    id_t add_const_vector(id_t vector_type_id, const std::vector<id_t>& elem_ids);
     id_t add_var(id_t type_id, StorageClass sc, id_t initializer = 0);
+    id_t add_spec_const(DType dtype, uint32_t value, SpecConstId spec_id);
 
     // arithmatic
     id_t binary_op(BinaryOperator bo, id_t func_id, id_t type_id, id_t op1_id, id_t op2_id);
+    id_t compare(CmpOp cmp_op, id_t op1_id, id_t op2_id);
+    id_t select(id_t type_id, id_t cond_id, id_t obj1_id, id_t obj2_id);
+    id_t convert(ConvertOp op, id_t type_id, id_t value_id);
+    // reduce value_id over the invocations of the subgroup
+    id_t group_reduce(GroupOp op, id_t type_id, id_t value_id);
+    // count bits of base starting at bit offset, sign or zero extended to type_id
+    id_t bit_field_extract(bool sign_extend, id_t type_id, id_t base_id, id_t offset_id, id_t count_id);
+    id_t composite_construct(id_t type_id, const std::vector<id_t>& constituent_ids);
+    id_t composite_extract(id_t type_id, id_t composite_id, uint32_t index);
+    id_t spec_const_op(BinaryOperator bo, id_t type_id, id_t op1_id, id_t op2_id);
 
     ext::Ext* std450() { return &std450_; }
     CodeGen* code_gen() { return &code_gen_; }
+    const CodeGen* code_gen() const { return &code_gen_; }
+    const InternStats& stats() const { return stats_; }
+    size_t num_functions() const { return global_funcs_.size(); }
     void push_entry_listed_id(id_t id);
+    void add_capability(Capability cap);
     FunctionHeaderDef& find_function_def(id_t id);
 private:
+    const Layer1* parent_;
+    std::vector<Deferred> deferred_;
     std::vector<id_t> entry_listed_ids_;
     std::unordered_map<id_t, FunctionHeaderDef> global_funcs_;
     CodeGen code_gen_;
     ext::Ext std450_;
+    int local_size_x_;
+    int local_size_y_;
+    int local_size_z_;
+    id_t void_type_id_;
+    InternStats stats_;
+
+    // intern tables, map the defining key to the defined id
+    std::unordered_map<DType, id_t> dtypes_;
+    std::unordered_map<ConstKey, id_t, ConstKeyHash> consts_;
+    std::unordered_map<uint64_t, id_t> type_pointers_;          // (type, storage class)
+    std::unordered_map<uint64_t, id_t> array_dtypes_;           // (dtype, length)
+    std::unordered_map<id_t, id_t> runtime_array_dtypes_;       // dtype
+    std::unordered_map<uint64_t, id_t> vector_dtypes_;          // (component type, count)
+    std::unordered_map<id_t, id_t> function_types_;             // return type
+    std::unordered_map<std::vector<id_t>, id_t, IdsHash> struct_dtypes_;      // fields
+    std::unordered_map<std::vector<id_t>, id_t, IdsHash> const_composites_;   // (type, elements...)
+    std::unordered_map<std::vector<id_t>, id_t, IdsHash> access_chains_;      // (func, base, indices...)
+    std::unordered_map<std::vector<id_t>, id_t, IdsHash> binary_ops_;         // (func, op, type, op1, op2)
+    std::unordered_map<uint64_t, id_t> invocation_indices_;     // (func, built-in << 2 | index)
+    std::unordered_map<uint32_t, id_t> builtin_vars_;           // built-in
+    std::unordered_set<id_t> decorated_types_;
+    std::unordered_map<uint32_t, id_t> spec_consts_;            // spec id
+    std::unordered_map<std::vector<id_t>, id_t, IdsHash> spec_const_ops_;     // (op, op1, op2)
+    std::unordered_map<uint64_t, id_t> spec_array_dtypes_;      // (dtype, length id)
+    std::unordered_set<uint32_t> capabilities_;
+    std::vector<InternScope> scopes_;
+
+    id_t add_const_composite(id_t type_id, const std::vector<id_t>& elem_ids);
+    // add_const with the type defined already, a fork replays this one
+    template<typename T>
+    id_t intern_const(DType dtype, id_t dtype_id, T value);
+    // fork only, a type of the parent may still miss the decoration of sc
+    id_t defer_decorated_type(const id_t* found, StorageClass sc, const DeferredFn& define);
+
+    // the own intern table first, then the one of the parent
+    template<typename Table, typename Key>
+    const id_t* find_interned(Table Layer1::* table, const Key& key) const;
+    template<typename Set, typename Key>
+    bool contains_interned(Set Layer1::* set, const Key& key) const;
 }; // struct Layer1
 
+template<typename Table, typename Key>
+const id_t* Layer1::find_interned(Table Layer1::* table, const Key& key) const
+{
+    for (auto layer1{this}; layer1 != nullptr; layer1 = layer1->parent_) {
+        const auto& interned{layer1->*table};
+        auto found{interned.find(key)};
+        if (found != interned.end()) {
+            return &found->second;
+        }
+    }
+    return nullptr;
+}
+
+template<typename Set, typename Key>
+bool Layer1::contains_interned(Set Layer1::* set, const Key& key) const
+{
+    for (auto layer1{this}; layer1 != nullptr; layer1 = layer1->parent_) {
+        if ((layer1->*set).count(key) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 template<typename T>
 id_t Layer1::add_const(DType dtype, T value)
 {
-    static std::vector<DTypeConstDef<T>> defs{};
+    return intern_const(dtype, add_dtype(dtype), value);
+}
 
-    auto dtype_id{add_dtype(dtype)};
-    for (auto& it: defs) {
-        if (it.dtype_id == dtype_id && value_eq(it.value, value)) {
-            return it.id;
-        }
+template<typename T>
+id_t Layer1::intern_const(DType dtype, id_t dtype_id, T value)
+{
+    ConstKey key{.dtype_id = dtype_id, .bits = literal_bits(dtype, value)};
+    auto found{find_interned(&Layer1::consts_, key)};
+    if (found != nullptr) {
+        ++stats_.consts_deduplicated;
+        return *found;
+    }
+    if (is_fork()) {
+        auto id{defer([dtype, dtype_id, value] (Layer1& parent, const IdResolver& resolve) {
+            return parent.intern_const(dtype, resolve(dtype_id), value);
+        })};
+        consts_.emplace(key, id);
+        return id;
     }
 
-    DTypeConstDef<T> dconst {.value = value, .dtype_id = dtype_id, .id = alloc_id()};
+    ++stats_.consts_interned;
+    DTypeConstDef<T> dconst {.value = value, .dtype = dtype, .dtype_id = dtype_id, .id = alloc_id()};
     code_gen_.push_const_dtype(dconst);
-    defs.push_back(dconst);
+    consts_.emplace(key, dconst.id);
     return dconst.id;
 }
 
@@ -5,6 +5,7 @@ StorageClass storage_class_for_accessment(StorageClass sc)
 {
     switch (sc) {
     case SC_GLOBAL_CONST:   return SC_FUNCTION;
+    case SC_GLOBAL_WEIGHT:  return SC_STORAGE_BUFFER;
     default:                return sc;
     }
 }
@@ -81,12 +82,14 @@ const std::string& as_string(Decoration deco)
     static const std::string specid{"SpecId"};
     static const std::string block{"Block"};   
     static const std::string buffer_block{"BufferBlock"};   
+    static const std::string non_writable{"NonWritable"};
 
     switch (deco) {
     case DECO_RELAXED_PRECISION:    return relaxed_precision;
     case DECO_SPECID:               return specid;
     case DECO_BLOCK:                return block;
     case DECO_BUFFER_BLOCK:         return buffer_block;
+    case DECO_NON_WRITABLE:         return non_writable;
     default:                        assert(false && "Unreachable");
     }
 
@@ -95,12 +98,26 @@ const std::string& as_string(Decoration deco)
 
 const std::string& as_string(BuiltIn built_in)
 {
+    static const std::string num_workgroups{"NumWorkgroups"};
     static const std::string workgroup_size{"WorkgroupSize"};
+    static const std::string workgroup_id{"WorkgroupId"};
+    static const std::string local_invocation_id{"LocalInvocationId"};
     static const std::string global_invocation_id{"GlobalInvocationId"};
+    static const std::string local_invocation_index{"LocalInvocationIndex"};
+    static const std::string num_subgroups{"NumSubgroups"};
+    static const std::string subgroup_id{"SubgroupId"};
+    static const std::string subgroup_local_invocation_id{"SubgroupLocalInvocationId"};
 
     switch (built_in) {
+    case BI_NUM_WORKGROUPS:         return num_workgroups;
     case BI_WORKGROUP_SIZE:         return workgroup_size;
+    case BI_WORKGROUP_ID:           return workgroup_id;
+    case BI_LOCAL_INVOCATION_ID:    return local_invocation_id;
     case BI_GLOBAL_INVOCATION_ID:   return global_invocation_id;
+    case BI_LOCAL_INVOCATION_INDEX: return local_invocation_index;
+    case BI_NUM_SUBGROUPS:          return num_subgroups;
+    case BI_SUBGROUP_ID:            return subgroup_id;
+    case BI_SUBGROUP_LOCAL_INVOCATION_ID: return subgroup_local_invocation_id;
     default:                        assert(false && "Not implemented");
     }
 
@@ -113,12 +130,24 @@ const std::string& as_string(BinaryOperator bo)
     static const std::string imul{"OpIMul"};
     static const std::string fadd{"OpFAdd"};
     static const std::string fmul{"OpFMul"};
+    static const std::string fdiv{"OpFDiv"};
+    static const std::string fsub{"OpFSub"};
+    static const std::string isub{"OpISub"};
+    static const std::string udiv{"OpUDiv"};
+    static const std::string logical_and{"OpLogicalAnd"};
+    static const std::string vector_times_scalar{"OpVectorTimesScalar"};
 
     switch (bo) {
     case BO_IADD:   return iadd;
     case BO_IMUL:   return imul;
     case BO_FADD:   return fadd;
     case BO_FMUL:   return fmul;
+    case BO_FDIV:   return fdiv;
+    case BO_FSUB:   return fsub;
+    case BO_ISUB:   return isub;
+    case BO_UDIV:   return udiv;
+    case BO_LOGICAL_AND: return logical_and;
+    case BO_VECTOR_TIMES_SCALAR: return vector_times_scalar;
     default:        assert(false && "Not implemented");
     }
 
@@ -144,3 +173,56 @@ const std::string& as_string(CmpOp cmp_op)
 
     return co_gt; // Unreachable, return something to suppress compile warning
 }
+
+const std::string& as_string(ConvertOp cvt_op)
+{
+    static const std::string f_to_f{"OpFConvert"};
+    static const std::string f_to_s{"OpConvertFToS"};
+    static const std::string s_to_f{"OpConvertSToF"};
+    static const std::string u_to_f{"OpConvertUToF"};
+
+    switch (cvt_op) {
+        case CVT_F_TO_F:    return f_to_f;
+        case CVT_F_TO_S:    return f_to_s;
+        case CVT_S_TO_F:    return s_to_f;
+        case CVT_U_TO_F:    return u_to_f;
+        case CVT_UNKNOWN:
+        default:            assert(false && "Not implement");
+    }
+
+    return f_to_f; // Unreachable, return something to suppress compile warning
+}
+
+const std::string& as_string(Capability cap)
+{
+    static const std::string shader{"Shader"};
+    static const std::string float16{"Float16"};
+    static const std::string storage_buffer_16bit_access{"StorageBuffer16BitAccess"};
+    static const std::string group_non_uniform{"GroupNonUniform"};
+    static const std::string group_non_uniform_arithmetic{"GroupNonUniformArithmetic"};
+
+    switch (cap) {
+        case CAP_SHADER:    return shader;
+        case CAP_FLOAT16:   return float16;
+        case CAP_STORAGE_BUFFER_16BIT_ACCESS: return storage_buffer_16bit_access;
+        case CAP_GROUP_NON_UNIFORM: return group_non_uniform;
+        case CAP_GROUP_NON_UNIFORM_ARITHMETIC: return group_non_uniform_arithmetic;
+        default:            assert(false && "Not implement");
+    }
+
+    return shader; // Unreachable, return something to suppress compile warning
+}
+
+const std::string& as_string(GroupOp group_op)
+{
+    static const std::string fadd{"OpGroupNonUniformFAdd"};
+    static const std::string fmax{"OpGroupNonUniformFMax"};
+
+    switch (group_op) {
+        case GO_FADD:       return fadd;
+        case GO_FMAX:       return fmax;
+        default:            assert(false && "Not implement");
+    }
+
+    return fadd; // Unreachable, return something to suppress compile warning
+}
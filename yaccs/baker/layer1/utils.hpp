@@ -2,27 +2,59 @@
 #define YACCS_BAKER_LAYER1_UTILS_H_
 
 #include "yaccs/baker/layer1/def.hpp"
+#include "yaccs/baker/def.hpp"
 #include <cassert>
-#include <cstdlib>
-#include <limits>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
 
-template<typename T>
-inline bool value_eq(T a, T b)
+inline void hash_combine(size_t& seed, size_t v)
 {
-    return a == b;
+    seed ^= v + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
 }
 
-template<>
-inline bool value_eq<float>(float a, float b)
+inline uint64_t pack_key(uint32_t hi, uint32_t lo)
 {
-    return std::abs(a - b) < std::numeric_limits<float>::epsilon();
+    return (static_cast<uint64_t>(hi) << 32) | lo;
 }
 
-template<>
-inline bool value_eq<double>(double a, double b)
+// Key for id lists, e.g. struct fields, composite elements or access chain indices.
+// The leading ids (type, function, base) are pushed into the same list.
+struct IdsHash
 {
-    return std::abs(a - b) < std::numeric_limits<double>::epsilon();
-}
+    size_t operator()(const std::vector<id_t>& ids) const
+    {
+        size_t seed{ids.size()};
+        for (auto it : ids) {
+            hash_combine(seed, it);
+        }
+        return seed;
+    }
+}; // struct IdsHash
+
+// Key for scalar constants: the defined type and the literal bits in that type
+struct ConstKey
+{
+    id_t dtype_id;
+    uint64_t bits;
+
+    bool operator==(const ConstKey& other) const
+    {
+        return dtype_id == other.dtype_id && bits == other.bits;
+    }
+}; // struct ConstKey
+
+struct ConstKeyHash
+{
+    size_t operator()(const ConstKey& key) const
+    {
+        size_t seed{std::hash<uint64_t>{}(key.bits)};
+        hash_combine(seed, key.dtype_id);
+        return seed;
+    }
+}; // struct ConstKeyHash
 
 inline bool should_decorate(StorageClass sc)
 {
@@ -40,5 +72,8 @@ const std::string& as_string(Decoration deco);
 const std::string& as_string(BuiltIn built_in);
 const std::string& as_string(BinaryOperator bo);
 const std::string& as_string(CmpOp cmp_op);
+const std::string& as_string(ConvertOp cvt_op);
+const std::string& as_string(Capability cap);
+const std::string& as_string(GroupOp group_op);
 
 #endif // YACCS_BAKER_LAYER1_UTILS_H_
@@ -3,12 +3,22 @@
 
 #include "yaccs/baker/def.hpp"
 #include "yaccs/baker/layer1/def.hpp"
+#include <cstdint>
+#include <vector>
 
 struct FunctionDef
 {
     id_t id;
 }; // struct FunctionDef
 
+// additional induction variable, starts at init_id and advances by step_id every iteration
+struct InductionDef
+{
+    id_t init_id;
+    id_t step_id;
+    id_t var_id;
+}; // struct InductionDef
+
 struct ForLoopDef
 {
     id_t i_var_id;
@@ -26,6 +36,9 @@ struct ForLoopDef
     id_t bool_type_id;
     id_t cmp_id;
     CmpOp cmp_op;
+
+    std::vector<InductionDef> inductions;
+    uint32_t unroll;    // body copies per iteration, only used by Layer2::unrolled_for
 }; // struct ForLoopDef
 
 struct IfDef
@@ -1,5 +1,6 @@
 #include "yaccs/baker/layer2/layer2.hpp"
 #include "yaccs/baker/def.hpp"
+#include <algorithm>
 #include <cassert>
 
 
@@ -28,39 +29,116 @@ void Layer2::end_function(FunctionDef& def)
 void Layer2::begin_for(ForLoopDef& def)
 {
     // init
-    def.init_label_id = alloc_id();
-    def.cond_label_id = alloc_id();
-    def.loop_exit_label_id = alloc_id();
-    def.loop_body_label_id = alloc_id();
-    def.i_inc_label_id = alloc_id();
-    def.cmp_id = alloc_id();
+    def.init_label_id = layer1_->alloc_id();
+    def.cond_label_id = layer1_->alloc_id();
+    def.loop_exit_label_id = layer1_->alloc_id();
+    def.loop_body_label_id = layer1_->alloc_id();
+    def.i_inc_label_id = layer1_->alloc_id();
+    def.cmp_id = layer1_->alloc_id();
     def.inc_amount_id = layer1_->add_const(DT_UINT32, 1);
     def.bool_type_id = layer1_->add_dtype(DT_BOOL);
     def.i_type_id = layer1_->add_dtype(DT_UINT32);
     def.i_type_ptr_id = layer1_->add_type_pointer(def.i_type_id, SC_FUNCTION);
     def.i_var_id = layer1_->add_var(def.i_type_id, SC_FUNCTION, layer1_->add_const(DT_UINT32, 0));
     def.cmp_op = CO_LT;
+    // the initializer only runs once per call, reset i for loops nested in other loops
+    layer1_->store_var(def.i_var_id, layer1_->add_const(DT_UINT32, 0));
+    for (auto& it : def.inductions) {
+        it.var_id = layer1_->add_var(def.i_type_id, SC_FUNCTION);
+        layer1_->store_var(it.var_id, it.init_id);
+    }
     layer1_->code_gen()->push_snippet_begin_for(def);
+    layer1_->begin_scope();
 }
 
 void Layer2::end_for(ForLoopDef& def)
 {
+    layer1_->end_scope();
     layer1_->code_gen()->push_snippet_end_for(def);
 }
 
+void Layer2::unrolled_for(id_t func_id, ForLoopDef& def, const LoopBody& body)
+{
+    // The main loop runs boundary / unroll times with unroll copies of the body, the
+    // remainder loop runs the last boundary % unroll iterations. i is carried as one
+    // more induction variable, so neither loop multiplies.
+    const auto unroll{std::max(def.unroll, 1u)};
+    const auto uint_id{layer1_->add_dtype(DT_UINT32)};
+    const auto unroll_id{layer1_->add_const(DT_UINT32, unroll)};
+    auto imul{[&] (id_t a, id_t b) -> id_t { return layer1_->binary_op(BO_IMUL, func_id, uint_id, a, b); }};
+    auto iadd{[&] (id_t a, id_t b) -> id_t { return layer1_->binary_op(BO_IADD, func_id, uint_id, a, b); }};
+
+    std::vector<InductionDef> inductions{{.init_id = layer1_->add_const(DT_UINT32, 0), .step_id = layer1_->add_const(DT_UINT32, 1)}};
+    inductions.insert(inductions.end(), def.inductions.begin(), def.inductions.end());
+    auto emit_body{[&] (const std::vector<id_t>& values) {
+        body(values.at(0), std::vector<id_t>(values.begin() + 1, values.end()));
+    }};
+    auto load_inductions{[&] (const ForLoopDef& loop) {
+        std::vector<id_t> values;
+        for (const auto& it : loop.inductions) {
+            values.push_back(layer1_->load_var(uint_id, it.var_id));
+        }
+        return values;
+    }};
+
+    // body copy u sees every induction advanced by u steps, the offsets are loop invariant
+    std::vector<std::vector<id_t>> offsets(unroll);
+    ForLoopDef main_loop{.i_boundary_id = unroll > 1 ? layer1_->binary_op(BO_UDIV, func_id, uint_id, def.i_boundary_id, unroll_id) : def.i_boundary_id};
+    for (const auto& it : inductions) {
+        for (uint32_t u = 1; u < unroll; ++u) {
+            offsets.at(u).push_back(u == 1 ? it.step_id : imul(it.step_id, layer1_->add_const(DT_UINT32, u)));
+        }
+        main_loop.inductions.push_back({.init_id = it.init_id, .step_id = unroll > 1 ? imul(it.step_id, unroll_id) : it.step_id});
+    }
+    begin_for(main_loop);
+        auto bases{load_inductions(main_loop)};
+        emit_body(bases);
+        for (uint32_t u = 1; u < unroll; ++u) {
+            std::vector<id_t> values;
+            for (size_t k = 0; k < bases.size(); ++k) {
+                values.push_back(iadd(bases.at(k), offsets.at(u).at(k)));
+            }
+            emit_body(values);
+        }
+    end_for(main_loop);
+
+    auto last_loop{&main_loop};
+    ForLoopDef remainder_loop;
+    if (unroll > 1) {
+        auto done{imul(main_loop.i_boundary_id, unroll_id)};
+        remainder_loop = ForLoopDef{.i_boundary_id = layer1_->binary_op(BO_ISUB, func_id, uint_id, def.i_boundary_id, done)};
+        // the main loop leaves its variables one unrolled step past the last copy
+        for (size_t k = 0; k < inductions.size(); ++k) {
+            remainder_loop.inductions.push_back({.init_id = layer1_->load_var(uint_id, main_loop.inductions.at(k).var_id),
+                .step_id = inductions.at(k).step_id});
+        }
+        begin_for(remainder_loop);
+            emit_body(load_inductions(remainder_loop));
+        end_for(remainder_loop);
+        last_loop = &remainder_loop;
+    }
+
+    // after the loops the variables hold the values one step past the last iteration
+    for (size_t k = 0; k < def.inductions.size(); ++k) {
+        def.inductions.at(k).var_id = last_loop->inductions.at(k + 1).var_id;
+    }
+}
+
 void Layer2::begin_if(IfDef& def, id_t op1_id, CmpOp cmp_op, id_t op2_id)
 {
     def.cmp_op1_id = op1_id;
     def.cmp_op2_id = op2_id;
     def.cmp_op = cmp_op;
     def.bool_type_id = layer1_->add_dtype(DT_BOOL);
-    def.body_label_id = alloc_id();
-    def.next_label_id = alloc_id();
+    def.body_label_id = layer1_->alloc_id();
+    def.next_label_id = layer1_->alloc_id();
 
     layer1_->code_gen()->push_snippet_begin_if(def);
+    layer1_->begin_scope();
 }
 
 void Layer2::end_if(IfDef& def)
 {
+    layer1_->end_scope();
     layer1_->code_gen()->push_snippet_end_if(def);
 }
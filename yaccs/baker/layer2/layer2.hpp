@@ -3,6 +3,12 @@
 
 #include "yaccs/baker/def.hpp"
 #include "yaccs/baker/layer1/layer1.hpp"
+#include "yaccs/baker/layer2/def.hpp"
+#include <functional>
+#include <vector>
+
+// loop body emitter, gets i and the values of the induction variables
+using LoopBody = std::function<void(id_t i_id, const std::vector<id_t>& induction_ids)>;
 
 struct Layer2
 {
@@ -13,6 +19,8 @@ struct Layer2
 
     void begin_for(ForLoopDef& def);
     void end_for(ForLoopDef& def);
+    // emit body def.unroll times per iteration, the remainder runs in a second loop
+    void unrolled_for(id_t func_id, ForLoopDef& def, const LoopBody& body);
 
     void begin_if(IfDef& def, id_t op1_id, CmpOp cmp_op, id_t op2_id);
     void end_if(IfDef& def);
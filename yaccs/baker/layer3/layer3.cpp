@@ -6,23 +6,189 @@
 #include "yaccs/baker/layer2/layer2.hpp"
 #include "yaccs/dtype.hpp"
 #include "yaccs/tensor.hpp"
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <endian.h>
 #include <utility>
 #include <vector>
 
 
 Layer3::Layer3()
-    : layer1_(new Layer1)
+    : parent_(nullptr)
+    , threads_(1)
+    , layer1_(new Layer1)
     , layer2_(new Layer2(layer1_))
+    , weights_in_buffer_(false)
+    , fp16_(false)
+    , gemm_tile_{.micro_m = 0, .micro_n = 0, .tile_k = 0}
+    , unroll_(1)
+    , tuning_cache_(nullptr)
+    , multi_dispatch_(false)
+    , num_intermediates_(1)
+    , arena_size_(0)
+    , arena_var_id_(0)
+    , subgroup_ops_(true)
+    , reduce_scratch_id_(0)
 {
 }
 
+Layer3::Layer3(Layer3* parent)
+    : parent_(parent)
+    , threads_(1)
+    , layer1_(new Layer1(parent->layer1_))
+    , layer2_(new Layer2(layer1_))
+    , weights_in_buffer_(parent->weights_in_buffer_)
+    , fp16_(parent->fp16_)
+    , fp16_accumulate_(parent->fp16_accumulate_)
+    , gemm_tile_(parent->gemm_tile_)
+    , unroll_(parent->unroll_)
+    , tuning_cache_(nullptr)
+    , multi_dispatch_(parent->multi_dispatch_)
+    , num_intermediates_(0)
+    , arena_size_(0)
+    , arena_var_id_(0)
+    , subgroup_ops_(parent->subgroup_ops_)
+    , reduce_scratch_id_(parent->reduce_scratch_id_)
+{
+}
+
+Layer3::~Layer3()
+{
+    delete layer2_;
+    delete layer1_;
+}
+
+void Layer3::set_threads(int threads)
+{
+    assert(threads > 0 && "Bad number of threads");
+    threads_ = threads;
+}
+
+const TensorMeta& Layer3::tensor_meta(const std::string& name) const
+{
+    // a fork registers no tensors
+    return parent_ != nullptr ? parent_->tensor_meta(name) : global_tensors_.at(name);
+}
+
 void Layer3::set_name(const std::string& name)
 {
     name_  = name;
 }
 
+void Layer3::set_weights_in_buffer(bool enable)
+{
+    weights_in_buffer_ = enable;
+}
+
+void Layer3::set_multi_dispatch(bool enable)
+{
+    multi_dispatch_ = enable;
+}
+
+void Layer3::set_fp16(bool enable)
+{
+    fp16_ = enable;
+}
+
+void Layer3::add_fp16_accumulate(const std::string& op_name)
+{
+    fp16_accumulate_.insert(op_name);
+}
+
+DType Layer3::accumulate_dtype(const std::string& op_name) const
+{
+    if (fp16_accumulate_.count("*") > 0 || fp16_accumulate_.count(op_name) > 0) {
+        return DT_FLOAT16;
+    }
+    return DT_FLOAT;
+}
+
+void Layer3::set_subgroup_ops(bool enable)
+{
+    subgroup_ops_ = enable;
+}
+
+void Layer3::set_gemm_tile(const GemmTileDef& tile)
+{
+    gemm_tile_ = tile;
+}
+
+void Layer3::set_unroll(int factor)
+{
+    assert(factor > 0 && "Bad unroll factor");
+    unroll_ = factor;
+}
+
+void Layer3::set_local_size(int x, int y)
+{
+    layer1_->set_local_size(x, y, 1);
+}
+
+int Layer3::local_size_x() const
+{
+    return layer1_->local_size_x();
+}
+
+int Layer3::local_size_y() const
+{
+    return layer1_->local_size_y();
+}
+
+void Layer3::set_tuning_cache(const TuningCache* cache)
+{
+    tuning_cache_ = cache;
+}
+
+void Layer3::apply_tuning(const Graph& graph)
+{
+    // Local size and tile_k are specialization constants shared by the whole module,
+    // take the configuration tuned for the Gemm doing the most work.
+    const TuningRecord* best{nullptr};
+    uint64_t best_macs{0};
+    for (auto node_id : graph.topo_order()) {
+        const auto& node{graph.node(node_id)};
+        if (node.op_type != OT_GEMM) {
+            continue;
+        }
+        const auto& gemm{std::get<OpGemm>(node.op)};
+        // A is an activation, its type is the one of the graph value
+        if (graph.value(node.inputs.at(0)).tt.is_dynamic()) {
+            continue;
+        }
+
+        GemmKey key{
+            .m = gemm.Y.tt.shape[0],
+            .n = gemm.Y.tt.shape[1],
+            .k = gemm.trans_b ? gemm.B.tt.shape[1] : gemm.B.tt.shape[0],
+            .dtype = gemm.Y.tt.dtype,
+        };
+        auto record{tuning_cache_->find(key)};
+        uint64_t macs{static_cast<uint64_t>(key.m) * key.n * key.k};
+        if (record != nullptr && record->config.valid() && macs > best_macs) {
+            best = record;
+            best_macs = macs;
+        }
+    }
+
+    if (best != nullptr) {
+        set_local_size(best->config.local_size_x, best->config.local_size_y);
+        gemm_tile_ = best->config.tile;
+    }
+}
+
 void Layer3::set_main()
 {
+    if (multi_dispatch_) {
+        // one entry point per layer, the host dispatches them in order
+        for (size_t i = 0; i < layers_.size(); ++i) {
+            layer1_->set_entry(layers_.at(i), "layer" + std::to_string(i));
+        }
+        return;
+    }
+
     FunctionDef fdef;
     layer2_->begin_function(fdef, T_VOID);
         Scope exe_scope{SCOPE_WORKGROUP};
@@ -40,36 +206,117 @@ void Layer3::set_main()
     layer1_->set_entry(fdef.id);
 }
 
-void Layer3::add_input(const TensorType& tensor_type)
+void Layer3::add_graph(const Graph& graph, const MemoryPlan* plan)
 {
-    auto storage_class{SC_STORAGE_BUFFER};
-    auto type_id{add_tensor_type(tensor_type, storage_class, false)};
-    auto input_tensor_type{layer1_->add_struct_dtype({type_id}, false)};
-    auto var_id{layer1_->add_var(input_tensor_type, storage_class)};
+    if (tuning_cache_ != nullptr && gemm_tile_.micro_m == 0 && gemm_tile_.tile_k == 0) {
+        apply_tuning(graph);
+    }
 
-    layer1_->add_struct_decorate(input_tensor_type, DECO_BLOCK, storage_class, {{0, 0}});
-    layer1_->add_binding(var_id, 0, 0);
+    if (plan != nullptr) {
+        for (const auto& it : plan->slots) {
+            arena_offsets_.emplace(graph.value(it.value_id).name, it.offset);
+        }
+        arena_size_ = plan->arena_size;
+    }
 
-    TensorMeta tm;
-    tm.name = tensor_type.name;
-    tm.dtype = tensor_type.dtype;
-    tm.storage_class = storage_class;
-    tm.id = var_id;
-    tm.dtype_id = layer1_->add_dtype(tensor_type.dtype);
-    tm.dtype_pointer_id = layer1_->add_type_pointer(tm.dtype_id, storage_class);
-    global_tensors_.insert(std::make_pair(tensor_type.name, tm));
-    layer1_->push_entry_listed_id(var_id);
+    for (auto value_id : graph.inputs()) {
+        add_input(graph.value(value_id).tt);
+    }
+    for (auto value_id : graph.outputs()) {
+        add_output(graph.value(value_id).tt);
+    }
+
+    for (auto node_id : graph.topo_order()) {
+        add_tensors(graph.node(node_id));
+    }
+    add_layers(graph);
+}
+
+void Layer3::add_tensors(const Node& node)
+{
+    switch (node.op_type) {
+    case OT_GEMM:   add_gemm_tensors(std::get<OpGemm>(node.op)); break;
+    case OT_RELU:   add_shared_tensor(std::get<OpRelu>(node.op).Y); break;
+    case OT_REDUCE_SUM:
+    case OT_REDUCE_MEAN:
+    case OT_REDUCE_MAX: add_shared_tensor(std::get<OpReduce>(node.op).Y); break;
+    case OT_SOFTMAX:    add_shared_tensor(std::get<OpSoftmax>(node.op).Y); break;
+    default:        assert(false && "Not supportted operator");
+    }
+}
+
+void Layer3::add_layer(const Node& node)
+{
+    switch (node.op_type) {
+    case OT_GEMM:   add_gemm(std::get<OpGemm>(node.op)); break;
+    case OT_RELU:   add_relu(std::get<OpRelu>(node.op)); break;
+    case OT_REDUCE_SUM:
+    case OT_REDUCE_MEAN:
+    case OT_REDUCE_MAX: add_reduce(std::get<OpReduce>(node.op)); break;
+    case OT_SOFTMAX:    add_softmax(std::get<OpSoftmax>(node.op)); break;
+    default:        assert(false && "Not supportted operator");
+    }
+}
+
+void Layer3::add_layers(const Graph& graph)
+{
+    const auto nodes{graph.topo_order()};
+    if (threads_ == 1 || nodes.size() < 2) {
+        for (auto node_id : nodes) {
+            add_layer(graph.node(node_id));
+        }
+        return;
+    }
+
+    // Every layer function is emitted by a fork of its own, the forks only read this
+    // Layer3 until they are joined. Joining in topological order gives the same module
+    // as the serial emission, whatever thread emitted which layer.
+    std::vector<std::unique_ptr<Layer3>> forks;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        forks.emplace_back(new Layer3(this));
+    }
+    std::atomic<size_t> next{0};
+    auto work{[&] {
+        for (auto i{next++}; i < nodes.size(); i = next++) {
+            forks.at(i)->add_layer(graph.node(nodes.at(i)));
+        }
+    }};
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads_ && static_cast<size_t>(i) < nodes.size(); ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& it : workers) {
+        it.join();
+    }
+
+    for (const auto& it : forks) {
+        const auto resolve{layer1_->join(*it->layer1_)};
+        for (auto layer : it->layers_) {
+            layers_.push_back(resolve(layer));
+        }
+    }
+}
+
+void Layer3::add_input(const TensorType& tensor_type)
+{
+    add_buffer_tensor(tensor_type, 0, 0);
 }
 
 void Layer3::add_output(const TensorType& tensor_type)
+{
+    add_buffer_tensor(tensor_type, 1, 0);
+}
+
+id_t Layer3::add_buffer_tensor(const TensorType& tensor_type, int set, int binding)
 {
     auto storage_class{SC_STORAGE_BUFFER};
     auto type_id{add_tensor_type(tensor_type, storage_class, false)};
-    auto output_tensor_type{layer1_->add_struct_dtype({type_id}, false)};
-    auto var_id{layer1_->add_var(output_tensor_type, storage_class)};
+    auto buffer_tensor_type{layer1_->add_struct_dtype({type_id}, false)};
+    auto var_id{layer1_->add_var(buffer_tensor_type, storage_class)};
 
-    layer1_->add_struct_decorate(output_tensor_type, DECO_BLOCK, storage_class, {{0, 0}});
-    layer1_->add_binding(var_id, 0, 1);
+    layer1_->add_struct_decorate(buffer_tensor_type, DECO_BLOCK, storage_class, {{0, 0}});
+    layer1_->add_binding(var_id, binding, set);
 
     TensorMeta tm;
     tm.name = tensor_type.name;
@@ -78,8 +325,13 @@ void Layer3::add_output(const TensorType& tensor_type)
     tm.id = var_id;
     tm.dtype_id = layer1_->add_dtype(tensor_type.dtype);
     tm.dtype_pointer_id = layer1_->add_type_pointer(tm.dtype_id, storage_class);
+    tm.set = set;
+    tm.binding = binding;
+    tm.vec4_offset = tensor_data_offset(tensor_type.dims) / 16;
     global_tensors_.insert(std::make_pair(tensor_type.name, tm));
     layer1_->push_entry_listed_id(var_id);
+
+    return var_id;
 }
 
 void Layer3::dump_ir()
@@ -89,21 +341,72 @@ void Layer3::dump_ir()
     ofs.close();
 }
 
+void Layer3::assemble(std::vector<uint32_t>& words)
+{
+    layer1_->code_gen()->assemble(words);
+}
+
+void Layer3::dump_spv(const std::string& filename)
+{
+    std::vector<uint32_t> words;
+    assemble(words);
+
+    std::ofstream ofs{filename, std::ios::out | std::ios::binary};
+    ofs.write(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(words[0]));
+    ofs.close();
+}
+
+void Layer3::dump_stats(std::ostream& os) const
+{
+    const auto& intern_stats{layer1_->stats()};
+    os << "Stats:\n"
+        << "  ids allocated: " << layer1_->code_gen()->id_bound() - 1 << "\n"
+        << "  types: " << intern_stats.types_interned << " interned, "
+        << intern_stats.types_deduplicated << " deduplicated\n"
+        << "  constants: " << intern_stats.consts_interned << " interned, "
+        << intern_stats.consts_deduplicated << " deduplicated\n"
+        << "  expressions: " << intern_stats.exprs_interned << " interned, "
+        << intern_stats.exprs_deduplicated << " deduplicated\n"
+        << "  functions: " << layer1_->num_functions() << " (" << layers_.size() << " layers)\n"
+        << "  section bytes:";
+    size_t total{0};
+    for (const auto& it : layer1_->code_gen()->section_bytes()) {
+        os << " " << it.first << " " << it.second;
+        total += it.second;
+    }
+    os << ", total " << total << "\n";
+}
+
+void Layer3::dump_weights(const std::string& filename)
+{
+    std::ofstream ofs{filename, std::ios::out | std::ios::binary};
+    ofs.write(weights_.data(), weights_.size());
+    ofs.close();
+}
+
 id_t Layer3::add_tensor_type(const TensorType& tt, StorageClass sc, bool reuse)
 {
     /*
      * {
      *     int dims;
      *     int shape[MAX_TENSOR_DIMS];
-     *     DType data[num_elems];
+     *     DType data[num_elems];   // DType data[] if any dim is dynamic
      * }
+     *
+     * data starts at the next 16 bytes boundary, so it can be read as vec4
      */
 
     const auto num_elems{tt.num_elems()};
     const auto dtype_id{layer1_->add_dtype(tt.dtype)};    // define type dtype
     const auto uint_id{layer1_->add_dtype(DT_UINT32)};    // define uint type
     const auto shape_id{layer1_->add_array_dtype(uint_id, tt.dims, sc, reuse)};
-    const auto data_id{layer1_->add_array_dtype(dtype_id, num_elems, sc, reuse)};
+    id_t data_id{};
+    if (tt.is_dynamic()) {
+        assert(sc == SC_STORAGE_BUFFER && "Dynamic shaped tensor must live in a storage buffer");
+        data_id = layer1_->add_runtime_array_dtype(dtype_id, sc, dtype_bytes(tt.dtype));
+    } else {
+        data_id = layer1_->add_array_dtype(dtype_id, num_elems, sc, reuse, dtype_bytes(tt.dtype));
+    }
 
     uint32_t offset{0};
     uint32_t field_idx{0};
@@ -112,8 +415,9 @@ id_t Layer3::add_tensor_type(const TensorType& tt, StorageClass sc, bool reuse)
 
     member_deco.push_back(std::make_pair(field_idx++, offset)); offset += 4;
     struct_ids.push_back(uint_id);   // dims
-    member_deco.push_back(std::make_pair(field_idx++, offset)); offset += 4 * tt.dims; 
+    member_deco.push_back(std::make_pair(field_idx++, offset)); offset += 4 * tt.dims;
     struct_ids.push_back(shape_id); // shape
+    offset = tensor_data_offset(tt.dims);
     member_deco.push_back(std::make_pair(field_idx++, offset));
     struct_ids.push_back(data_id);  // data
 
@@ -145,8 +449,9 @@ id_t Layer3::add_const_tensor(const Tensor& tensor)
 
     // setup data
     std::vector<id_t> data(num_elems);
-    for (int i = 0; i < num_elems; ++i) {
-        data.at(i) = add_const_tensor_element(tensor.tt.dtype, i, tensor);
+    TensorIterator it{tensor};
+    for (int i = 0; i < num_elems; ++i, ++it) {
+        data.at(i) = add_const_tensor_element(tensor.tt.dtype, it.offset(), tensor);
     }
     auto dtype_id{layer1_->add_dtype(tensor.tt.dtype)};
     auto data_type_id{layer1_->add_array_dtype(dtype_id, num_elems, SC_GLOBAL_CONST)};
@@ -172,8 +477,91 @@ id_t Layer3::add_const_tensor(const Tensor& tensor)
     return const_tensor_id;
 }
 
+id_t Layer3::add_initializer(const Tensor& tensor)
+{
+    if (fp16_ && tensor.tt.dtype == DT_FLOAT) {
+        auto half{tensor.cast(DT_FLOAT16)};
+        return weights_in_buffer_ ? add_weight_tensor(half) : add_const_tensor(half);
+    }
+    return weights_in_buffer_ ? add_weight_tensor(tensor) : add_const_tensor(tensor);
+}
+
+id_t Layer3::weights_var(DType dtype)
+{
+    auto found{weights_vars_.find(dtype)};
+    if (found != weights_vars_.end()) {
+        return found->second;
+    }
+
+    /*
+     * {
+     *     DType data[];
+     * }
+     */
+    const auto storage_class{SC_STORAGE_BUFFER};
+    const auto dtype_id{layer1_->add_dtype(dtype)};
+    const auto data_id{layer1_->add_runtime_array_dtype(dtype_id, storage_class, dtype_bytes(dtype))};
+    const auto weights_type_id{layer1_->add_struct_dtype({data_id}, false)};
+    const auto var_id{layer1_->add_var(weights_type_id, storage_class)};
+
+    layer1_->add_struct_decorate(weights_type_id, DECO_BLOCK, storage_class, {{0, 0}});
+    layer1_->add_decorate(var_id, DECO_NON_WRITABLE);
+    layer1_->add_binding(var_id, 1, 0);
+    layer1_->push_entry_listed_id(var_id);
+    weights_vars_.emplace(dtype, var_id);
+    return var_id;
+}
+
+id_t Layer3::add_weight_tensor(const Tensor& tensor)
+{
+    assert((tensor.tt.dtype == DT_FLOAT || tensor.tt.dtype == DT_FLOAT16 || tensor.tt.dtype == DT_INT32)
+        && "Not implemented");
+
+    // keep every tensor 16 bytes aligned in the weight buffer
+    const size_t alignment{16};
+    const auto elem_bytes{dtype_bytes(tensor.tt.dtype)};
+    weights_.resize((weights_.size() + alignment - 1) / alignment * alignment, 0);
+    const auto offset{static_cast<uint32_t>(weights_.size() / elem_bytes)};
+
+    const auto num_elems{tensor.tt.num_elems()};
+    weights_.resize(weights_.size() + num_elems * elem_bytes);
+    // tensor buffers are little endian like the weights, a row major copy with the
+    // scale applied is copied as is
+    const auto dense{tensor.materialize()};
+    memcpy(weights_.data() + offset * elem_bytes, dense.data.data(), num_elems * elem_bytes);
+
+    TensorMeta tm;
+    tm.name = tensor.tt.name;
+    tm.dtype = tensor.tt.dtype;
+    tm.id = weights_var(tensor.tt.dtype);
+    tm.dims_id = layer1_->add_const(DT_UINT32, tensor.tt.dims);
+    for (int i = 0; i < tensor.tt.dims; ++i) {
+        tm.shape_ids.push_back(layer1_->add_const(DT_UINT32, tensor.tt.shape[i]));
+    }
+    tm.offset_id = layer1_->add_const(DT_UINT32, offset);
+    tm.storage_class = SC_GLOBAL_WEIGHT;
+    tm.set = 0;
+    tm.binding = 1;
+    tm.vec4_offset = offset * elem_bytes / 16;
+    tm.dtype_id = layer1_->add_dtype(tensor.tt.dtype);
+    global_tensors_.insert(std::make_pair(tensor.tt.name, tm));
+
+    return tm.id;
+}
+
 id_t Layer3::add_shared_tensor(const Tensor& tensor)
 {
+    // the arena is an array of floats
+    auto arena_offset{arena_offsets_.find(tensor.tt.name)};
+    if (arena_offset != arena_offsets_.end() && tensor.tt.dtype == DT_FLOAT) {
+        return add_arena_tensor(tensor, arena_offset->second);
+    }
+
+    if (multi_dispatch_) {
+        return add_buffer_tensor(tensor.tt, 2, num_intermediates_++);
+    }
+    assert(!tensor.tt.is_dynamic() && "Dynamic shaped intermediates need multi-dispatch mode");
+
     const auto storage_class{SC_WORKGROUP};
     const auto tensor_type_id{add_tensor_type(tensor.tt, storage_class)};
     const auto var_id{layer1_->add_var(tensor_type_id, storage_class)};
@@ -190,19 +578,77 @@ id_t Layer3::add_shared_tensor(const Tensor& tensor)
     return var_id;
 }
 
-id_t Layer3::add_const_tensor_element(DType dtype, int elem_idx, const Tensor& tensor)
+id_t Layer3::arena_var()
+{
+    if (arena_var_id_ != 0) {
+        return arena_var_id_;
+    }
+
+    const auto dtype_id{layer1_->add_dtype(DT_FLOAT)};
+    if (multi_dispatch_) {
+        /*
+         * {
+         *     float data[];
+         * }
+         */
+        const auto storage_class{SC_STORAGE_BUFFER};
+        const auto data_id{layer1_->add_runtime_array_dtype(dtype_id, storage_class)};
+        const auto arena_type_id{layer1_->add_struct_dtype({data_id}, false)};
+        arena_var_id_ = layer1_->add_var(arena_type_id, storage_class);
+        layer1_->add_struct_decorate(arena_type_id, DECO_BLOCK, storage_class, {{0, 0}});
+        layer1_->add_binding(arena_var_id_, 0, 2);
+    } else {
+        const auto storage_class{SC_WORKGROUP};
+        const auto num_elems{static_cast<int>(arena_size_ / DT_FLOAT_BYTES)};
+        const auto arena_type_id{layer1_->add_array_dtype(dtype_id, num_elems, storage_class)};
+        arena_var_id_ = layer1_->add_var(arena_type_id, storage_class);
+    }
+    layer1_->push_entry_listed_id(arena_var_id_);
+    return arena_var_id_;
+}
+
+id_t Layer3::add_arena_tensor(const Tensor& tensor, size_t offset)
+{
+    assert(tensor.tt.dtype == DT_FLOAT && "Not implemented");
+
+    // dims and shape are known at compile time, only the data lives in the arena
+    TensorMeta tm;
+    tm.name = tensor.tt.name;
+    tm.dtype = tensor.tt.dtype;
+    tm.id = arena_var();
+    tm.dims_id = layer1_->add_const(DT_UINT32, tensor.tt.dims);
+    for (int i = 0; i < tensor.tt.dims; ++i) {
+        tm.shape_ids.push_back(layer1_->add_const(DT_UINT32, tensor.tt.shape[i]));
+    }
+    tm.offset_id = layer1_->add_const(DT_UINT32, static_cast<uint32_t>(offset / DT_FLOAT_BYTES));
+    tm.storage_class = multi_dispatch_ ? SC_STORAGE_BUFFER : SC_WORKGROUP;
+    tm.in_arena = true;
+    if (multi_dispatch_) {
+        // the planner keeps every slot 16 bytes aligned
+        tm.set = 2;
+        tm.binding = 0;
+        tm.vec4_offset = offset / 16;
+    }
+    tm.dtype_id = layer1_->add_dtype(tensor.tt.dtype);
+    tm.dtype_pointer_id = layer1_->add_type_pointer(tm.dtype_id, tm.storage_class);
+    global_tensors_.insert(std::make_pair(tensor.tt.name, tm));
+
+    return tm.id;
+}
+
+id_t Layer3::add_const_tensor_element(DType dtype, size_t offset, const Tensor& tensor)
 {
     switch (dtype) {
-        case DT_FLOAT: return layer1_->add_const(dtype, tensor.at<DT_FLOAT>(elem_idx));
+        case DT_FLOAT: return layer1_->add_const(dtype, tensor.at_offset<DT_FLOAT>(offset));
+        case DT_FLOAT16: return layer1_->add_const(dtype, tensor.at_offset<DT_FLOAT16>(offset));
+        case DT_INT32: return layer1_->add_const(dtype, tensor.at_offset<DT_INT32>(offset));
         case DT_UINT8:
         case DT_INT8:
         case DT_UINT16:
         case DT_INT16:
-        case DT_INT32:
         case DT_INT64:
         case DT_STRING:
         case DT_BOOL:
-        case DT_FLOAT16:
         case DT_DOUBLE:
         case DT_UINT32:
         case DT_UINT64:
@@ -228,9 +674,11 @@ id_t Layer3::add_const_tensor_element(DType dtype, int elem_idx, const Tensor& t
 id_t Layer3::access_tensor_dims(id_t func_id, const TensorMeta& tm)
 {
     std::vector<uint32_t> access_indices{};
-    if (tm.storage_class == SC_UNIFORM || tm.storage_class == SC_STORAGE_BUFFER) {
+    if (tm.in_arena) {
+        return tm.dims_id;
+    } else if (tm.storage_class == SC_UNIFORM || tm.storage_class == SC_STORAGE_BUFFER) {
         access_indices = {0, 0};
-    } else if (tm.storage_class == SC_GLOBAL_CONST) {
+    } else if (tm.storage_class == SC_GLOBAL_CONST || tm.storage_class == SC_GLOBAL_WEIGHT) {
         return tm.dims_id;
     } else {
         access_indices = {0};
@@ -244,10 +692,13 @@ id_t Layer3::access_tensor_dims(id_t func_id, const TensorMeta& tm)
 
 id_t Layer3::access_tensor_shape_index(id_t func_id, const TensorMeta& tm, uint32_t index)
 {
-    static std::vector<AccessTensorShapeEelementDef> dfs;
+    if (tm.storage_class == SC_GLOBAL_WEIGHT || tm.in_arena) {
+        return tm.shape_ids.at(index);
+    }
+
     AccessTensorShapeEelementDef def;
 
-    for (const auto& it: dfs) {
+    for (const auto& it: shape_elements_) {
         if (it.func_id == func_id && it.tensor_id == tm.id && it.index == index) {
             return it.id;
         }
@@ -262,7 +713,7 @@ id_t Layer3::access_tensor_shape_index(id_t func_id, const TensorMeta& tm, uint3
     if (tm.storage_class == SC_UNIFORM || tm.storage_class == SC_STORAGE_BUFFER) {
         access_indices = {0, 1, index};
     } else if (tm.storage_class == SC_GLOBAL_CONST) {
-        def.base_id = layer1_->add_var(tm.shape_type_id, SC_FUNCTION, tm.shape_id);
+        def.base_id = const_copy(func_id, tm.shape_type_id, tm.shape_id);
         access_indices = {index};
     } else {
         access_indices = {1, index};
@@ -273,17 +724,32 @@ id_t Layer3::access_tensor_shape_index(id_t func_id, const TensorMeta& tm, uint3
     def.shape_comp_ptr_id = layer1_->access_chain_indices(func_id, def.shape_comp_type_ptr_id, def.base_id, access_indices);
     def.id = layer1_->load_var(def.shape_comp_type_id, def.shape_comp_ptr_id);
 
-    dfs.push_back(def);
+    shape_elements_.push_back(def);
     return def.id;
 }
 
+id_t Layer3::const_copy(id_t func_id, id_t type_id, id_t const_id)
+{
+    // Composite constants are only indexable through a variable. Function variables
+    // live in the entry block, so one copy serves every load in the function.
+    const auto key{pack_key(func_id, const_id)};
+    auto found{const_copies_.find(key)};
+    if (found != const_copies_.end()) {
+        return found->second;
+    }
+
+    auto var_id{layer1_->add_var(type_id, SC_FUNCTION, const_id)};
+    const_copies_.emplace(key, var_id);
+    return var_id;
+}
+
 void Layer3::invocation_boundary_check(id_t func_id, const TensorMeta& tm, uint32_t index)
 {
     IfDef if_def;
     auto cmp_op1_id{layer1_->access_invocation_index(func_id, index)};
     auto cmp_op2_id{access_tensor_shape_index(func_id, tm, index)};
 
-    layer2_->begin_if(if_def, cmp_op1_id, CO_GT, cmp_op2_id);
+    layer2_->begin_if(if_def, cmp_op1_id, CO_GE, cmp_op2_id);
         layer1_->add_return();
     layer2_->end_if(if_def);
 }
@@ -295,11 +761,17 @@ id_t Layer3::load_tensor_element(id_t func_id, const TensorMeta& tm, id_t index_
     auto tensor_index_id{layer1_->add_const(DT_UINT32, 0)}; // for uniform input
 
     id_t base_id{tm.id};
-    if (tm.storage_class == SC_UNIFORM || tm.storage_class == SC_STORAGE_BUFFER) {
+    if (tm.in_arena) {
+        access_index_ids = arena_access_indices(func_id, tm, index_id);
+    } else if (tm.storage_class == SC_UNIFORM || tm.storage_class == SC_STORAGE_BUFFER) {
         access_index_ids = {tensor_index_id, data_index_id, index_id};
     } else if (tm.storage_class == SC_GLOBAL_CONST) {
-        base_id = layer1_->add_var(tm.data_type_id, SC_FUNCTION, tm.data_id);
+        base_id = const_copy(func_id, tm.data_type_id, tm.data_id);
         access_index_ids = {index_id};
+    } else if (tm.storage_class == SC_GLOBAL_WEIGHT) {
+        auto uint_id{layer1_->add_dtype(DT_UINT32)};
+        auto weight_index_id{layer1_->binary_op(BO_IADD, func_id, uint_id, tm.offset_id, index_id)};
+        access_index_ids = {tensor_index_id, weight_index_id};
     } else {
         access_index_ids = {data_index_id, index_id};
     }
@@ -318,6 +790,20 @@ id_t Layer3::load_tensor_element(id_t func_id, const TensorMeta& tm, id_t i, id_
     return load_tensor_element(func_id, tm, index_id);
 }
 
+id_t Layer3::load_tensor_element_as(id_t func_id, const TensorMeta& tm, id_t index_id, DType dtype)
+{
+    return convert_element(load_tensor_element(func_id, tm, index_id), tm.dtype, dtype);
+}
+
+id_t Layer3::convert_element(id_t value_id, DType from, DType to)
+{
+    if (from == to) {
+        return value_id;
+    }
+    assert(dtype_is_float(from) && dtype_is_float(to) && "Not implemented");
+    return layer1_->convert(CVT_F_TO_F, layer1_->add_dtype(to), value_id);
+}
+
 void Layer3::store_tensor_element(id_t func_id, const TensorMeta& tm, id_t index_id, id_t object_id)
 {
     auto data_index_id{layer1_->add_const(DT_UINT32, 2)};
@@ -326,7 +812,9 @@ void Layer3::store_tensor_element(id_t func_id, const TensorMeta& tm, id_t index
     auto tensor_index_id{layer1_->add_const(DT_UINT32, 0)}; // for uniform input
 
     std::vector<id_t> access_index_ids{};
-    if (tm.storage_class == SC_UNIFORM || tm.storage_class == SC_STORAGE_BUFFER) {
+    if (tm.in_arena) {
+        access_index_ids = arena_access_indices(func_id, tm, index_id);
+    } else if (tm.storage_class == SC_UNIFORM || tm.storage_class == SC_STORAGE_BUFFER) {
         access_index_ids = {tensor_index_id, data_index_id, index_id};
     } else {
         access_index_ids = {data_index_id, index_id};
@@ -347,6 +835,10 @@ void Layer3::store_tensor_element(id_t func_id, const TensorMeta& tm, id_t i, id
 
 void Layer3::store_tensor_shape_element(id_t func_id, const TensorMeta& tm, uint32_t index, id_t object_id)
 {
+    if (tm.in_arena) {
+        return; // shape is a compile time constant
+    }
+
     auto shape_base_index_id{layer1_->add_const(DT_UINT32, 1)};
     auto shape_index_id{layer1_->add_const(DT_UINT32, index)};
     auto shape_type_id{layer1_->add_dtype(DT_UINT32)};
@@ -366,6 +858,10 @@ void Layer3::store_tensor_shape_element(id_t func_id, const TensorMeta& tm, uint
 
 void Layer3::store_tensor_dims(id_t func_id, const TensorMeta& tm, id_t object_id)
 {
+    if (tm.in_arena) {
+        return; // dims is a compile time constant
+    }
+
     std::vector<uint32_t> access_indices{};
     if (tm.storage_class == SC_UNIFORM || tm.storage_class == SC_STORAGE_BUFFER) {
         access_indices = {0, 0};
@@ -378,3 +874,79 @@ void Layer3::store_tensor_dims(id_t func_id, const TensorMeta& tm, id_t object_i
     auto ptr{layer1_->access_chain_indices(func_id, dims_type_ptr_id, tm.id, access_indices)};
     layer1_->store_var(ptr, object_id);
 }
+
+std::vector<id_t> Layer3::arena_access_indices(id_t func_id, const TensorMeta& tm, id_t index_id)
+{
+    auto uint_id{layer1_->add_dtype(DT_UINT32)};
+    auto arena_index_id{layer1_->binary_op(BO_IADD, func_id, uint_id, tm.offset_id, index_id)};
+    if (tm.storage_class == SC_STORAGE_BUFFER) {
+        return {layer1_->add_const(DT_UINT32, 0), arena_index_id};
+    }
+    return {arena_index_id};
+}
+
+bool Layer3::vec4_accessible(const TensorMeta& tm) const
+{
+    return tm.set >= 0 && tm.dtype == DT_FLOAT;
+}
+
+id_t Layer3::vec4_view(const TensorMeta& tm)
+{
+    const uint64_t key{static_cast<uint64_t>(tm.set) << 32 | static_cast<uint32_t>(tm.binding)};
+    auto found{vec4_views_.find(key)};
+    if (found != vec4_views_.end()) {
+        return found->second;
+    }
+    if (parent_ != nullptr) {
+        auto in_parent{parent_->vec4_views_.find(key)};
+        if (in_parent != parent_->vec4_views_.end()) {
+            return in_parent->second;
+        }
+        auto parent{parent_};
+        auto id{layer1_->defer([parent, tm] (Layer1&, const IdResolver&) { return parent->vec4_view(tm); })};
+        vec4_views_.emplace(key, id);
+        return id;
+    }
+
+    /*
+     * {
+     *     vec4 data[];
+     * }
+     *
+     * aliases the binding of the tensor, index 0 is the first 16 bytes of the buffer
+     */
+    const auto storage_class{SC_STORAGE_BUFFER};
+    const auto vec4_id{layer1_->add_vector_dtype(layer1_->add_dtype(DT_FLOAT), 4)};
+    const auto data_id{layer1_->add_runtime_array_dtype(vec4_id, storage_class, 16)};
+    const auto view_type_id{layer1_->add_struct_dtype({data_id}, false)};
+    const auto var_id{layer1_->add_var(view_type_id, storage_class)};
+
+    layer1_->add_struct_decorate(view_type_id, DECO_BLOCK, storage_class, {{0, 0}});
+    if (tm.storage_class == SC_GLOBAL_WEIGHT) {
+        layer1_->add_decorate(var_id, DECO_NON_WRITABLE);
+    }
+    layer1_->add_binding(var_id, tm.binding, tm.set);
+    layer1_->push_entry_listed_id(var_id);
+    vec4_views_.emplace(key, var_id);
+    return var_id;
+}
+
+id_t Layer3::load_tensor_vec4(id_t func_id, const TensorMeta& tm, id_t index_id)
+{
+    auto uint_id{layer1_->add_dtype(DT_UINT32)};
+    auto vec4_id{layer1_->add_vector_dtype(tm.dtype_id, 4)};
+    auto vec4_ptr_id{layer1_->add_type_pointer(vec4_id, SC_STORAGE_BUFFER)};
+    auto view_index_id{layer1_->binary_op(BO_IADD, func_id, uint_id, layer1_->add_const(DT_UINT32, tm.vec4_offset), index_id)};
+    auto ptr{layer1_->access_chain(func_id, vec4_ptr_id, vec4_view(tm), {layer1_->add_const(DT_UINT32, 0), view_index_id})};
+    return layer1_->load_var(vec4_id, ptr);
+}
+
+void Layer3::store_tensor_vec4(id_t func_id, const TensorMeta& tm, id_t index_id, id_t object_id)
+{
+    auto uint_id{layer1_->add_dtype(DT_UINT32)};
+    auto vec4_id{layer1_->add_vector_dtype(tm.dtype_id, 4)};
+    auto vec4_ptr_id{layer1_->add_type_pointer(vec4_id, SC_STORAGE_BUFFER)};
+    auto view_index_id{layer1_->binary_op(BO_IADD, func_id, uint_id, layer1_->add_const(DT_UINT32, tm.vec4_offset), index_id)};
+    auto ptr{layer1_->access_chain(func_id, vec4_ptr_id, vec4_view(tm), {layer1_->add_const(DT_UINT32, 0), view_index_id})};
+    layer1_->store_var(ptr, object_id);
+}
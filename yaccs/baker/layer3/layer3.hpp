@@ -3,32 +3,127 @@
 
 #include "yaccs/baker/def.hpp"
 #include "yaccs/baker/layer2/layer2.hpp"
+#include "yaccs/graph/graph.hpp"
+#include "yaccs/graph/memory_plan.hpp"
 #include "yaccs/tensor.hpp"
+#include "yaccs/tuning/tuning_cache.hpp"
 #include "yaccs/onnx/ops.hpp"
+#include <functional>
+#include <ostream>
 #include <unordered_map>
+#include <unordered_set>
 
 struct Layer3
 {
     Layer3();
+    ~Layer3();
+    Layer3(const Layer3&) = delete;
+    Layer3& operator=(const Layer3&) = delete;
     void set_name(const std::string& name);
     void set_main();
     void dump_ir();
+    void dump_spv(const std::string& filename);
+    void assemble(std::vector<uint32_t>& words);
+    void set_weights_in_buffer(bool enable);
+    void set_gemm_tile(const GemmTileDef& tile);
+    // body copies per iteration of the Gemm K loop
+    void set_unroll(int factor);
+    void set_local_size(int x, int y);
+    int local_size_x() const;
+    int local_size_y() const;
+    void set_tuning_cache(const TuningCache* cache);
+    void set_multi_dispatch(bool enable);
+    void set_fp16(bool enable);
+    // op_name accumulates in half precision, "*" selects every op
+    void add_fp16_accumulate(const std::string& op_name);
+    // reductions combine across subgroups instead of a workgroup memory tree
+    void set_subgroup_ops(bool enable);
+    // threads emitting the layer functions of add_graph, the module does not depend on it
+    void set_threads(int threads);
+    void dump_weights(const std::string& filename);
+    void dump_stats(std::ostream& os) const;
+    const std::vector<char>& weights() const { return weights_; }
 
+    void add_graph(const Graph& graph, const MemoryPlan* plan=nullptr);
     void add_input(const TensorType& tensor_type);
     void add_output(const TensorType& tensor_type);
-    void add_gemm(const OpGemm& gemm);
-    void add_relu(const OpRelu& relu);
 private:
+    // a fork emits layer functions of parent on another thread, see Layer1(const Layer1*)
+    Layer3* parent_;
+    int threads_;
     std::vector<id_t> layers_;  // layers in order
     std::unordered_map<std::string, TensorMeta> global_tensors_;
     std::string name_;
     Layer1* layer1_;
     Layer2* layer2_;
+    // initializers placed in a read-only storage buffer instead of constants
+    bool weights_in_buffer_;
+    std::vector<char> weights_;
+    // views of the weights buffer, one per element type
+    std::unordered_map<DType, id_t> weights_vars_;
+    // initializers converted to half precision on the host
+    bool fp16_;
+    std::unordered_set<std::string> fp16_accumulate_;
+    GemmTileDef gemm_tile_;
+    int unroll_;
+    // best known Gemm configurations, consulted when no tile is given explicitly
+    const TuningCache* tuning_cache_;
+    // intermediates in storage buffers (set 2) and one entry point per layer
+    bool multi_dispatch_;
+    int num_intermediates_;
+    // intermediates placed by the memory planner, byte offsets into one arena
+    std::unordered_map<std::string, size_t> arena_offsets_;
+    size_t arena_size_;
+    id_t arena_var_id_;
+    // vec4 aliases of storage buffers, (set, binding) to variable
+    std::unordered_map<uint64_t, id_t> vec4_views_;
+    // function variable copies of constant composites, (function, constant) to variable
+    std::unordered_map<uint64_t, id_t> const_copies_;
+    bool subgroup_ops_;
+    // one float per invocation, shared by the workgroup reductions
+    id_t reduce_scratch_id_;
+    // loaded shape elements, (function, tensor, index) to value
+    std::vector<AccessTensorShapeEelementDef> shape_elements_;
+
+    explicit Layer3(Layer3* parent);
+    const TensorMeta& tensor_meta(const std::string& name) const;
+    // the tensors of node, registered before any layer function is emitted
+    void add_tensors(const Node& node);
+    void add_gemm_tensors(const OpGemm& gemm);
+    void add_layer(const Node& node);
+    void add_layers(const Graph& graph);
+    void add_gemm(const OpGemm& gemm);
+    void add_relu(const OpRelu& relu);
+    void add_reduce(const OpReduce& reduce);
+    void add_softmax(const OpSoftmax& softmax);
+    void add_gemm_tiled(const OpGemm& gemm);
+    void add_gemm_vec4(id_t func_id, const OpGemm& gemm);
+    void add_gemm_int8(const OpGemm& gemm);
+    void add_relu_vec4(id_t func_id, const TensorMeta& X, const TensorMeta& Y);
+    void apply_tuning(const Graph& graph);
+    id_t reduce_scratch_var();
+    id_t reduce_row(id_t func_id, GroupOp op, const TensorMeta& X, id_t row_begin, id_t N,
+        const std::function<id_t(id_t)>& map=nullptr);
+    id_t workgroup_reduce(id_t func_id, GroupOp op, id_t value_id);
+    void load_reduce_builtins(id_t func_id);
+    id_t combine(id_t func_id, GroupOp op, id_t op1_id, id_t op2_id);
+    DType accumulate_dtype(const std::string& op_name) const;
 
-    id_t add_const_tensor_element(DType dtype, int elem_idx, const Tensor& tensor);
+    // offset of the element in tensor.data, see TensorIterator
+    id_t add_const_tensor_element(DType dtype, size_t offset, const Tensor& tensor);
     id_t add_const_tensor(const Tensor& tensor);
+    id_t add_weight_tensor(const Tensor& tensor);
+    // B of a quantized Gemm, four int8 weights of a column packed along K in each word
+    Tensor pack_int8_weights(const OpGemm& gemm) const;
+    Tensor int8_scale(const OpGemm& gemm) const;
+    id_t add_initializer(const Tensor& tensor);
+    id_t weights_var(DType dtype);
     id_t add_shared_tensor(const Tensor& tensor);
+    id_t add_buffer_tensor(const TensorType& tensor_type, int set, int binding);
+    id_t add_arena_tensor(const Tensor& tensor, size_t offset);
+    id_t arena_var();
     id_t add_tensor_type(const TensorType& tensor_type, StorageClass sc, bool reuse=true);
+    id_t const_copy(id_t func_id, id_t type_id, id_t const_id);
 
     void invocation_boundary_check(id_t func_id, const TensorMeta& tm, uint32_t index);
     id_t access_tensor_dims(id_t func_id, const TensorMeta& tm);
@@ -39,6 +134,16 @@ private:
     void store_tensor_element(id_t func_id, const TensorMeta& tm, id_t i, id_t step, id_t j, id_t object_id);
     void store_tensor_shape_element(id_t func_id, const TensorMeta& tm, uint32_t index, id_t object_id);
     void store_tensor_dims(id_t func_id, const TensorMeta& tm, id_t object_id);
+    id_t load_tensor_element_as(id_t func_id, const TensorMeta& tm, id_t index_id, DType dtype);
+    id_t convert_element(id_t value_id, DType from, DType to);
+    id_t quantize_element(id_t func_id, id_t value_id, float scale, int zero_point, int qmin, int qmax);
+    id_t gemm_bias_index(id_t func_id, const OpGemm& gemm, id_t row_id, id_t col_id);
+    std::vector<id_t> arena_access_indices(id_t func_id, const TensorMeta& tm, id_t index_id);
+
+    bool vec4_accessible(const TensorMeta& tm) const;
+    id_t vec4_view(const TensorMeta& tm);
+    id_t load_tensor_vec4(id_t func_id, const TensorMeta& tm, id_t index_id);
+    void store_tensor_vec4(id_t func_id, const TensorMeta& tm, id_t index_id, id_t object_id);
 }; // class Program
 
 #endif // YACCS_BAKER_LAYER3_H_
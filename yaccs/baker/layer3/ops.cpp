@@ -7,26 +7,42 @@
 #include "yaccs/tensor.hpp"
 
 
+void Layer3::add_gemm_tensors(const OpGemm& gemm)
+{
+    if (gemm.quant.enabled) {
+        add_initializer(pack_int8_weights(gemm));
+        // never rounded to half, the combined scales easily fall below its normal range
+        weights_in_buffer_ ? add_weight_tensor(int8_scale(gemm)) : add_const_tensor(int8_scale(gemm));
+    } else {
+        Tensor B_alpha{gemm.trans_b ? gemm.B.transpose() : gemm.B};
+        B_alpha.mul(gemm.alpha);
+        add_initializer(B_alpha);
+    }
+    Tensor C_beta{gemm.C};
+    C_beta.mul(gemm.beta);
+    add_initializer(C_beta);
+    add_shared_tensor(gemm.Y);
+}
+
 void Layer3::add_gemm(const OpGemm& gemm)
 {
+    if (gemm.quant.enabled) {
+        add_gemm_int8(gemm);
+        return;
+    }
+    if (gemm_tile_.micro_m > 0) {
+        add_gemm_tiled(gemm);
+        return;
+    }
+
     FunctionDef fdef;
     layer2_->begin_function(fdef, T_VOID);
         const auto func_id{fdef.id};
-        const auto alpha{gemm.alpha};
-        const auto beta{gemm.beta};
-        
-        Tensor B_alpha{gemm.trans_b ? gemm.B.transpose() : gemm.B};
-        Tensor C_beta{gemm.C};
-        B_alpha.mul(gemm.alpha);
-        C_beta.mul(gemm.beta);
-        add_const_tensor(B_alpha);
-        add_const_tensor(C_beta);
-        add_shared_tensor(gemm.Y);
 
-        const auto& A{global_tensors_.at(gemm.A.tt.name)};
-        const auto& B{global_tensors_.at(gemm.B.tt.name)};
-        const auto& C{global_tensors_.at(gemm.C.tt.name)};
-        const auto& Y{global_tensors_.at(gemm.Y.tt.name)};
+        const auto& A{tensor_meta(gemm.A.tt.name)};
+        const auto& B{tensor_meta(gemm.B.tt.name)};
+        const auto& C{tensor_meta(gemm.C.tt.name)};
+        const auto& Y{tensor_meta(gemm.Y.tt.name)};
 
         auto A_shape0{access_tensor_shape_index(func_id, A, 0)};
         auto A_shape1{access_tensor_shape_index(func_id, A, 1)};
@@ -37,43 +53,259 @@ void Layer3::add_gemm(const OpGemm& gemm)
         store_tensor_shape_element(func_id, Y, 1, B_shape1);
         store_tensor_dims(func_id, Y, A_dims);
 
-        auto this_element_var{layer1_->add_var(Y.dtype_id, SC_FUNCTION, layer1_->add_const(Y.dtype, 0))};
-        auto shape_element_type_id{layer1_->add_dtype(DT_UINT32)};
-        auto bo_mul{Y.dtype == DT_FLOAT ? BO_FMUL : BO_IMUL};
-        auto bo_add{Y.dtype == DT_FLOAT ? BO_FADD : BO_IADD};
-        auto invo_x{layer1_->access_invocation_index(func_id, 0)};
-        auto invo_y{layer1_->access_invocation_index(func_id, 1)};
-        
-        invocation_boundary_check(func_id, Y, 0);
-        invocation_boundary_check(func_id, Y, 1);
+        const auto N{gemm.trans_b ? gemm.B.tt.shape[0] : gemm.B.tt.shape[1]};
+        const auto acc_dtype{accumulate_dtype(gemm.name)};
+        const auto acc_dtype_id{layer1_->add_dtype(acc_dtype)};
+        if (weights_in_buffer_ && !gemm.trans_a && vec4_accessible(B) && vec4_accessible(C) && vec4_accessible(Y)
+            && acc_dtype == DT_FLOAT && N % 4 == 0 && gemm.C.tt.dims > 0 && gemm.C.tt.shape[gemm.C.tt.dims - 1] == N) {
+            add_gemm_vec4(func_id, gemm);
+        } else {
+            auto this_element_var{layer1_->add_var(acc_dtype_id, SC_FUNCTION, layer1_->add_const(acc_dtype, 0))};
+            auto shape_element_type_id{layer1_->add_dtype(DT_UINT32)};
+            auto bo_mul{dtype_is_float(acc_dtype) ? BO_FMUL : BO_IMUL};
+            auto bo_add{dtype_is_float(acc_dtype) ? BO_FADD : BO_IADD};
+            auto invo_x{layer1_->access_invocation_index(func_id, 0)};
+            auto invo_y{layer1_->access_invocation_index(func_id, 1)};
         
-        ForLoopDef for_def{.i_boundary_id = gemm.trans_a ? A_shape0 : A_shape1};
-        layer2_->begin_for(for_def);
-            auto i_id{layer1_->load_var(for_def.i_type_id, for_def.i_var_id)};
-            id_t A_row_begin{};
-            id_t A_element_index{};
-            if (gemm.trans_a) {
-                A_row_begin = layer1_->binary_op(BO_IMUL, func_id, shape_element_type_id, invo_y, A_shape0);
-                A_element_index = layer1_->binary_op(BO_IADD, func_id, shape_element_type_id, A_row_begin, i_id);
-            } else {
-                A_row_begin = layer1_->binary_op(BO_IMUL, func_id, shape_element_type_id, invo_x, A_shape1);
-                A_element_index = layer1_->binary_op(BO_IADD, func_id, shape_element_type_id, A_row_begin, i_id);
+            invocation_boundary_check(func_id, Y, 0);
+            invocation_boundary_check(func_id, Y, 1);
+
+            // loop invariant, emitted once before the loop. A is K x M when transposed,
+            // row x of op(A) is then column x of A
+            auto A_row_begin{gemm.trans_a
+                ? invo_x
+                : layer1_->binary_op(BO_IMUL, func_id, shape_element_type_id, invo_x, A_shape1)};
+
+            // A and B indices are induction variables, stepping along the A row (down the
+            // A column when transposed) and down the B column by addition only
+            ForLoopDef for_def{.i_boundary_id = gemm.trans_a ? A_shape0 : A_shape1,
+                .inductions = {{.init_id = A_row_begin, .step_id = gemm.trans_a ? A_shape1 : layer1_->add_const(DT_UINT32, 1)},
+                    {.init_id = invo_y, .step_id = B_shape1}},
+                .unroll = static_cast<uint32_t>(unroll_)};
+            layer2_->unrolled_for(func_id, for_def, [&] (id_t, const std::vector<id_t>& indices) {
+                auto A_element{load_tensor_element_as(func_id, A, indices.at(0), acc_dtype)};
+                auto B_element{load_tensor_element_as(func_id, B, indices.at(1), acc_dtype)};
+                auto AB_mul{layer1_->binary_op(bo_mul, func_id, acc_dtype_id, A_element, B_element)};
+                auto this_element_val{layer1_->load_var(acc_dtype_id, this_element_var)};
+                auto this_element_accu{layer1_->binary_op(bo_add, func_id, acc_dtype_id, AB_mul, this_element_val)};
+                layer1_->store_var(this_element_var, this_element_accu);
+            });
+
+            auto Y_shape1{access_tensor_shape_index(func_id, Y, 1)};
+            auto AB_element_val{layer1_->load_var(acc_dtype_id, this_element_var)};
+            auto C_element_id{load_tensor_element_as(func_id, C, gemm_bias_index(func_id, gemm, invo_x, invo_y), acc_dtype)};
+            auto final_this_element_val{layer1_->binary_op(bo_add, func_id, acc_dtype_id, AB_element_val, C_element_id)};
+            if (gemm.fused_relu) {
+                final_this_element_val = layer1_->std450()->max(acc_dtype, func_id, layer1_->add_const(acc_dtype, 0), final_this_element_val);
             }
-            auto B_row_begin{layer1_->binary_op(BO_IMUL, func_id, shape_element_type_id, i_id, B_shape1)};
-            auto B_element_index{layer1_->binary_op(BO_IADD, func_id, shape_element_type_id, B_row_begin, invo_y)};
-            auto A_element{load_tensor_element(func_id, A, A_element_index)};
-            auto B_element{load_tensor_element(func_id, B, B_element_index)};
-            auto AB_mul{layer1_->binary_op(bo_mul, func_id, Y.dtype_id, A_element, B_element)};
-            auto this_element_val{layer1_->load_var(Y.dtype_id, this_element_var)};
-            auto this_element_accu{layer1_->binary_op(bo_add, func_id, Y.dtype_id, AB_mul, this_element_val)};
-            layer1_->store_var(this_element_var, this_element_accu);
-        layer2_->end_for(for_def);
+            final_this_element_val = convert_element(final_this_element_val, acc_dtype, Y.dtype);
+            store_tensor_element(func_id, Y, invo_x, Y_shape1, invo_y, final_this_element_val);
+        }
+    layer2_->end_function(fdef);
+    layers_.push_back(func_id);
+}
 
-        auto Y_shape1{access_tensor_shape_index(func_id, Y, 1)};
-        auto AB_element_val{layer1_->load_var(Y.dtype_id, this_element_var)};
-        auto C_element_id{load_tensor_element(func_id, C, invo_x)};
-        auto final_this_element_val{layer1_->binary_op(bo_add, func_id, Y.dtype_id, AB_element_val, C_element_id)};
-        store_tensor_element(func_id, Y, invo_x, Y_shape1, invo_y, final_this_element_val);
+void Layer3::add_gemm_tiled(const OpGemm& gemm)
+{
+    // The register tile is unrolled and fixed at compile time, local size and tile_k are
+    // specialization constants and may be changed at pipeline creation, as long as
+    // tile_k stays a multiple of local_size_x and local_size_y.
+    const uint32_t MM{static_cast<uint32_t>(gemm_tile_.micro_m)};
+    const uint32_t MN{static_cast<uint32_t>(gemm_tile_.micro_n)};
+    assert(MN > 0 && gemm_tile_.tile_k > 0 && "Bad Gemm tile");
+    assert(gemm_tile_.tile_k % layer1_->local_size_x() == 0 && gemm_tile_.tile_k % layer1_->local_size_y() == 0
+        && "Gemm tile_k must be a multiple of the local size");
+
+    FunctionDef fdef;
+    layer2_->begin_function(fdef, T_VOID);
+        const auto func_id{fdef.id};
+
+        const auto& A{tensor_meta(gemm.A.tt.name)};
+        const auto& B{tensor_meta(gemm.B.tt.name)};
+        const auto& C{tensor_meta(gemm.C.tt.name)};
+        const auto& Y{tensor_meta(gemm.Y.tt.name)};
+
+        auto A_shape0{access_tensor_shape_index(func_id, A, 0)};
+        auto A_shape1{access_tensor_shape_index(func_id, A, 1)};
+        auto B_shape1{access_tensor_shape_index(func_id, B, 1)};
+        auto A_dims{access_tensor_dims(func_id, A)};
+        const auto M{gemm.trans_a ? A_shape1 : A_shape0};
+        const auto K{gemm.trans_a ? A_shape0 : A_shape1};
+        const auto N{B_shape1};
+        store_tensor_shape_element(func_id, Y, 0, M);
+        store_tensor_shape_element(func_id, Y, 1, N);
+        store_tensor_dims(func_id, Y, A_dims);
+
+        // staged tiles and the register tile hold the accumulation type
+        const auto acc_dtype{accumulate_dtype(gemm.name)};
+        const auto acc_dtype_id{layer1_->add_dtype(acc_dtype)};
+        const auto uint_id{layer1_->add_dtype(DT_UINT32)};
+        const auto bo_mul{dtype_is_float(acc_dtype) ? BO_FMUL : BO_IMUL};
+        const auto bo_add{dtype_is_float(acc_dtype) ? BO_FADD : BO_IADD};
+        const auto zero{layer1_->add_const(acc_dtype, 0.0f)};
+        const auto uint_zero{layer1_->add_const(DT_UINT32, 0u)};
+        auto uconst{[this] (uint32_t v) -> id_t { return layer1_->add_const(DT_UINT32, v); }};
+        auto iadd{[&] (id_t a, id_t b) -> id_t { return layer1_->binary_op(BO_IADD, func_id, uint_id, a, b); }};
+        auto imul{[&] (id_t a, id_t b) -> id_t { return layer1_->binary_op(BO_IMUL, func_id, uint_id, a, b); }};
+        auto spec_imul{[&] (id_t a, id_t b) -> id_t { return layer1_->spec_const_op(BO_IMUL, uint_id, a, b); }};
+        auto spec_udiv{[&] (id_t a, id_t b) -> id_t { return layer1_->spec_const_op(BO_UDIV, uint_id, a, b); }};
+        auto ceil_div{[&] (id_t a, id_t b) -> id_t {
+            auto b_minus_1{layer1_->binary_op(BO_ISUB, func_id, uint_id, b, uconst(1))};
+            return layer1_->binary_op(BO_UDIV, func_id, uint_id, iadd(a, b_minus_1), b);
+        }};
+        auto in_bounds{[&] (id_t i, id_t i_bound, id_t j, id_t j_bound) -> id_t {
+            auto i_in{layer1_->compare(CO_LT, i, i_bound)};
+            auto j_in{layer1_->compare(CO_LT, j, j_bound)};
+            return layer1_->binary_op(BO_LOGICAL_AND, func_id, layer1_->add_dtype(DT_BOOL), i_in, j_in);
+        }};
+
+        const auto LX{layer1_->local_size_id(0)};
+        const auto LY{layer1_->local_size_id(1)};
+        const auto BK{layer1_->add_spec_const(DT_UINT32, gemm_tile_.tile_k, SPEC_GEMM_TILE_K)};
+        const auto BM{spec_imul(LX, uconst(MM))};
+        const auto BN{spec_imul(LY, uconst(MN))};
+
+        // A and B tiles staged in workgroup memory, row major BM x BK and BK x BN
+        auto tile_elem_ptr_id{layer1_->add_type_pointer(acc_dtype_id, SC_WORKGROUP)};
+        auto A_tile_type{layer1_->add_spec_array_dtype(acc_dtype_id, spec_imul(BM, BK), SC_WORKGROUP)};
+        auto B_tile_type{layer1_->add_spec_array_dtype(acc_dtype_id, spec_imul(BK, BN), SC_WORKGROUP)};
+        auto A_tile{layer1_->add_var(A_tile_type, SC_WORKGROUP)};
+        auto B_tile{layer1_->add_var(B_tile_type, SC_WORKGROUP)};
+        layer1_->push_entry_listed_id(A_tile);
+        layer1_->push_entry_listed_id(B_tile);
+
+        // register micro tile, this invocation owns rows lx + i * LX and columns ly + j * LY
+        std::vector<id_t> acc(MM * MN);
+        for (auto& it : acc) {
+            it = layer1_->add_var(acc_dtype_id, SC_FUNCTION);
+        }
+
+        auto lx{layer1_->access_builtin_index(func_id, BI_LOCAL_INVOCATION_ID, 0)};
+        auto ly{layer1_->access_builtin_index(func_id, BI_LOCAL_INVOCATION_ID, 1)};
+        auto wg_x{layer1_->access_builtin_index(func_id, BI_WORKGROUP_ID, 0)};
+        auto wg_y{layer1_->access_builtin_index(func_id, BI_WORKGROUP_ID, 1)};
+        auto num_wg_x{layer1_->access_builtin_index(func_id, BI_NUM_WORKGROUPS, 0)};
+        auto num_wg_y{layer1_->access_builtin_index(func_id, BI_NUM_WORKGROUPS, 1)};
+
+        // rows and columns of the tiles owned by this invocation
+        std::vector<id_t> local_rows(MM), local_cols(MN);
+        for (uint32_t i = 0; i < MM; ++i) {
+            local_rows.at(i) = iadd(lx, spec_imul(uconst(i), LX));
+        }
+        for (uint32_t j = 0; j < MN; ++j) {
+            local_cols.at(j) = iadd(ly, spec_imul(uconst(j), LY));
+        }
+
+        Scope exe_scope{SCOPE_WORKGROUP};
+        Scope mem_scope{SCOPE_WORKGROUP};
+        MemSemantic mem_semantics{MS_WORKGROUP_MEMORY | MS_ACQUIRE_RELEASE};
+        auto num_k_tiles{ceil_div(K, BK)};
+
+        // Workgroups stride over the output tiles, so every workgroup runs the same
+        // number of iterations and the barriers stay in uniform control flow.
+        ForLoopDef tile_m_loop{.i_boundary_id = ceil_div(ceil_div(M, BM), num_wg_x)};
+        layer2_->begin_for(tile_m_loop);
+            auto tile_m_i{layer1_->load_var(tile_m_loop.i_type_id, tile_m_loop.i_var_id)};
+            auto row_base{imul(iadd(wg_x, imul(tile_m_i, num_wg_x)), BM)};
+
+            ForLoopDef tile_n_loop{.i_boundary_id = ceil_div(ceil_div(N, BN), num_wg_y)};
+            layer2_->begin_for(tile_n_loop);
+                auto tile_n_i{layer1_->load_var(tile_n_loop.i_type_id, tile_n_loop.i_var_id)};
+                auto col_base{imul(iadd(wg_y, imul(tile_n_i, num_wg_y)), BN)};
+
+                for (auto it : acc) {
+                    layer1_->store_var(it, zero);
+                }
+
+                ForLoopDef tile_k_loop{.i_boundary_id = num_k_tiles};
+                layer2_->begin_for(tile_k_loop);
+                    auto tile_k_i{layer1_->load_var(tile_k_loop.i_type_id, tile_k_loop.i_var_id)};
+                    auto k_base{imul(tile_k_i, BK)};
+
+                    // stage A tile, out of range elements are zero filled
+                    ForLoopDef a_loop{.i_boundary_id = spec_udiv(BK, LY)};
+                    layer2_->begin_for(a_loop);
+                        auto a_j{layer1_->load_var(a_loop.i_type_id, a_loop.i_var_id)};
+                        auto a_k_local{iadd(ly, imul(a_j, LY))};
+                        auto a_k{iadd(k_base, a_k_local)};
+                        for (uint32_t i = 0; i < MM; ++i) {
+                            auto row{iadd(row_base, local_rows.at(i))};
+                            auto in{in_bounds(row, M, a_k, K)};
+                            auto index{gemm.trans_a ? iadd(imul(a_k, M), row) : iadd(imul(row, K), a_k)};
+                            auto safe_index{layer1_->select(uint_id, in, index, uint_zero)};
+                            auto value{layer1_->select(acc_dtype_id, in, load_tensor_element_as(func_id, A, safe_index, acc_dtype), zero)};
+                            auto ptr{layer1_->access_chain(func_id, tile_elem_ptr_id, A_tile,
+                                {iadd(imul(local_rows.at(i), BK), a_k_local)})};
+                            layer1_->store_var(ptr, value);
+                        }
+                    layer2_->end_for(a_loop);
+
+                    // stage B tile
+                    ForLoopDef b_loop{.i_boundary_id = spec_udiv(BK, LX)};
+                    layer2_->begin_for(b_loop);
+                        auto b_i{layer1_->load_var(b_loop.i_type_id, b_loop.i_var_id)};
+                        auto b_k_local{iadd(lx, imul(b_i, LX))};
+                        auto b_k{iadd(k_base, b_k_local)};
+                        for (uint32_t j = 0; j < MN; ++j) {
+                            auto col{iadd(col_base, local_cols.at(j))};
+                            auto in{in_bounds(b_k, K, col, N)};
+                            auto safe_index{layer1_->select(uint_id, in, iadd(imul(b_k, N), col), uint_zero)};
+                            auto value{layer1_->select(acc_dtype_id, in, load_tensor_element_as(func_id, B, safe_index, acc_dtype), zero)};
+                            auto ptr{layer1_->access_chain(func_id, tile_elem_ptr_id, B_tile,
+                                {iadd(imul(b_k_local, BN), local_cols.at(j))})};
+                            layer1_->store_var(ptr, value);
+                        }
+                    layer2_->end_for(b_loop);
+                    layer1_->add_control_barrier(exe_scope, mem_scope, mem_semantics);
+
+                    // multiply-accumulate the staged tiles into the register tile, the
+                    // trip count is a constant once specialized
+                    ForLoopDef kk_loop{.i_boundary_id = BK};
+                    layer2_->begin_for(kk_loop);
+                        auto kk{layer1_->load_var(kk_loop.i_type_id, kk_loop.i_var_id)};
+                        std::vector<id_t> a(MM), b(MN);
+                        for (uint32_t i = 0; i < MM; ++i) {
+                            auto ptr{layer1_->access_chain(func_id, tile_elem_ptr_id, A_tile,
+                                {iadd(imul(local_rows.at(i), BK), kk)})};
+                            a.at(i) = layer1_->load_var(acc_dtype_id, ptr);
+                        }
+                        for (uint32_t j = 0; j < MN; ++j) {
+                            auto ptr{layer1_->access_chain(func_id, tile_elem_ptr_id, B_tile,
+                                {iadd(imul(kk, BN), local_cols.at(j))})};
+                            b.at(j) = layer1_->load_var(acc_dtype_id, ptr);
+                        }
+                        for (uint32_t i = 0; i < MM; ++i) {
+                            for (uint32_t j = 0; j < MN; ++j) {
+                                auto ab{layer1_->binary_op(bo_mul, func_id, acc_dtype_id, a.at(i), b.at(j))};
+                                auto acc_val{layer1_->load_var(acc_dtype_id, acc.at(i * MN + j))};
+                                layer1_->store_var(acc.at(i * MN + j), layer1_->binary_op(bo_add, func_id, acc_dtype_id, ab, acc_val));
+                            }
+                        }
+                    layer2_->end_for(kk_loop);
+                    layer1_->add_control_barrier(exe_scope, mem_scope, mem_semantics);
+                layer2_->end_for(tile_k_loop);
+
+                // add bias and write back the register tile
+                for (uint32_t i = 0; i < MM; ++i) {
+                    auto row{iadd(row_base, local_rows.at(i))};
+                    for (uint32_t j = 0; j < MN; ++j) {
+                        auto col{iadd(col_base, local_cols.at(j))};
+                        IfDef row_in, col_in;
+                        layer2_->begin_if(row_in, M, CO_GT, row);
+                        layer2_->begin_if(col_in, N, CO_GT, col);
+                            auto C_element{load_tensor_element_as(func_id, C, gemm_bias_index(func_id, gemm, row, col), acc_dtype)};
+                            auto AB_element{layer1_->load_var(acc_dtype_id, acc.at(i * MN + j))};
+                            auto result{layer1_->binary_op(bo_add, func_id, acc_dtype_id, AB_element, C_element)};
+                            if (gemm.fused_relu) {
+                                result = layer1_->std450()->max(acc_dtype, func_id, zero, result);
+                            }
+                            store_tensor_element(func_id, Y, row, N, col, convert_element(result, acc_dtype, Y.dtype));
+                        layer2_->end_if(col_in);
+                        layer2_->end_if(row_in);
+                    }
+                }
+            layer2_->end_for(tile_n_loop);
+        layer2_->end_for(tile_m_loop);
     layer2_->end_function(fdef);
     layers_.push_back(func_id);
 }
@@ -83,14 +315,8 @@ void Layer3::add_relu(const OpRelu& relu)
     FunctionDef fdef;
     layer2_->begin_function(fdef, T_VOID);
         const auto func_id{fdef.id};
-        const auto& X{global_tensors_.at(relu.X.tt.name)};
-        // infer Y from X
-        Tensor tensor_Y;
-        tensor_Y.tt.name = relu.Y.tt.name;
-        tensor_Y.tt.dtype = X.dtype;
-        tensor_Y.tt.row_major = true;
-        add_shared_tensor(relu.Y);
-        const auto& Y{global_tensors_.at(relu.Y.tt.name)};
+        const auto& X{tensor_meta(relu.X.tt.name)};
+        const auto& Y{tensor_meta(relu.Y.tt.name)};
 
         // Setup output tensor dims and shape
         auto X_shape0{access_tensor_shape_index(func_id, X, 0)};
@@ -100,16 +326,325 @@ void Layer3::add_relu(const OpRelu& relu)
         store_tensor_shape_element(func_id, Y, 0, X_shape0);
         store_tensor_shape_element(func_id, Y, 1, X_shape1);
 
-        // boundary check
-        invocation_boundary_check(func_id, Y, 0);
-        invocation_boundary_check(func_id, Y, 1);
+        if (vec4_accessible(X) && vec4_accessible(Y)) {
+            add_relu_vec4(func_id, X, Y);
+        } else {
+            // boundary check
+            invocation_boundary_check(func_id, Y, 0);
+            invocation_boundary_check(func_id, Y, 1);
+
+            // relu operator eval
+            auto invo_x{layer1_->access_invocation_index(func_id, 0)};
+            auto invo_y{layer1_->access_invocation_index(func_id, 1)};
+            auto x{load_tensor_element(func_id, X, invo_x, X_shape1, invo_y)};
+            auto relu_result{layer1_->std450()->max(X.dtype, func_id, layer1_->add_const(X.dtype, 0), x)};
+            store_tensor_element(func_id, Y, invo_x, X_shape1, invo_y, relu_result);
+        }
+    layer2_->end_function(fdef);
+    layers_.push_back(func_id);
+}
+
+void Layer3::add_relu_vec4(id_t func_id, const TensorMeta& X, const TensorMeta& Y)
+{
+    // Relu is elementwise, so the row-major data is handled as one flat array. Invocation
+    // (x, y) owns the vec4 chunk x * ceil(shape1 / 4) + y, the host grid stays the one
+    // of the scalar kernel. The last chunk may be partial and is done element by element.
+    const auto uint_id{layer1_->add_dtype(DT_UINT32)};
+    const auto vec4_id{layer1_->add_vector_dtype(X.dtype_id, 4)};
+    const auto zero_id{layer1_->add_const(X.dtype, 0)};
+    const auto zero4_id{layer1_->add_const_vector(vec4_id, {zero_id, zero_id, zero_id, zero_id})};
+    const auto one_id{layer1_->add_const(DT_UINT32, 1)};
+    const auto three_id{layer1_->add_const(DT_UINT32, 3)};
+    const auto four_id{layer1_->add_const(DT_UINT32, 4)};
+
+    auto X_shape0{access_tensor_shape_index(func_id, X, 0)};
+    auto X_shape1{access_tensor_shape_index(func_id, X, 1)};
+    auto invo_x{layer1_->access_invocation_index(func_id, 0)};
+    auto invo_y{layer1_->access_invocation_index(func_id, 1)};
+    invocation_boundary_check(func_id, Y, 0);
+
+    auto chunks_per_row{layer1_->binary_op(BO_UDIV, func_id, uint_id,
+        layer1_->binary_op(BO_IADD, func_id, uint_id, X_shape1, three_id), four_id)};
+    IfDef row_end;
+    layer2_->begin_if(row_end, invo_y, CO_GE, chunks_per_row);
+        layer1_->add_return();
+    layer2_->end_if(row_end);
+
+    auto num_elems{layer1_->binary_op(BO_IMUL, func_id, uint_id, X_shape0, X_shape1)};
+    auto chunk{layer1_->binary_op(BO_IADD, func_id, uint_id,
+        layer1_->binary_op(BO_IMUL, func_id, uint_id, invo_x, chunks_per_row), invo_y)};
+    auto first{layer1_->binary_op(BO_IMUL, func_id, uint_id, chunk, four_id)};
+    IfDef data_end;
+    layer2_->begin_if(data_end, first, CO_GE, num_elems);
+        layer1_->add_return();
+    layer2_->end_if(data_end);
+
+    IfDef full_chunk;
+    auto last{layer1_->binary_op(BO_IADD, func_id, uint_id, first, three_id)};
+    layer2_->begin_if(full_chunk, last, CO_LT, num_elems);
+        auto x4{load_tensor_vec4(func_id, X, chunk)};
+        auto relu4{layer1_->std450()->max(X.dtype, vec4_id, func_id, zero4_id, x4)};
+        store_tensor_vec4(func_id, Y, chunk, relu4);
+        layer1_->add_return();
+    layer2_->end_if(full_chunk);
 
-        // relu operator eval
+    // scalar tail, first is in range already
+    auto index{first};
+    for (int t = 0; t < 4; ++t) {
+        IfDef in_range;
+        layer2_->begin_if(in_range, index, CO_LT, num_elems);
+            auto x{load_tensor_element(func_id, X, index)};
+            auto relu_result{layer1_->std450()->max(X.dtype, func_id, zero_id, x)};
+            store_tensor_element(func_id, Y, index, relu_result);
+        layer2_->end_if(in_range);
+        index = layer1_->binary_op(BO_IADD, func_id, uint_id, index, one_id);
+    }
+}
+
+void Layer3::add_gemm_vec4(id_t func_id, const OpGemm& gemm)
+{
+    // Invocation (x, y) computes Y[x, 4y .. 4y + 3]. B and C live in the weights buffer,
+    // N is a multiple of 4, so every row of them starts at a vec4 boundary. A is read
+    // as vec4 as well when it is in a storage buffer and K is a static multiple of 4.
+    const auto& A{tensor_meta(gemm.A.tt.name)};
+    const auto& B{tensor_meta(gemm.B.tt.name)};
+    const auto& C{tensor_meta(gemm.C.tt.name)};
+    const auto& Y{tensor_meta(gemm.Y.tt.name)};
+    const auto N{gemm.trans_b ? gemm.B.tt.shape[0] : gemm.B.tt.shape[1]};
+    const auto K{gemm.trans_b ? gemm.B.tt.shape[1] : gemm.B.tt.shape[0]};
+    const bool A_vec4{vec4_accessible(A) && !(gemm.A.tt.dynamic_dims & 2) && K % 4 == 0};
+    assert(!gemm.trans_a && "Bad logic. Transposed A has no vec4 path.");
+
+    const auto uint_id{layer1_->add_dtype(DT_UINT32)};
+    const auto vec4_id{layer1_->add_vector_dtype(Y.dtype_id, 4)};
+    const auto zero_id{layer1_->add_const(Y.dtype, 0)};
+    const auto zero4_id{layer1_->add_const_vector(vec4_id, {zero_id, zero_id, zero_id, zero_id})};
+    const auto N4{layer1_->add_const(DT_UINT32, N / 4)};
+
+    auto invo_x{layer1_->access_invocation_index(func_id, 0)};
+    auto invo_y{layer1_->access_invocation_index(func_id, 1)};
+    auto acc_var{layer1_->add_var(vec4_id, SC_FUNCTION, zero4_id)};
+    invocation_boundary_check(func_id, Y, 0);
+    IfDef col_end;
+    layer2_->begin_if(col_end, invo_y, CO_GE, N4);
+        layer1_->add_return();
+    layer2_->end_if(col_end);
+
+    if (A_vec4) {
+        const auto K4{layer1_->add_const(DT_UINT32, K / 4)};
+        auto A_row_begin{layer1_->binary_op(BO_IMUL, func_id, uint_id, invo_x, K4)};
+        // one A vec4 covers four B rows, the row offsets within a step are constants
+        ForLoopDef for_def{.i_boundary_id = K4,
+            .inductions = {{.init_id = A_row_begin, .step_id = layer1_->add_const(DT_UINT32, 1)},
+                {.init_id = invo_y, .step_id = layer1_->add_const(DT_UINT32, N)}},
+            .unroll = static_cast<uint32_t>(unroll_)};
+        layer2_->unrolled_for(func_id, for_def, [&] (id_t, const std::vector<id_t>& indices) {
+            auto a4{load_tensor_vec4(func_id, A, indices.at(0))};
+            auto acc{layer1_->load_var(vec4_id, acc_var)};
+            for (uint32_t t = 0; t < 4; ++t) {
+                auto a{layer1_->composite_extract(Y.dtype_id, a4, t)};
+                auto B_index{t == 0 ? indices.at(1)
+                    : layer1_->binary_op(BO_IADD, func_id, uint_id, indices.at(1), layer1_->add_const(DT_UINT32, t * (N / 4)))};
+                auto b4{load_tensor_vec4(func_id, B, B_index)};
+                auto ab{layer1_->binary_op(BO_VECTOR_TIMES_SCALAR, func_id, vec4_id, b4, a)};
+                acc = layer1_->binary_op(BO_FADD, func_id, vec4_id, acc, ab);
+            }
+            layer1_->store_var(acc_var, acc);
+        });
+    } else {
+        auto A_shape1{access_tensor_shape_index(func_id, A, 1)};
+        auto A_row_begin{layer1_->binary_op(BO_IMUL, func_id, uint_id, invo_x, A_shape1)};
+        ForLoopDef for_def{.i_boundary_id = A_shape1,
+            .inductions = {{.init_id = A_row_begin, .step_id = layer1_->add_const(DT_UINT32, 1)},
+                {.init_id = invo_y, .step_id = N4}},
+            .unroll = static_cast<uint32_t>(unroll_)};
+        layer2_->unrolled_for(func_id, for_def, [&] (id_t, const std::vector<id_t>& indices) {
+            auto a{load_tensor_element_as(func_id, A, indices.at(0), Y.dtype)};
+            auto b4{load_tensor_vec4(func_id, B, indices.at(1))};
+            auto ab{layer1_->binary_op(BO_VECTOR_TIMES_SCALAR, func_id, vec4_id, b4, a)};
+            auto acc{layer1_->load_var(vec4_id, acc_var)};
+            layer1_->store_var(acc_var, layer1_->binary_op(BO_FADD, func_id, vec4_id, acc, ab));
+        });
+    }
+
+    auto Y_index{layer1_->binary_op(BO_IADD, func_id, uint_id,
+        layer1_->binary_op(BO_IMUL, func_id, uint_id, invo_x, N4), invo_y)};
+    // C is a row of N or M x N here, a row broadcasts over the rows of Y
+    const auto& C_tt{gemm.C.tt};
+    const bool C_rows{C_tt.dims > 1 && (C_tt.shape[C_tt.dims - 2] > 1 || (C_tt.dynamic_dims & (1u << (C_tt.dims - 2))))};
+    auto c4{load_tensor_vec4(func_id, C, C_rows ? Y_index : invo_y)};
+    auto result{layer1_->binary_op(BO_FADD, func_id, vec4_id, layer1_->load_var(vec4_id, acc_var), c4)};
+    if (gemm.fused_relu) {
+        result = layer1_->std450()->max(Y.dtype, vec4_id, func_id, zero4_id, result);
+    }
+    store_tensor_vec4(func_id, Y, Y_index, result);
+}
+
+id_t Layer3::gemm_bias_index(id_t func_id, const OpGemm& gemm, id_t row_id, id_t col_id)
+{
+    // C broadcasts unidirectionally to M x N, a dim of size 1 does not step
+    const auto& tt{gemm.C.tt};
+    const uint32_t cols{tt.dims > 0 ? tt.shape[tt.dims - 1] : 1u};
+    const bool row_steps{tt.dims > 1 && (tt.shape[tt.dims - 2] > 1 || (tt.dynamic_dims & (1u << (tt.dims - 2))))};
+    const auto uint_id{layer1_->add_dtype(DT_UINT32)};
+    if (!row_steps) {
+        return cols > 1 ? col_id : layer1_->add_const(DT_UINT32, 0);
+    }
+    if (cols == 1) {
+        return row_id;
+    }
+    auto row_begin{layer1_->binary_op(BO_IMUL, func_id, uint_id, row_id, layer1_->add_const(DT_UINT32, cols))};
+    return layer1_->binary_op(BO_IADD, func_id, uint_id, row_begin, col_id);
+}
+
+id_t Layer3::quantize_element(id_t func_id, id_t value_id, float scale, int zero_point, int qmin, int qmax)
+{
+    // clamp(round_even(x / scale) + zero_point, qmin, qmax) - zero_point, kept in float,
+    // the values are small integers and stay exact
+    const auto float_id{layer1_->add_dtype(DT_FLOAT)};
+    auto q{layer1_->binary_op(BO_FDIV, func_id, float_id, value_id, layer1_->add_const(DT_FLOAT, scale))};
+    q = layer1_->std450()->round_even(DT_FLOAT, func_id, q);
+    q = layer1_->binary_op(BO_FADD, func_id, float_id, q, layer1_->add_const(DT_FLOAT, zero_point));
+    q = layer1_->std450()->min(DT_FLOAT, func_id, q, layer1_->add_const(DT_FLOAT, qmax));
+    q = layer1_->std450()->max(DT_FLOAT, func_id, q, layer1_->add_const(DT_FLOAT, qmin));
+    return layer1_->binary_op(BO_FADD, func_id, float_id, q, layer1_->add_const(DT_FLOAT, -zero_point));
+}
+
+Tensor Layer3::pack_int8_weights(const OpGemm& gemm) const
+{
+    assert((gemm.B.tt.dtype == DT_INT8 || gemm.B.tt.dtype == DT_UINT8) && "Bad quantized weights");
+    const uint32_t K{gemm.trans_b ? gemm.B.tt.shape[1] : gemm.B.tt.shape[0]};
+    const uint32_t N{gemm.trans_b ? gemm.B.tt.shape[0] : gemm.B.tt.shape[1]};
+    const uint32_t KW{(K + 3) / 4};
+
+    // column n is KW consecutive words, byte t of word w holds k = 4w + t
+    Tensor B_packed;
+    B_packed.tt.name = gemm.B.tt.name;
+    B_packed.tt.dtype = DT_INT32;
+    B_packed.tt.dims = 2;
+    B_packed.tt.row_major = true;
+    B_packed.tt.shape[0] = N;
+    B_packed.tt.shape[1] = KW;
+    B_packed.tt.dynamic_dims = 0;
+    B_packed.data.resize(N * KW * DT_INT32_BYTES, 0);
+    for (uint32_t n = 0; n < N; ++n) {
+        for (uint32_t k = 0; k < K; ++k) {
+            B_packed.data.at(n * KW * DT_INT32_BYTES + k) = gemm.B.data.at(gemm.trans_b ? n * K + k : k * N + n);
+        }
+    }
+    return B_packed;
+}
+
+Tensor Layer3::int8_scale(const OpGemm& gemm) const
+{
+    // alpha and both input scales fold into one scale per output column
+    const auto& quant{gemm.quant};
+    const uint32_t N{gemm.trans_b ? gemm.B.tt.shape[0] : gemm.B.tt.shape[1]};
+    Tensor scale;
+    scale.tt.name = gemm.B.tt.name + "_scale";
+    scale.tt.dtype = DT_FLOAT;
+    scale.tt.dims = 1;
+    scale.tt.row_major = true;
+    scale.tt.shape[0] = N;
+    scale.tt.dynamic_dims = 0;
+    scale.data.resize(N * DT_FLOAT_BYTES);
+    for (uint32_t n = 0; n < N; ++n) {
+        scale.set<DT_FLOAT>(n, gemm.alpha * quant.a_scale * quant.b_scale.at(quant.b_scale.size() > 1 ? n : 0));
+    }
+    return scale;
+}
+
+void Layer3::add_gemm_int8(const OpGemm& gemm)
+{
+    // The weights stay in int8, four of them packed in a 32-bit word along K, a load
+    // fetches a quarter of the bytes of the float path. A is quantized as it is loaded,
+    // the products accumulate exactly in int32 and are scaled back once per output.
+    const auto& quant{gemm.quant};
+    const uint32_t K{gemm.trans_b ? gemm.B.tt.shape[1] : gemm.B.tt.shape[0]};
+    const uint32_t N{gemm.trans_b ? gemm.B.tt.shape[0] : gemm.B.tt.shape[1]};
+    const uint32_t KW{(K + 3) / 4};
+
+    FunctionDef fdef;
+    layer2_->begin_function(fdef, T_VOID);
+        const auto func_id{fdef.id};
+
+        // B is the packed weights, see pack_int8_weights
+        const auto& A{tensor_meta(gemm.A.tt.name)};
+        const auto& B{tensor_meta(gemm.B.tt.name)};
+        const auto& S{tensor_meta(gemm.B.tt.name + "_scale")};
+        const auto& C{tensor_meta(gemm.C.tt.name)};
+        const auto& Y{tensor_meta(gemm.Y.tt.name)};
+
+        auto A_shape0{access_tensor_shape_index(func_id, A, 0)};
+        auto A_shape1{access_tensor_shape_index(func_id, A, 1)};
+        auto A_dims{access_tensor_dims(func_id, A)};
+        store_tensor_shape_element(func_id, Y, 0, gemm.trans_a ? A_shape1 : A_shape0);
+        store_tensor_shape_element(func_id, Y, 1, layer1_->add_const(DT_UINT32, N));
+        store_tensor_dims(func_id, Y, A_dims);
+
+        const auto uint_id{layer1_->add_dtype(DT_UINT32)};
+        const auto int_id{layer1_->add_dtype(DT_INT32)};
+        const auto float_id{layer1_->add_dtype(DT_FLOAT)};
+        const bool sign_extend{gemm.B.tt.dtype == DT_INT8};
         auto invo_x{layer1_->access_invocation_index(func_id, 0)};
         auto invo_y{layer1_->access_invocation_index(func_id, 1)};
-        auto x{load_tensor_element(func_id, X, invo_x, X_shape1, invo_y)};
-        auto relu_result{layer1_->std450()->max(X.dtype, func_id, layer1_->add_const(X.dtype, 0), x)};
-        store_tensor_element(func_id, Y, invo_x, X_shape1, invo_y, relu_result);
+        auto acc_var{layer1_->add_var(int_id, SC_FUNCTION, layer1_->add_const(DT_INT32, 0))};
+
+        invocation_boundary_check(func_id, Y, 0);
+        invocation_boundary_check(func_id, Y, 1);
+
+        // acc += (A[m, k] quantized - zero point) * (byte t of word - zero point)
+        auto multiply_add = [&] (id_t word_id, uint32_t t, id_t k_id) {
+            auto A_index{gemm.trans_a
+                ? layer1_->binary_op(BO_IADD, func_id, uint_id, layer1_->binary_op(BO_IMUL, func_id, uint_id, k_id, A_shape1), invo_x)
+                : layer1_->binary_op(BO_IADD, func_id, uint_id, layer1_->binary_op(BO_IMUL, func_id, uint_id, invo_x, A_shape1), k_id)};
+            auto a{quantize_element(func_id, load_tensor_element_as(func_id, A, A_index, DT_FLOAT),
+                quant.a_scale, quant.a_zero_point, quant.a_qmin, quant.a_qmax)};
+            a = layer1_->convert(CVT_F_TO_S, int_id, a);
+            auto w{layer1_->bit_field_extract(sign_extend, int_id, word_id,
+                layer1_->add_const(DT_UINT32, 8 * t), layer1_->add_const(DT_UINT32, 8))};
+            if (quant.b_zero_point != 0) {
+                w = layer1_->binary_op(BO_ISUB, func_id, int_id, w, layer1_->add_const(DT_INT32, quant.b_zero_point));
+            }
+            auto acc{layer1_->load_var(int_id, acc_var)};
+            auto ab{layer1_->binary_op(BO_IMUL, func_id, int_id, a, w)};
+            layer1_->store_var(acc_var, layer1_->binary_op(BO_IADD, func_id, int_id, acc, ab));
+        };
+
+        auto B_col_begin{layer1_->binary_op(BO_IMUL, func_id, uint_id, invo_y, layer1_->add_const(DT_UINT32, KW))};
+        if (K / 4 > 0) {
+            ForLoopDef for_def{.i_boundary_id = layer1_->add_const(DT_UINT32, K / 4)};
+            layer2_->begin_for(for_def);
+                auto w4{layer1_->load_var(for_def.i_type_id, for_def.i_var_id)};
+                auto word{load_tensor_element(func_id, B, layer1_->binary_op(BO_IADD, func_id, uint_id, B_col_begin, w4))};
+                auto k_begin{layer1_->binary_op(BO_IMUL, func_id, uint_id, w4, layer1_->add_const(DT_UINT32, 4))};
+                for (uint32_t t = 0; t < 4; ++t) {
+                    multiply_add(word, t, layer1_->binary_op(BO_IADD, func_id, uint_id, k_begin, layer1_->add_const(DT_UINT32, t)));
+                }
+            layer2_->end_for(for_def);
+        }
+        if (K % 4 > 0) {
+            // tail word, only its first K % 4 bytes are weights
+            auto word{load_tensor_element(func_id, B,
+                layer1_->binary_op(BO_IADD, func_id, uint_id, B_col_begin, layer1_->add_const(DT_UINT32, K / 4)))};
+            for (uint32_t t = 0; t < K % 4; ++t) {
+                multiply_add(word, t, layer1_->add_const(DT_UINT32, K / 4 * 4 + t));
+            }
+        }
+
+        auto Y_shape1{access_tensor_shape_index(func_id, Y, 1)};
+        auto result{layer1_->convert(CVT_S_TO_F, float_id, layer1_->load_var(int_id, acc_var))};
+        result = layer1_->binary_op(BO_FMUL, func_id, float_id, result, load_tensor_element_as(func_id, S, invo_y, DT_FLOAT));
+        result = layer1_->binary_op(BO_FADD, func_id, float_id, result,
+            load_tensor_element_as(func_id, C, gemm_bias_index(func_id, gemm, invo_x, invo_y), DT_FLOAT));
+        if (quant.requantize) {
+            result = quantize_element(func_id, result, quant.y_scale, quant.y_zero_point, quant.y_qmin, quant.y_qmax);
+            result = layer1_->binary_op(BO_FMUL, func_id, float_id, result, layer1_->add_const(DT_FLOAT, quant.y_scale));
+        }
+        if (gemm.fused_relu) {
+            result = layer1_->std450()->max(DT_FLOAT, func_id, layer1_->add_const(DT_FLOAT, 0), result);
+        }
+        store_tensor_element(func_id, Y, invo_x, Y_shape1, invo_y, convert_element(result, DT_FLOAT, Y.dtype));
     layer2_->end_function(fdef);
     layers_.push_back(func_id);
 }
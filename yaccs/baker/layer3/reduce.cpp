@@ -0,0 +1,307 @@
+#include "yaccs/baker/layer3/layer3.hpp"
+#include "yaccs/baker/def.hpp"
+#include "yaccs/baker/layer1/layer1.hpp"
+#include "yaccs/baker/layer2/def.hpp"
+#include "yaccs/baker/layer2/layer2.hpp"
+#include "yaccs/dtype.hpp"
+#include "yaccs/tensor.hpp"
+#include <limits>
+
+
+void Layer3::add_reduce(const OpReduce& reduce)
+{
+    assert(reduce.X.tt.dims == 2 && reduce.axes.size() == 1 && reduce.axes.at(0) == 1
+        && "Only the last axis of a 2-D tensor can be reduced");
+    const auto op{reduce.op_type.compare("ReduceMax") == 0 ? GO_FMAX : GO_FADD};
+    const bool mean{reduce.op_type.compare("ReduceMean") == 0};
+
+    FunctionDef fdef;
+    layer2_->begin_function(fdef, T_VOID);
+        const auto func_id{fdef.id};
+        const auto& X{tensor_meta(reduce.X.tt.name)};
+        const auto& Y{tensor_meta(reduce.Y.tt.name)};
+
+        const auto uint_id{layer1_->add_dtype(DT_UINT32)};
+        const auto float_id{layer1_->add_dtype(DT_FLOAT)};
+        const auto one{layer1_->add_const(DT_UINT32, 1u)};
+        auto iadd{[&] (id_t a, id_t b) -> id_t { return layer1_->binary_op(BO_IADD, func_id, uint_id, a, b); }};
+        auto imul{[&] (id_t a, id_t b) -> id_t { return layer1_->binary_op(BO_IMUL, func_id, uint_id, a, b); }};
+        auto ceil_div{[&] (id_t a, id_t b) -> id_t {
+            auto b_minus_1{layer1_->binary_op(BO_ISUB, func_id, uint_id, b, one)};
+            return layer1_->binary_op(BO_UDIV, func_id, uint_id, iadd(a, b_minus_1), b);
+        }};
+
+        auto M{access_tensor_shape_index(func_id, X, 0)};
+        auto N{access_tensor_shape_index(func_id, X, 1)};
+        if (reduce.keepdims) {
+            store_tensor_dims(func_id, Y, access_tensor_dims(func_id, X));
+            store_tensor_shape_element(func_id, Y, 0, M);
+            store_tensor_shape_element(func_id, Y, 1, one);
+        } else {
+            store_tensor_dims(func_id, Y, one);
+            store_tensor_shape_element(func_id, Y, 0, M);
+        }
+
+        auto lane{layer1_->access_builtin(func_id, BI_LOCAL_INVOCATION_INDEX)};
+        auto wg_x{layer1_->access_builtin_index(func_id, BI_WORKGROUP_ID, 0)};
+        auto num_wg_x{layer1_->access_builtin_index(func_id, BI_NUM_WORKGROUPS, 0)};
+        load_reduce_builtins(func_id);
+
+        // Workgroups stride over the rows and the whole workgroup reduces one row, the
+        // row guard only depends on the workgroup id and keeps the barriers uniform.
+        ForLoopDef row_loop{.i_boundary_id = ceil_div(M, num_wg_x)};
+        layer2_->begin_for(row_loop);
+            auto row_i{layer1_->load_var(row_loop.i_type_id, row_loop.i_var_id)};
+            auto row{iadd(wg_x, imul(row_i, num_wg_x))};
+            IfDef row_in;
+            layer2_->begin_if(row_in, row, CO_LT, M);
+                auto result{reduce_row(func_id, op, X, imul(row, N), N)};
+                if (mean) {
+                    auto count{layer1_->convert(CVT_U_TO_F, float_id, N)};
+                    result = layer1_->binary_op(BO_FDIV, func_id, float_id, result, count);
+                }
+                IfDef first_lane;
+                layer2_->begin_if(first_lane, lane, CO_LT, one);
+                    store_tensor_element(func_id, Y, row, convert_element(result, DT_FLOAT, Y.dtype));
+                layer2_->end_if(first_lane);
+            layer2_->end_if(row_in);
+        layer2_->end_for(row_loop);
+    layer2_->end_function(fdef);
+    layers_.push_back(func_id);
+}
+
+void Layer3::add_softmax(const OpSoftmax& softmax)
+{
+    assert(softmax.X.tt.dims == 2 && softmax.axis == 1 && "Only Softmax over the last axis of a 2-D tensor is supported");
+
+    FunctionDef fdef;
+    layer2_->begin_function(fdef, T_VOID);
+        const auto func_id{fdef.id};
+        const auto& X{tensor_meta(softmax.X.tt.name)};
+        const auto& Y{tensor_meta(softmax.Y.tt.name)};
+
+        const auto uint_id{layer1_->add_dtype(DT_UINT32)};
+        const auto float_id{layer1_->add_dtype(DT_FLOAT)};
+        const auto one{layer1_->add_const(DT_UINT32, 1u)};
+        auto iadd{[&] (id_t a, id_t b) -> id_t { return layer1_->binary_op(BO_IADD, func_id, uint_id, a, b); }};
+        auto imul{[&] (id_t a, id_t b) -> id_t { return layer1_->binary_op(BO_IMUL, func_id, uint_id, a, b); }};
+        auto ceil_div{[&] (id_t a, id_t b) -> id_t {
+            auto b_minus_1{layer1_->binary_op(BO_ISUB, func_id, uint_id, b, one)};
+            return layer1_->binary_op(BO_UDIV, func_id, uint_id, iadd(a, b_minus_1), b);
+        }};
+        auto spec_imul{[&] (id_t a, id_t b) -> id_t { return layer1_->spec_const_op(BO_IMUL, uint_id, a, b); }};
+
+        auto M{access_tensor_shape_index(func_id, X, 0)};
+        auto N{access_tensor_shape_index(func_id, X, 1)};
+        store_tensor_dims(func_id, Y, access_tensor_dims(func_id, X));
+        store_tensor_shape_element(func_id, Y, 0, M);
+        store_tensor_shape_element(func_id, Y, 1, N);
+
+        const auto lanes{spec_imul(spec_imul(layer1_->local_size_id(0), layer1_->local_size_id(1)), layer1_->local_size_id(2))};
+        auto lane{layer1_->access_builtin(func_id, BI_LOCAL_INVOCATION_INDEX)};
+        auto wg_x{layer1_->access_builtin_index(func_id, BI_WORKGROUP_ID, 0)};
+        auto num_wg_x{layer1_->access_builtin_index(func_id, BI_NUM_WORKGROUPS, 0)};
+        load_reduce_builtins(func_id);
+
+        ForLoopDef row_loop{.i_boundary_id = ceil_div(M, num_wg_x)};
+        layer2_->begin_for(row_loop);
+            auto row_i{layer1_->load_var(row_loop.i_type_id, row_loop.i_var_id)};
+            auto row{iadd(wg_x, imul(row_i, num_wg_x))};
+            IfDef row_in;
+            layer2_->begin_if(row_in, row, CO_LT, M);
+                // subtract the row max before exp, so the sum can not overflow
+                auto row_begin{imul(row, N)};
+                auto row_max{reduce_row(func_id, GO_FMAX, X, row_begin, N)};
+                auto shifted_exp{[&] (id_t x) -> id_t {
+                    auto shifted{layer1_->binary_op(BO_FSUB, func_id, float_id, x, row_max)};
+                    return layer1_->std450()->exp(DT_FLOAT, func_id, shifted);
+                }};
+                auto row_sum{reduce_row(func_id, GO_FADD, X, row_begin, N, shifted_exp)};
+
+                ForLoopDef col_loop{.i_boundary_id = ceil_div(N, lanes)};
+                layer2_->begin_for(col_loop);
+                    auto col_i{layer1_->load_var(col_loop.i_type_id, col_loop.i_var_id)};
+                    auto col{iadd(imul(col_i, lanes), lane)};
+                    IfDef col_in;
+                    layer2_->begin_if(col_in, col, CO_LT, N);
+                        auto index{iadd(row_begin, col)};
+                        auto x{shifted_exp(load_tensor_element_as(func_id, X, index, DT_FLOAT))};
+                        auto y{layer1_->binary_op(BO_FDIV, func_id, float_id, x, row_sum)};
+                        store_tensor_element(func_id, Y, index, convert_element(y, DT_FLOAT, Y.dtype));
+                    layer2_->end_if(col_in);
+                layer2_->end_for(col_loop);
+            layer2_->end_if(row_in);
+        layer2_->end_for(row_loop);
+    layer2_->end_function(fdef);
+    layers_.push_back(func_id);
+}
+
+id_t Layer3::reduce_row(id_t func_id, GroupOp op, const TensorMeta& X, id_t row_begin, id_t N,
+    const std::function<id_t(id_t)>& map)
+{
+    // Invocation lane folds columns lane, lane + lanes, ... into a private partial, in
+    // float whatever the tensor type is. Must be called from uniform control flow.
+    const auto uint_id{layer1_->add_dtype(DT_UINT32)};
+    const auto float_id{layer1_->add_dtype(DT_FLOAT)};
+    const auto identity{op == GO_FMAX
+        ? layer1_->add_const(DT_FLOAT, -std::numeric_limits<float>::infinity())
+        : layer1_->add_const(DT_FLOAT, 0.0f)};
+    auto spec_imul{[&] (id_t a, id_t b) -> id_t { return layer1_->spec_const_op(BO_IMUL, uint_id, a, b); }};
+    const auto lanes{spec_imul(spec_imul(layer1_->local_size_id(0), layer1_->local_size_id(1)), layer1_->local_size_id(2))};
+    auto lane{layer1_->access_builtin(func_id, BI_LOCAL_INVOCATION_INDEX)};
+
+    auto partial_var{layer1_->add_var(float_id, SC_FUNCTION)};
+    layer1_->store_var(partial_var, identity);
+    auto lanes_minus_1{layer1_->binary_op(BO_ISUB, func_id, uint_id, lanes, layer1_->add_const(DT_UINT32, 1u))};
+    auto num_steps{layer1_->binary_op(BO_UDIV, func_id, uint_id,
+        layer1_->binary_op(BO_IADD, func_id, uint_id, N, lanes_minus_1), lanes)};
+    ForLoopDef col_loop{.i_boundary_id = num_steps};
+    layer2_->begin_for(col_loop);
+        auto col_i{layer1_->load_var(col_loop.i_type_id, col_loop.i_var_id)};
+        auto col{layer1_->binary_op(BO_IADD, func_id, uint_id,
+            layer1_->binary_op(BO_IMUL, func_id, uint_id, col_i, lanes), lane)};
+        IfDef col_in;
+        layer2_->begin_if(col_in, col, CO_LT, N);
+            auto index{layer1_->binary_op(BO_IADD, func_id, uint_id, row_begin, col)};
+            auto x{load_tensor_element_as(func_id, X, index, DT_FLOAT)};
+            if (map) {
+                x = map(x);
+            }
+            auto partial{layer1_->load_var(float_id, partial_var)};
+            layer1_->store_var(partial_var, combine(func_id, op, partial, x));
+        layer2_->end_if(col_in);
+    layer2_->end_for(col_loop);
+
+    return workgroup_reduce(func_id, op, layer1_->load_var(float_id, partial_var));
+}
+
+id_t Layer3::workgroup_reduce(id_t func_id, GroupOp op, id_t value_id)
+{
+    // Every invocation of the workgroup gets the result. Must be called from uniform
+    // control flow.
+    const auto uint_id{layer1_->add_dtype(DT_UINT32)};
+    const auto float_id{layer1_->add_dtype(DT_FLOAT)};
+    const auto float_ptr_id{layer1_->add_type_pointer(float_id, SC_WORKGROUP)};
+    const auto uint_zero{layer1_->add_const(DT_UINT32, 0u)};
+    const auto one{layer1_->add_const(DT_UINT32, 1u)};
+    const auto scratch{reduce_scratch_var()};
+    Scope exe_scope{SCOPE_WORKGROUP};
+    Scope mem_scope{SCOPE_WORKGROUP};
+    MemSemantic mem_semantics{MS_WORKGROUP_MEMORY | MS_ACQUIRE_RELEASE};
+
+    auto lane{layer1_->access_builtin(func_id, BI_LOCAL_INVOCATION_INDEX)};
+    auto lane_ptr{layer1_->access_chain(func_id, float_ptr_id, scratch, {lane})};
+    auto first_ptr{layer1_->access_chain(func_id, float_ptr_id, scratch, {uint_zero})};
+
+    id_t result{};
+    if (subgroup_ops_) {
+        // reduce within each subgroup, then fold the per-subgroup partials
+        auto subgroup_lane{layer1_->access_builtin(func_id, BI_SUBGROUP_LOCAL_INVOCATION_ID)};
+        auto subgroup_id{layer1_->access_builtin(func_id, BI_SUBGROUP_ID)};
+        auto num_subgroups{layer1_->access_builtin(func_id, BI_NUM_SUBGROUPS)};
+        auto subgroup_ptr{layer1_->access_chain(func_id, float_ptr_id, scratch, {subgroup_id})};
+        auto partial{layer1_->group_reduce(op, float_id, value_id)};
+        IfDef subgroup_first;
+        layer2_->begin_if(subgroup_first, subgroup_lane, CO_LT, one);
+            layer1_->store_var(subgroup_ptr, partial);
+        layer2_->end_if(subgroup_first);
+        layer1_->add_control_barrier(exe_scope, mem_scope, mem_semantics);
+
+        auto result_var{layer1_->add_var(float_id, SC_FUNCTION)};
+        layer1_->store_var(result_var, layer1_->load_var(float_id, first_ptr));
+        ForLoopDef fold_loop{.i_boundary_id = layer1_->binary_op(BO_ISUB, func_id, uint_id, num_subgroups, one)};
+        layer2_->begin_for(fold_loop);
+            auto i{layer1_->load_var(fold_loop.i_type_id, fold_loop.i_var_id)};
+            auto ptr{layer1_->access_chain(func_id, float_ptr_id, scratch,
+                {layer1_->binary_op(BO_IADD, func_id, uint_id, i, one)})};
+            auto acc{layer1_->load_var(float_id, result_var)};
+            layer1_->store_var(result_var, combine(func_id, op, acc, layer1_->load_var(float_id, ptr)));
+        layer2_->end_for(fold_loop);
+        result = layer1_->load_var(float_id, result_var);
+    } else {
+        // halve the active invocations each level, the local size is a power of two
+        const auto lanes{layer1_->spec_const_op(BO_IMUL, uint_id,
+            layer1_->spec_const_op(BO_IMUL, uint_id, layer1_->local_size_id(0), layer1_->local_size_id(1)),
+            layer1_->local_size_id(2))};
+        const auto two{layer1_->add_const(DT_UINT32, 2u)};
+        layer1_->store_var(lane_ptr, value_id);
+        layer1_->add_control_barrier(exe_scope, mem_scope, mem_semantics);
+
+        auto stride_var{layer1_->add_var(uint_id, SC_FUNCTION)};
+        layer1_->store_var(stride_var, layer1_->spec_const_op(BO_UDIV, uint_id, lanes, two));
+        ForLoopDef level_loop{.i_boundary_id = layer1_->std450()->find_umsb(func_id, lanes)};
+        layer2_->begin_for(level_loop);
+            auto stride{layer1_->load_var(uint_id, stride_var)};
+            IfDef active;
+            layer2_->begin_if(active, lane, CO_LT, stride);
+                auto other_ptr{layer1_->access_chain(func_id, float_ptr_id, scratch,
+                    {layer1_->binary_op(BO_IADD, func_id, uint_id, lane, stride)})};
+                auto mine{layer1_->load_var(float_id, lane_ptr)};
+                auto other{layer1_->load_var(float_id, other_ptr)};
+                layer1_->store_var(lane_ptr, combine(func_id, op, mine, other));
+            layer2_->end_if(active);
+            layer1_->add_control_barrier(exe_scope, mem_scope, mem_semantics);
+            layer1_->store_var(stride_var, layer1_->binary_op(BO_UDIV, func_id, uint_id, stride, two));
+        layer2_->end_for(level_loop);
+        result = layer1_->load_var(float_id, first_ptr);
+    }
+    // the scratch is reused by the next reduction
+    layer1_->add_control_barrier(exe_scope, mem_scope, mem_semantics);
+    return result;
+}
+
+void Layer3::load_reduce_builtins(id_t func_id)
+{
+    // Built-ins and scratch pointers do not change from row to row, load them once at
+    // the top instead of once per row.
+    const auto float_ptr_id{layer1_->add_type_pointer(layer1_->add_dtype(DT_FLOAT), SC_WORKGROUP)};
+    const auto scratch{reduce_scratch_var()};
+    auto lane{layer1_->access_builtin(func_id, BI_LOCAL_INVOCATION_INDEX)};
+    layer1_->access_chain(func_id, float_ptr_id, scratch, {lane});
+    layer1_->access_chain(func_id, float_ptr_id, scratch, {layer1_->add_const(DT_UINT32, 0u)});
+    if (subgroup_ops_) {
+        layer1_->access_builtin(func_id, BI_SUBGROUP_LOCAL_INVOCATION_ID);
+        layer1_->access_builtin(func_id, BI_NUM_SUBGROUPS);
+        auto subgroup_id{layer1_->access_builtin(func_id, BI_SUBGROUP_ID)};
+        layer1_->access_chain(func_id, float_ptr_id, scratch, {subgroup_id});
+    }
+}
+
+id_t Layer3::reduce_scratch_var()
+{
+    if (reduce_scratch_id_ != 0) {
+        return reduce_scratch_id_;
+    }
+    if (parent_ != nullptr) {
+        auto parent{parent_};
+        reduce_scratch_id_ = layer1_->defer([parent] (Layer1&, const IdResolver&) {
+            return parent->reduce_scratch_var();
+        });
+        return reduce_scratch_id_;
+    }
+
+    if (!subgroup_ops_) {
+        const auto num_lanes{layer1_->local_size_x() * layer1_->local_size_y() * layer1_->local_size_z()};
+        assert((num_lanes & (num_lanes - 1)) == 0 && "Reduction tree needs a power of two local size");
+    }
+    // sized by the specialized local size, the subgroup path only uses NumSubgroups of it
+    const auto uint_id{layer1_->add_dtype(DT_UINT32)};
+    const auto lanes{layer1_->spec_const_op(BO_IMUL, uint_id,
+        layer1_->spec_const_op(BO_IMUL, uint_id, layer1_->local_size_id(0), layer1_->local_size_id(1)),
+        layer1_->local_size_id(2))};
+    const auto scratch_type_id{layer1_->add_spec_array_dtype(layer1_->add_dtype(DT_FLOAT), lanes, SC_WORKGROUP)};
+    reduce_scratch_id_ = layer1_->add_var(scratch_type_id, SC_WORKGROUP);
+    layer1_->push_entry_listed_id(reduce_scratch_id_);
+    return reduce_scratch_id_;
+}
+
+id_t Layer3::combine(id_t func_id, GroupOp op, id_t op1_id, id_t op2_id)
+{
+    switch (op) {
+    case GO_FADD:   return layer1_->binary_op(BO_FADD, func_id, layer1_->add_dtype(DT_FLOAT), op1_id, op2_id);
+    case GO_FMAX:   return layer1_->std450()->max(DT_FLOAT, func_id, op1_id, op2_id);
+    default:        assert(false && "Not implemented");
+    }
+
+    return 0; // unreachable, return something to suppress compiler warning
+}
@@ -1,65 +1,204 @@
 #include "yaccs/code_gen/code_gen.hpp"
 #include "yaccs/baker/def.hpp"
 #include "yaccs/baker/layer1/utils.hpp"
+#include "yaccs/code_gen/spv.hpp"
 #include "yaccs/dtype.hpp"
 #include <cassert>
+#include <cctype>
 #include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <string>
 
 
-CodeGen::CodeGen() {}
+CodeGen::CodeGen(id_t first_id)
+    : first_id_(first_id)
+    , next_id_(first_id)
+{
+    assert(first_id > 0 && "Id 0 is invalid");
+    this_fn_.clear();
+}
+
+id_t CodeGen::alloc_id()
+{
+    assert(next_id_ < std::numeric_limits<id_t>::max() && "Out of ids");
+    return next_id_++;
+}
 
 void CodeGen::assemble(std::ofstream& ofs)
 {
     ofs << header_ss_.str();
     ofs << ext_import_ss_.str();
     ofs << entry_def_ss_.str();
+    ofs << execution_mode_ss_.str();
     ofs << decorate_ss_.str();
     ofs << type_const_def_ss_.str();
     ofs << fn_def_ss_.str();
 }
 
+void CodeGen::assemble(std::vector<uint32_t>& words)
+{
+    words.clear();
+    words.reserve(SPV_HEADER_WORDS + header_words_.size() + ext_import_words_.size()
+        + entry_def_words_.size() + execution_mode_words_.size() + decorate_words_.size() + type_const_def_words_.size()
+        + fn_def_words_.size());
+
+    words.push_back(SPV_MAGIC_NUMBER);
+    words.push_back(SPV_VERSION_1_6);
+    words.push_back(SPV_GENERATOR);
+    words.push_back(next_id_);
+    words.push_back(0); // schema
+
+    words.insert(words.end(), header_words_.begin(), header_words_.end());
+    words.insert(words.end(), ext_import_words_.begin(), ext_import_words_.end());
+    words.insert(words.end(), entry_def_words_.begin(), entry_def_words_.end());
+    words.insert(words.end(), execution_mode_words_.begin(), execution_mode_words_.end());
+    words.insert(words.end(), decorate_words_.begin(), decorate_words_.end());
+    words.insert(words.end(), type_const_def_words_.begin(), type_const_def_words_.end());
+    words.insert(words.end(), fn_def_words_.begin(), fn_def_words_.end());
+}
+
+std::vector<std::pair<const char*, size_t>> CodeGen::section_bytes() const
+{
+    return {
+        {"header", (SPV_HEADER_WORDS + header_words_.size()) * sizeof(uint32_t)},
+        {"ext_import", ext_import_words_.size() * sizeof(uint32_t)},
+        {"entry_def", entry_def_words_.size() * sizeof(uint32_t)},
+        {"execution_mode", execution_mode_words_.size() * sizeof(uint32_t)},
+        {"decorate", decorate_words_.size() * sizeof(uint32_t)},
+        {"type_const_def", type_const_def_words_.size() * sizeof(uint32_t)},
+        {"fn_def", fn_def_words_.size() * sizeof(uint32_t)},
+    };
+}
+
+void CodeGen::append_functions(const CodeGen& other, const std::function<id_t(id_t)>& resolve)
+{
+    // Operands of function instructions are ids or small literals, function control,
+    // loop control, extended instruction numbers and the like, so every operand at or
+    // above the first id of other is one of its ids.
+    const auto& ss{other.fn_def_ss_.str()};
+    for (size_t i = 0; i < ss.size();) {
+        const auto end{ss.find('%', i)};
+        fn_def_ss_.write(ss.data() + i, (end == std::string::npos ? ss.size() : end + 1) - i);
+        if (end == std::string::npos) {
+            break;
+        }
+        i = end + 1;
+        if (i < ss.size() && isdigit(static_cast<unsigned char>(ss.at(i)))) {
+            char* digits_end{};
+            const auto id{strtoull(ss.c_str() + i, &digits_end, 10)};
+            fn_def_ss_ << (id >= other.first_id_ ? resolve(static_cast<id_t>(id)) : id);
+            i = digits_end - ss.c_str();
+        }
+    }
+
+    const auto& words{other.fn_def_words_};
+    fn_def_words_.reserve(fn_def_words_.size() + words.size());
+    for (size_t i = 0; i < words.size();) {
+        const auto word_count{words.at(i) >> 16};
+        assert(word_count > 0 && i + word_count <= words.size() && "Bad instruction");
+        fn_def_words_.push_back(words.at(i));
+        for (size_t k = i + 1; k < i + word_count; ++k) {
+            fn_def_words_.push_back(words.at(k) >= other.first_id_ ? resolve(words.at(k)) : words.at(k));
+        }
+        i += word_count;
+    }
+}
+
 void CodeGen::push_header()
 {
-    header_ss_ << "OpCapability Shader\n";
+    push_capability(CAP_SHADER);
+}
+
+void CodeGen::push_capability(Capability cap)
+{
+    // the header section holds capabilities only, so they may be added at any time
+    header_ss_ << "OpCapability " << as_string(cap) << "\n";
+    SpvInst(header_words_, OP_CAPABILITY).word(cap).end();
 }
 
 void CodeGen::push_ext_import(const ExtImportDef& eid)
 {
     ext_import_ss_ << "%" << eid.id << " = OpExtInstImport \"" << eid.ext_name << "\"\n";
+    SpvInst(ext_import_words_, OP_EXT_INST_IMPORT).word(eid.id).string(eid.ext_name).end();
 }
 
 void CodeGen::push_entry(const EntryDef& ed)
 {
-    entry_def_ss_ << "OpMemoryModel Logical GLSL450\n";
-    entry_def_ss_ << "OpEntryPoint GLCompute %" << ed.main_id << " \"main\"";
+    // A module may have several entry points but only one memory model, and all
+    // OpEntryPoint precede the OpExecutionMode instructions
+    const bool first_entry{entry_def_words_.empty()};
+    if (first_entry) {
+        entry_def_ss_ << "OpMemoryModel Logical GLSL450\n";
+    }
+    entry_def_ss_ << "OpEntryPoint GLCompute %" << ed.main_id << " \"" << ed.name << "\"";
     for (auto it: ed.input_ids) {
         entry_def_ss_ << " %" << it;
     }
     entry_def_ss_ << "\n";
 
-    entry_def_ss_ << "OpExecutionMode %" << ed.main_id << " LocalSize "
-        << ed.local_size_x << " " << ed.local_size_y << " " << ed.local_size_z << "\n";
+    execution_mode_ss_ << "OpExecutionModeId %" << ed.main_id << " LocalSizeId %"
+        << ed.local_size_x_id << " %" << ed.local_size_y_id << " %" << ed.local_size_z_id << "\n";
+
+    if (first_entry) {
+        SpvInst(entry_def_words_, OP_MEMORY_MODEL).word(SPV_ADDRESSING_LOGICAL).word(SPV_MEMORY_MODEL_GLSL450).end();
+    }
+    SpvInst(entry_def_words_, OP_ENTRY_POINT).word(SPV_EXECUTION_MODEL_GLCOMPUTE).word(ed.main_id)
+        .string(ed.name).words(ed.input_ids).end();
+    SpvInst(execution_mode_words_, OP_EXECUTION_MODE_ID).word(ed.main_id).word(SPV_EXECUTION_MODE_LOCAL_SIZE_ID)
+        .word(ed.local_size_x_id).word(ed.local_size_y_id).word(ed.local_size_z_id).end();
 }
 
 void CodeGen::push_struct_decorate(const DecorateStructDef& dsd)
 {
     if (dsd.deco != DECO_NONE) {
         decorate_ss_ <<  "OpDecorate %" << dsd.struct_type_id << " " << as_string(dsd.deco) << "\n";
+        SpvInst(decorate_words_, OP_DECORATE).word(dsd.struct_type_id).word(as_spv(dsd.deco)).end();
     }
 
     for (const auto& it : dsd.member_deco) {
         decorate_ss_ << "OpMemberDecorate %" << dsd.struct_type_id << " " << it.field << " Offset " << it.offset << "\n";
+        SpvInst(decorate_words_, OP_MEMBER_DECORATE).word(dsd.struct_type_id).word(it.field)
+            .word(SPV_DECORATION_OFFSET).word(it.offset).end();
     }
 }
 
+void CodeGen::push_decorate(const DecorateDef& dd)
+{
+    decorate_ss_ << "OpDecorate %" << dd.target << " " << as_string(dd.deco) << "\n";
+    SpvInst(decorate_words_, OP_DECORATE).word(dd.target).word(as_spv(dd.deco)).end();
+}
+
+void CodeGen::push_spec_const(const SpecConstDef& scd)
+{
+    type_const_def_ss_ << "%" << scd.id << " = OpSpecConstant %" << scd.dtype_id << " " << scd.value << "\n";
+    decorate_ss_ << "OpDecorate %" << scd.id << " SpecId " << scd.spec_id << "\n";
+
+    SpvInst(type_const_def_words_, OP_SPEC_CONSTANT).word(scd.dtype_id).word(scd.id).word(scd.value).end();
+    SpvInst(decorate_words_, OP_DECORATE).word(scd.id).word(as_spv(DECO_SPECID)).word(scd.spec_id).end();
+}
+
+void CodeGen::push_spec_const_op(const SpecConstOpDef& scod)
+{
+    // the operation is spelled without the "Op" prefix in the assembly
+    type_const_def_ss_ << "%" << scod.result_id << " = OpSpecConstantOp %" << scod.type_id << " "
+        << as_string(scod.bo).substr(2) << " %" << scod.op1_id << " %" << scod.op2_id << "\n";
+
+    SpvInst(type_const_def_words_, OP_SPEC_CONSTANT_OP).word(scod.type_id).word(scod.result_id)
+        .word(as_opcode(scod.bo)).word(scod.op1_id).word(scod.op2_id).end();
+}
+
 void CodeGen::push_array_decorate(const DecorateArrayDef& dad)
 {
-    decorate_ss_ << "OpDecorate %" << dad.array_type_id << " ArrayStride 4\n";
+    decorate_ss_ << "OpDecorate %" << dad.array_type_id << " ArrayStride " << dad.stride << "\n";
+    SpvInst(decorate_words_, OP_DECORATE).word(dad.array_type_id).word(SPV_DECORATION_ARRAY_STRIDE).word(dad.stride).end();
 }
 
 void CodeGen::push_builtin_decorate(const DecorateBuiltInDef& built_in)
 {
     decorate_ss_ << "OpDecorate %" << built_in.var_id << " BuiltIn " << as_string(built_in.built_in) << "\n";
+    SpvInst(decorate_words_, OP_DECORATE).word(built_in.var_id).word(SPV_DECORATION_BUILTIN)
+        .word(built_in.built_in).end();
 }
 
 void CodeGen::push_dtype(DType dt, id_t id)
@@ -67,18 +206,23 @@ void CodeGen::push_dtype(DType dt, id_t id)
     switch (dt) {
     case DT_FLOAT:
         type_const_def_ss_ << "%" << id << " = OpTypeFloat 32\n";
+        SpvInst(type_const_def_words_, OP_TYPE_FLOAT).word(id).word(32).end();
         break;
     case DT_FLOAT16:
         type_const_def_ss_ << "%" << id << " = OpTypeFloat 16\n";
+        SpvInst(type_const_def_words_, OP_TYPE_FLOAT).word(id).word(16).end();
         break;
     case DT_INT32:
         type_const_def_ss_ << "%" << id << " = OpTypeInt 32 1\n";
+        SpvInst(type_const_def_words_, OP_TYPE_INT).word(id).word(32).word(1).end();
         break;
     case DT_UINT32:
         type_const_def_ss_ << "%" << id << " = OpTypeInt 32 0\n";
+        SpvInst(type_const_def_words_, OP_TYPE_INT).word(id).word(32).word(0).end();
         break;
     case DT_BOOL:
         type_const_def_ss_ << "%" << id << " = OpTypeBool\n";
+        SpvInst(type_const_def_words_, OP_TYPE_BOOL).word(id).end();
         break;
     default: assert(false && "Unsupported type");
     }
@@ -87,6 +231,13 @@ void CodeGen::push_dtype(DType dt, id_t id)
 void CodeGen::push_array_dtype(const ArrTypeDef& arr)
 {
     type_const_def_ss_ << "%" << arr.id << " = OpTypeArray %" << arr.dtype << " %" << arr.length_id << "\n";
+    SpvInst(type_const_def_words_, OP_TYPE_ARRAY).word(arr.id).word(arr.dtype).word(arr.length_id).end();
+}
+
+void CodeGen::push_runtime_array_dtype(const RuntimeArrTypeDef& arr)
+{
+    type_const_def_ss_ << "%" << arr.id << " = OpTypeRuntimeArray %" << arr.dtype << "\n";
+    SpvInst(type_const_def_words_, OP_TYPE_RUNTIME_ARRAY).word(arr.id).word(arr.dtype).end();
 }
 
 void CodeGen::push_struct_dtype(const StructTypeDef& sd)
@@ -97,16 +248,20 @@ void CodeGen::push_struct_dtype(const StructTypeDef& sd)
         if (i != sd.num_fields - 1) type_const_def_ss_ << " ";
     }
     type_const_def_ss_ << "\n";
+
+    SpvInst(type_const_def_words_, OP_TYPE_STRUCT).word(sd.id).words(sd.fields).end();
 }
 
 void CodeGen::push_void_type(id_t id)
 {
     type_const_def_ss_ << "%" << id << " = OpTypeVoid\n";
+    SpvInst(type_const_def_words_, OP_TYPE_VOID).word(id).end();
 }
 
 void CodeGen::push_function_type(const FunctionTypeDef& ft)
 {
     type_const_def_ss_ << "%" << ft.id << " = OpTypeFunction %" << ft.return_type_id << "\n";
+    SpvInst(type_const_def_words_, OP_TYPE_FUNCTION).word(ft.id).word(ft.return_type_id).end();
 }
 
 void CodeGen::push_const_composite(const ConstCompositeDef& ccd)
@@ -116,12 +271,15 @@ void CodeGen::push_const_composite(const ConstCompositeDef& ccd)
         type_const_def_ss_ << " %" << it;
     }
     type_const_def_ss_ << "\n";
+
+    SpvInst(type_const_def_words_, OP_CONSTANT_COMPOSITE).word(ccd.type_id).word(ccd.id).words(ccd.elem_ids).end();
 }
 
 void CodeGen::push_type_pointer(const TypePointerDef& tp)
 {
     type_const_def_ss_ << "%" << tp.id << " = OpTypePointer "
         << as_string(tp.storage_class) << " %" << tp.type_id << "\n";
+    SpvInst(type_const_def_words_, OP_TYPE_POINTER).word(tp.id).word(as_spv(tp.storage_class)).word(tp.type_id).end();
 }
 
 void CodeGen::push_variable(const VarDef& var)
@@ -137,6 +295,14 @@ void CodeGen::push_variable(const VarDef& var)
     } else {
         ss << " %" << var.initializer_id << "\n";
     }
+
+    auto& words{var.storage_class == SC_FUNCTION ? this_fn_.var_def_words : type_const_def_words_};
+    SpvInst inst{words, OP_VARIABLE};
+    inst.word(var.type_pointer_id).word(var.id).word(as_spv(var.storage_class));
+    if (var.initializer_id != 0) {
+        inst.word(var.initializer_id);
+    }
+    inst.end();
 }
 
 void CodeGen::push_decorate_set_binding(const DecorateSetBindingDef& deco)
@@ -144,9 +310,12 @@ void CodeGen::push_decorate_set_binding(const DecorateSetBindingDef& deco)
     assert(deco.binding >= 0 && deco.set >= 0 && "Bad decoration");
     decorate_ss_ << "OpDecorate %" << deco.target << " DescriptorSet " << deco.set << "\n";
     decorate_ss_ << "OpDecorate %" << deco.target << " Binding " << deco.binding << "\n";
+    SpvInst(decorate_words_, OP_DECORATE).word(deco.target).word(SPV_DECORATION_DESCRIPTOR_SET).word(deco.set).end();
+    SpvInst(decorate_words_, OP_DECORATE).word(deco.target).word(SPV_DECORATION_BINDING).word(deco.binding).end();
 }
 
 void CodeGen::push_vector_dtype(const VectorDef& vd)
 {
     type_const_def_ss_ << "%" << vd.id << " = OpTypeVector %" << vd.component_type_id << " " << vd.count << "\n";
+    SpvInst(type_const_def_words_, OP_TYPE_VECTOR).word(vd.id).word(vd.component_type_id).word(vd.count).end();
 }
@@ -5,24 +5,42 @@
 #include "yaccs/baker/layer1/def.hpp"
 #include "yaccs/baker/layer2/def.hpp"
 #include "yaccs/baker/def.hpp"
+#include "yaccs/code_gen/spv.hpp"
 #include "yaccs/dtype.hpp"
+#include <cstdint>
 #include <fstream>
+#include <functional>
 #include <sstream>
+#include <utility>
+#include <vector>
 
 struct CodeGen
 {
-    CodeGen();
+    // ids of the module are allocated counting up from first_id
+    explicit CodeGen(id_t first_id=1);
+    id_t alloc_id();
+    id_t id_bound() const { return next_id_; }  // all allocated ids are less than the bound
     void assemble(std::ofstream& ofs);
+    void assemble(std::vector<uint32_t>& words);
+    // binary size in bytes of every module section, in output order
+    std::vector<std::pair<const char*, size_t>> section_bytes() const;
+    // append the functions of other, its own ids are renamed through resolve
+    void append_functions(const CodeGen& other, const std::function<id_t(id_t)>& resolve);
 
     void push_header();
+    void push_capability(Capability cap);
     void push_ext_import(const ExtImportDef& eid);
     void push_entry(const EntryDef& ed);
     void push_struct_decorate(const DecorateStructDef& dsd);
+    void push_decorate(const DecorateDef& dd);
+    void push_spec_const(const SpecConstDef& scd);
+    void push_spec_const_op(const SpecConstOpDef& scod);
     void push_array_decorate(const DecorateArrayDef& dad);
     void push_builtin_decorate(const DecorateBuiltInDef& built_in);
     void push_decorate_set_binding(const DecorateSetBindingDef& deco);
     void push_dtype(DType dt, id_t id);
     void push_array_dtype(const ArrTypeDef& arr);
+    void push_runtime_array_dtype(const RuntimeArrTypeDef& arr);
     void push_struct_dtype(const StructTypeDef& sd);
     void push_void_type(id_t id);
     void push_const_composite(const ConstCompositeDef& ccd);
@@ -41,6 +59,13 @@ struct CodeGen
     void push_control_barrier(const ControlBarrierDef& cbd);
     void push_function_call(const FunctionCallDef& fcd);
     void push_binary_operation(const BinaryOpDef& bod);
+    void push_compare(const CompareDef& cd);
+    void push_select(const SelectDef& sd);
+    void push_convert(const ConvertDef& cd);
+    void push_bit_field_extract(const BitFieldExtractDef& bfed);
+    void push_group_reduce(const GroupReduceDef& grd);
+    void push_composite_construct(const CompositeConstructDef& ccd);
+    void push_composite_extract(const CompositeExtractDef& ced);
     void push_load(const LoadDef& ld);
     void push_store(const StoreDef& sd);
     void push_access_chain(const AccessChainDef& acd);
@@ -50,6 +75,7 @@ struct CodeGen
     void push_snippet_end_for(const ForLoopDef& for_def);
 
     // for ext
+    void push_ext_unary_opration(const ext::UnaryOpDef& uod);
     void push_ext_binary_opration(const ext::BinaryOpDef& bod);
 private:
     struct FnCodeGen {
@@ -57,23 +83,45 @@ private:
         std::stringstream var_def_ss;
         std::stringstream body_ss;
         std::stringstream epilogue_ss;
+        std::vector<uint32_t> prologue_words;
+        std::vector<uint32_t> var_def_words;
+        std::vector<uint32_t> body_words;
+        std::vector<uint32_t> epilogue_words;
+        bool block_returned;    // current block is already terminated by OpReturn
         void clear();
     }; // struct FnCodeGen
 
     std::stringstream header_ss_;
     std::stringstream ext_import_ss_;
     std::stringstream entry_def_ss_;
+    std::stringstream execution_mode_ss_;
     std::stringstream decorate_ss_;
     std::stringstream type_const_def_ss_;
 
     std::stringstream fn_def_ss_;
+
+    std::vector<uint32_t> header_words_;
+    std::vector<uint32_t> ext_import_words_;
+    std::vector<uint32_t> entry_def_words_;
+    std::vector<uint32_t> execution_mode_words_;
+    std::vector<uint32_t> decorate_words_;
+    std::vector<uint32_t> type_const_def_words_;
+    std::vector<uint32_t> fn_def_words_;
+
     FnCodeGen this_fn_;
+    id_t first_id_;
+    id_t next_id_;
 }; // class CodeGen
 
 template<typename T>
 void CodeGen::push_const_dtype(const DTypeConstDef<T>& dconst)
 {
     type_const_def_ss_ << "%" << dconst.id << " = OpConstant %" << dconst.dtype_id << " " << dconst.value << "\n";
+
+    SpvInst inst{type_const_def_words_, OP_CONSTANT};
+    inst.word(dconst.dtype_id).word(dconst.id);
+    push_literal(inst, dconst.dtype, dconst.value);
+    inst.end();
 }
 
 #endif // YACCS_CODE_GEN_H_
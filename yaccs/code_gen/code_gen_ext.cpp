@@ -1,9 +1,20 @@
 #include "yaccs/code_gen/code_gen.hpp"
 #include "yaccs/baker/layer1/exts/utils.hpp"
+#include "yaccs/code_gen/spv.hpp"
 #include <cassert>
 
+void CodeGen::push_ext_unary_opration(const ext::UnaryOpDef& uod)
+{
+    this_fn_.body_ss << "\t%" << uod.result_id << " = OpExtInst %" << uod.type_id << " %" << uod.ext_id << " "
+        << as_string(uod.uo) << " %" << uod.op_id << "\n";
+    SpvInst(this_fn_.body_words, OP_EXT_INST).word(uod.type_id).word(uod.result_id).word(uod.ext_id)
+        .word(ext::as_inst(uod.uo)).word(uod.op_id).end();
+}
+
 void CodeGen::push_ext_binary_opration(const ext::BinaryOpDef& bod)
 {
     this_fn_.body_ss << "\t%" << bod.result_id << " = OpExtInst %" << bod.type_id << " %" << bod.ext_id << " "
         << as_string(bod.bo) << " %" << bod.op1_id << " %" << bod.op2_id << "\n";
+    SpvInst(this_fn_.body_words, OP_EXT_INST).word(bod.type_id).word(bod.result_id).word(bod.ext_id)
+        .word(ext::as_inst(bod.bo)).word(bod.op1_id).word(bod.op2_id).end();
 }
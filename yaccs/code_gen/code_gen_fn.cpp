@@ -1,7 +1,7 @@
 #include "yaccs/code_gen/code_gen.hpp"
 #include "yaccs/baker/def.hpp"
 #include "yaccs/baker/layer1/utils.hpp"
-#include "yaccs/baker/utils.hpp"
+#include "yaccs/code_gen/spv.hpp"
 #include <cassert>
 
 void CodeGen::push_function(const FunctionHeaderDef& fh)
@@ -10,55 +10,134 @@ void CodeGen::push_function(const FunctionHeaderDef& fh)
     this_fn_.prologue_ss << "%" << fh.id << " = OpFunction " << "%" << fh.return_type_id
         << " None %" << fh.function_type_id << "\n";
     this_fn_.prologue_ss << "\t%" << fh.open_label_id << " = OpLabel\n";
+
+    SpvInst(this_fn_.prologue_words, OP_FUNCTION).word(fh.return_type_id).word(fh.id)
+        .word(SPV_FUNCTION_CONTROL_NONE).word(fh.function_type_id).end();
+    SpvInst(this_fn_.prologue_words, OP_LABEL).word(fh.open_label_id).end();
 }
 
 void CodeGen::push_function_end()
 {
     this_fn_.epilogue_ss << "\t\tOpReturn\n";
     this_fn_.epilogue_ss << "\t\tOpFunctionEnd\n";
+    SpvInst(this_fn_.epilogue_words, OP_RETURN).end();
+    SpvInst(this_fn_.epilogue_words, OP_FUNCTION_END).end();
 
     fn_def_ss_ << this_fn_.prologue_ss.str();
     fn_def_ss_ << this_fn_.var_def_ss.str();
     fn_def_ss_ << this_fn_.body_ss.str();
     fn_def_ss_ << this_fn_.epilogue_ss.str();
+
+    fn_def_words_.insert(fn_def_words_.end(), this_fn_.prologue_words.begin(), this_fn_.prologue_words.end());
+    fn_def_words_.insert(fn_def_words_.end(), this_fn_.var_def_words.begin(), this_fn_.var_def_words.end());
+    fn_def_words_.insert(fn_def_words_.end(), this_fn_.body_words.begin(), this_fn_.body_words.end());
+    fn_def_words_.insert(fn_def_words_.end(), this_fn_.epilogue_words.begin(), this_fn_.epilogue_words.end());
     this_fn_.clear();
 }
 
 void CodeGen::push_return()
 {
     this_fn_.body_ss << "\t\tOpReturn\n";
+    SpvInst(this_fn_.body_words, OP_RETURN).end();
+    this_fn_.block_returned = true;
 }
 
 void CodeGen::push_label(id_t id)
 {
     this_fn_.body_ss << "\t%" << id << " = OpLabel\n";
+    SpvInst(this_fn_.body_words, OP_LABEL).word(id).end();
 }
 
 void CodeGen::push_function_call(const FunctionCallDef& fcd)
 {
     this_fn_.body_ss << "\t%" << fcd.id << " = OpFunctionCall %" << fcd.return_type_id << " %" << fcd.func_id << "\n";
+    SpvInst(this_fn_.body_words, OP_FUNCTION_CALL).word(fcd.return_type_id).word(fcd.id).word(fcd.func_id).end();
 }
 
 void CodeGen::push_control_barrier(const ControlBarrierDef& cbd)
 {
     this_fn_.body_ss << "\t\tOpControlBarrier %"
         << cbd.exe_scope_id << " %" << cbd.mem_scope_id << " %" << cbd.mem_semantics_id << "\n";
+    SpvInst(this_fn_.body_words, OP_CONTROL_BARRIER).word(cbd.exe_scope_id).word(cbd.mem_scope_id)
+        .word(cbd.mem_semantics_id).end();
 }
 
 void CodeGen::push_binary_operation(const BinaryOpDef& bod)
 {
     this_fn_.body_ss << "\t%" << bod.result_id << " = " << as_string(bod.bo) << " %" << bod.type_id
         << " %" << bod.op1_id << " %" << bod.op2_id << "\n";
+    SpvInst(this_fn_.body_words, as_opcode(bod.bo)).word(bod.type_id).word(bod.result_id)
+        .word(bod.op1_id).word(bod.op2_id).end();
+}
+
+void CodeGen::push_compare(const CompareDef& cd)
+{
+    this_fn_.body_ss << "\t%" << cd.result_id << " = " << as_string(cd.cmp_op) << " %" << cd.bool_type_id
+        << " %" << cd.op1_id << " %" << cd.op2_id << "\n";
+    SpvInst(this_fn_.body_words, as_opcode(cd.cmp_op)).word(cd.bool_type_id).word(cd.result_id)
+        .word(cd.op1_id).word(cd.op2_id).end();
+}
+
+void CodeGen::push_select(const SelectDef& sd)
+{
+    this_fn_.body_ss << "\t%" << sd.result_id << " = OpSelect %" << sd.type_id << " %" << sd.cond_id
+        << " %" << sd.obj1_id << " %" << sd.obj2_id << "\n";
+    SpvInst(this_fn_.body_words, OP_SELECT).word(sd.type_id).word(sd.result_id).word(sd.cond_id)
+        .word(sd.obj1_id).word(sd.obj2_id).end();
+}
+
+void CodeGen::push_convert(const ConvertDef& cd)
+{
+    this_fn_.body_ss << "\t%" << cd.result_id << " = " << as_string(cd.op) << " %" << cd.type_id
+        << " %" << cd.value_id << "\n";
+    SpvInst(this_fn_.body_words, as_opcode(cd.op)).word(cd.type_id).word(cd.result_id).word(cd.value_id).end();
+}
+
+void CodeGen::push_bit_field_extract(const BitFieldExtractDef& bfed)
+{
+    this_fn_.body_ss << "\t%" << bfed.result_id << " = " << (bfed.sign_extend ? "OpBitFieldSExtract" : "OpBitFieldUExtract")
+        << " %" << bfed.type_id << " %" << bfed.base_id << " %" << bfed.offset_id << " %" << bfed.count_id << "\n";
+    SpvInst(this_fn_.body_words, bfed.sign_extend ? OP_BIT_FIELD_S_EXTRACT : OP_BIT_FIELD_U_EXTRACT).word(bfed.type_id)
+        .word(bfed.result_id).word(bfed.base_id).word(bfed.offset_id).word(bfed.count_id).end();
+}
+
+void CodeGen::push_group_reduce(const GroupReduceDef& grd)
+{
+    this_fn_.body_ss << "\t%" << grd.result_id << " = " << as_string(grd.op) << " %" << grd.type_id
+        << " %" << grd.scope_id << " Reduce %" << grd.value_id << "\n";
+    SpvInst(this_fn_.body_words, as_opcode(grd.op)).word(grd.type_id).word(grd.result_id).word(grd.scope_id)
+        .word(SPV_GROUP_OPERATION_REDUCE).word(grd.value_id).end();
+}
+
+void CodeGen::push_composite_construct(const CompositeConstructDef& ccd)
+{
+    this_fn_.body_ss << "\t%" << ccd.result_id << " = OpCompositeConstruct %" << ccd.type_id;
+    for (auto it : ccd.constituent_ids) {
+        this_fn_.body_ss << " %" << it;
+    }
+    this_fn_.body_ss << "\n";
+    SpvInst(this_fn_.body_words, OP_COMPOSITE_CONSTRUCT).word(ccd.type_id).word(ccd.result_id)
+        .words(ccd.constituent_ids).end();
+}
+
+void CodeGen::push_composite_extract(const CompositeExtractDef& ced)
+{
+    this_fn_.body_ss << "\t%" << ced.result_id << " = OpCompositeExtract %" << ced.type_id
+        << " %" << ced.composite_id << " " << ced.index << "\n";
+    SpvInst(this_fn_.body_words, OP_COMPOSITE_EXTRACT).word(ced.type_id).word(ced.result_id)
+        .word(ced.composite_id).word(ced.index).end();
 }
 
 void CodeGen::push_load(const LoadDef& ld)
 {
     this_fn_.body_ss << "\t%" << ld.id << " = OpLoad %" << ld.type_id << " %" << ld.pointer << "\n";
+    SpvInst(this_fn_.body_words, OP_LOAD).word(ld.type_id).word(ld.id).word(ld.pointer).end();
 }
 
 void CodeGen::push_store(const StoreDef& sd)
 {
     this_fn_.body_ss << "\t\tOpStore %" << sd.pointer << " %" << sd.object << "\n";
+    SpvInst(this_fn_.body_words, OP_STORE).word(sd.pointer).word(sd.object).end();
 }
 
 void CodeGen::push_access_chain(const AccessChainDef& acd)
@@ -68,23 +147,40 @@ void CodeGen::push_access_chain(const AccessChainDef& acd)
         this_fn_.body_ss << " %" << it;
     }
     this_fn_.body_ss << "\n";
+
+    SpvInst(this_fn_.body_words, OP_ACCESS_CHAIN).word(acd.type_id).word(acd.id).word(acd.base_id)
+        .words(acd.index_ids).end();
 }
 
 void CodeGen::push_snippet_begin_if(const IfDef& def)
 {
     auto condition_id{alloc_id()};
 
-    this_fn_.body_ss << "\t%" << condition_id << " = OpUGreaterThan %" << def.bool_type_id
+    this_fn_.body_ss << "\t%" << condition_id << " = " << as_string(def.cmp_op) << " %" << def.bool_type_id
         << " %" << def.cmp_op1_id << " %" << def.cmp_op2_id << "\n";
     this_fn_.body_ss << "\t\tOpSelectionMerge %" << def.next_label_id << " None\n";
     this_fn_.body_ss << "\t\tOpBranchConditional %" << condition_id << " %"
         << def.body_label_id << " %" << def.next_label_id << "\n";
     this_fn_.body_ss << "\t%" << def.body_label_id << " = OpLabel\n";
+
+    auto& words{this_fn_.body_words};
+    SpvInst(words, as_opcode(def.cmp_op)).word(def.bool_type_id).word(condition_id)
+        .word(def.cmp_op1_id).word(def.cmp_op2_id).end();
+    SpvInst(words, OP_SELECTION_MERGE).word(def.next_label_id).word(SPV_SELECTION_CONTROL_NONE).end();
+    SpvInst(words, OP_BRANCH_CONDITIONAL).word(condition_id).word(def.body_label_id).word(def.next_label_id).end();
+    SpvInst(words, OP_LABEL).word(def.body_label_id).end();
 }
 
 void CodeGen::push_snippet_end_if(const IfDef& def)
 {
+    if (!this_fn_.block_returned) {
+        this_fn_.body_ss << "\t\tOpBranch %" << def.next_label_id << "\n";
+        SpvInst(this_fn_.body_words, OP_BRANCH).word(def.next_label_id).end();
+    }
+    this_fn_.block_returned = false;
+
     this_fn_.body_ss << "\t%" << def.next_label_id << " = OpLabel\n";
+    SpvInst(this_fn_.body_words, OP_LABEL).word(def.next_label_id).end();
 }
 
 void CodeGen::push_snippet_begin_for(const ForLoopDef& for_def)
@@ -102,6 +198,20 @@ void CodeGen::push_snippet_begin_for(const ForLoopDef& for_def)
         << " %" << for_def.bool_type_id << " %" << i_id << " %" << for_def.i_boundary_id << "\n";
     this_fn_.body_ss << "\t\tOpBranchConditional %" << for_def.cmp_id << " %" << for_def.loop_body_label_id << " %" << for_def.loop_exit_label_id << "\n";
     this_fn_.body_ss << "\t%" << for_def.loop_body_label_id << " = OpLabel\n";
+
+    auto& words{this_fn_.body_words};
+    SpvInst(words, OP_BRANCH).word(for_def.init_label_id).end();
+    SpvInst(words, OP_LABEL).word(for_def.init_label_id).end();
+    SpvInst(words, OP_LOOP_MERGE).word(for_def.loop_exit_label_id).word(for_def.i_inc_label_id)
+        .word(SPV_LOOP_CONTROL_NONE).end();
+    SpvInst(words, OP_BRANCH).word(for_def.cond_label_id).end();
+    SpvInst(words, OP_LABEL).word(for_def.cond_label_id).end();
+    SpvInst(words, OP_LOAD).word(for_def.i_type_id).word(i_id).word(for_def.i_var_id).end();
+    SpvInst(words, as_opcode(for_def.cmp_op)).word(for_def.bool_type_id).word(for_def.cmp_id)
+        .word(i_id).word(for_def.i_boundary_id).end();
+    SpvInst(words, OP_BRANCH_CONDITIONAL).word(for_def.cmp_id).word(for_def.loop_body_label_id)
+        .word(for_def.loop_exit_label_id).end();
+    SpvInst(words, OP_LABEL).word(for_def.loop_body_label_id).end();
 }
 
 
@@ -115,8 +225,30 @@ void CodeGen::push_snippet_end_for(const ForLoopDef& for_def)
     this_fn_.body_ss << "\t%" << i_id << " = OpLoad %" << for_def.i_type_id << " %" << for_def.i_var_id << "\n";
     this_fn_.body_ss << "\t%" << i_inc_id << " = OpIAdd %" << for_def.i_type_id << " %" << i_id << " %" << for_def.inc_amount_id << "\n";
     this_fn_.body_ss << "\t\tOpStore %" << for_def.i_var_id << " %" << i_inc_id << "\n";
+
+    auto& words{this_fn_.body_words};
+    SpvInst(words, OP_BRANCH).word(for_def.i_inc_label_id).end();
+    SpvInst(words, OP_LABEL).word(for_def.i_inc_label_id).end();
+    SpvInst(words, OP_LOAD).word(for_def.i_type_id).word(i_id).word(for_def.i_var_id).end();
+    SpvInst(words, OP_IADD).word(for_def.i_type_id).word(i_inc_id).word(i_id).word(for_def.inc_amount_id).end();
+    SpvInst(words, OP_STORE).word(for_def.i_var_id).word(i_inc_id).end();
+
+    // the other induction variables advance in the continue block as well
+    for (const auto& it : for_def.inductions) {
+        auto value_id{alloc_id()};
+        auto next_id{alloc_id()};
+        this_fn_.body_ss << "\t%" << value_id << " = OpLoad %" << for_def.i_type_id << " %" << it.var_id << "\n";
+        this_fn_.body_ss << "\t%" << next_id << " = OpIAdd %" << for_def.i_type_id << " %" << value_id << " %" << it.step_id << "\n";
+        this_fn_.body_ss << "\t\tOpStore %" << it.var_id << " %" << next_id << "\n";
+        SpvInst(words, OP_LOAD).word(for_def.i_type_id).word(value_id).word(it.var_id).end();
+        SpvInst(words, OP_IADD).word(for_def.i_type_id).word(next_id).word(value_id).word(it.step_id).end();
+        SpvInst(words, OP_STORE).word(it.var_id).word(next_id).end();
+    }
+
     this_fn_.body_ss << "\t\tOpBranch %" << for_def.init_label_id <<"\n";
     this_fn_.body_ss << "\t%" << for_def.loop_exit_label_id << " = OpLabel\n";
+    SpvInst(words, OP_BRANCH).word(for_def.init_label_id).end();
+    SpvInst(words, OP_LABEL).word(for_def.loop_exit_label_id).end();
 }
 
 void CodeGen::FnCodeGen::clear()
@@ -130,4 +262,11 @@ void CodeGen::FnCodeGen::clear()
     var_def_ss.clear();
     body_ss.clear();
     epilogue_ss.clear();
+
+    prologue_words.clear();
+    var_def_words.clear();
+    body_words.clear();
+    epilogue_words.clear();
+
+    block_returned = false;
 }
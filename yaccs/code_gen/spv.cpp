@@ -0,0 +1,152 @@
+#include "yaccs/code_gen/spv.hpp"
+#include <cassert>
+#include <cstring>
+
+
+SpvInst::SpvInst(std::vector<uint32_t>& words, SpvOp op)
+    : words_(words)
+    , begin_(words.size())
+    , op_(op)
+{
+    words_.push_back(0); // placeholder, patched in end()
+}
+
+SpvInst& SpvInst::word(uint32_t w)
+{
+    words_.push_back(w);
+    return *this;
+}
+
+SpvInst& SpvInst::words(const std::vector<id_t>& ws)
+{
+    words_.insert(words_.end(), ws.begin(), ws.end());
+    return *this;
+}
+
+SpvInst& SpvInst::string(const std::string& str)
+{
+    // nul-terminated UTF-8, padded to a word boundary
+    const size_t num_words{str.size() / 4 + 1};
+    const auto offset{words_.size()};
+    words_.resize(offset + num_words, 0);
+    memcpy(words_.data() + offset, str.data(), str.size());
+    return *this;
+}
+
+void SpvInst::end()
+{
+    const auto word_count{static_cast<uint32_t>(words_.size() - begin_)};
+    assert(word_count <= 0xffff && "Instruction too long");
+    words_.at(begin_) = (word_count << 16) | op_;
+}
+
+uint32_t as_spv(StorageClass sc)
+{
+    switch (sc) {
+    case SC_UNIFORM_CONSTANT:           return 0;
+    case SC_INPUT:                      return 1;
+    case SC_UNIFORM:                    return 2;
+    case SC_OUTPUT:                     return 3;
+    case SC_WORKGROUP:                  return 4;
+    case SC_CROSS_WORKGROUP:            return 5;
+    case SC_PRIVATE:                    return 6;
+    case SC_FUNCTION:                   return 7;
+    case SC_GENERIC:                    return 8;
+    case SC_PUSH_CONSTANT:              return 9;
+    case SC_ATOMICCOUNTER:              return 10;
+    case SC_IMAGE:                      return 11;
+    case SC_STORAGE_BUFFER:             return 12;
+    case SC_TILE_IMAGE_EXT:             return 4172;
+    case SC_TILE_ATTACHMENT_QCOM:       return 4491;
+    case SC_NODE_PAYLOAD_AMDX:          return 5068;
+    case SC_CALLABLE_DATA_KHR:          return 5328;
+    case SC_INCOMING_CALLABLE_DATA_KHR: return 5329;
+    case SC_RAY_PAYLOAD_KHR:            return 5338;
+    case SC_HIT_ATTRIBUTE_KHR:          return 5339;
+    case SC_INCOMING_RAYPAYLOAD_KHR:    return 5342;
+    case SC_SHADER_RECORD_BUFFER_KHR:   return 5343;
+    case SC_PHYSICAL_STORAGE_BUFFER:    return 5349;
+    case SC_HIT_OBJECT_ATTRIBUTE_NV:    return 5385;
+    case SC_TASK_PAYLOAD_WORKGROUP_EXT: return 5402;
+    case SC_CODE_SECTION_INTEL:         return 5605;
+    case SC_DEVICE_ONLY_INTEL:          return 5936;
+    case SC_HOST_ONLY_INTEL:            return 5937;
+    default:                            assert(false && "Unreachable");
+    }
+
+    return 0; // unreachable, return something to suppress compiler warning
+}
+
+uint32_t as_spv(Decoration deco)
+{
+    switch (deco) {
+    case DECO_RELAXED_PRECISION:    return 0;
+    case DECO_SPECID:               return 1;
+    case DECO_BLOCK:                return 2;
+    case DECO_BUFFER_BLOCK:         return 3;
+    case DECO_NON_WRITABLE:         return 24;
+    default:                        assert(false && "Unreachable");
+    }
+
+    return 0; // unreachable, return something to suppress compiler warning
+}
+
+SpvOp as_opcode(BinaryOperator bo)
+{
+    switch (bo) {
+    case BO_IADD:   return OP_IADD;
+    case BO_IMUL:   return OP_IMUL;
+    case BO_FADD:   return OP_FADD;
+    case BO_FMUL:   return OP_FMUL;
+    case BO_FDIV:   return OP_FDIV;
+    case BO_FSUB:   return OP_FSUB;
+    case BO_ISUB:   return OP_ISUB;
+    case BO_UDIV:   return OP_UDIV;
+    case BO_LOGICAL_AND: return OP_LOGICAL_AND;
+    case BO_VECTOR_TIMES_SCALAR: return OP_VECTOR_TIMES_SCALAR;
+    default:        assert(false && "Not implemented");
+    }
+
+    return OP_IADD;  // return something to suppress compiler warning
+}
+
+SpvOp as_opcode(CmpOp cmp_op)
+{
+    switch (cmp_op) {
+        case CO_GT:         return OP_UGREATER_THAN;
+        case CO_GE:         return OP_UGREATER_THAN_EQUAL;
+        case CO_LT:         return OP_ULESS_THAN;
+        case CO_LE:
+        case CO_EQ:
+        case CO_NE:
+        case CO_UNKNOWN:
+        default:                        assert(false && "Not implement");
+    }
+
+    return OP_UGREATER_THAN; // Unreachable, return something to suppress compile warning
+}
+
+SpvOp as_opcode(ConvertOp cvt_op)
+{
+    switch (cvt_op) {
+        case CVT_F_TO_F:    return OP_FCONVERT;
+        case CVT_F_TO_S:    return OP_CONVERT_F_TO_S;
+        case CVT_S_TO_F:    return OP_CONVERT_S_TO_F;
+        case CVT_U_TO_F:    return OP_CONVERT_U_TO_F;
+        case CVT_UNKNOWN:
+        default:            assert(false && "Not implement");
+    }
+
+    return OP_FCONVERT; // Unreachable, return something to suppress compile warning
+}
+
+SpvOp as_opcode(GroupOp group_op)
+{
+    switch (group_op) {
+        case GO_FADD:       return OP_GROUP_NON_UNIFORM_FADD;
+        case GO_FMAX:       return OP_GROUP_NON_UNIFORM_FMAX;
+        default:            assert(false && "Not implement");
+    }
+
+    return OP_GROUP_NON_UNIFORM_FADD; // Unreachable, return something to suppress compile warning
+}
@@ -0,0 +1,172 @@
+#ifndef YACCS_CODE_GEN_SPV_H_
+#define YACCS_CODE_GEN_SPV_H_
+
+#include "yaccs/baker/layer1/def.hpp"
+#include "yaccs/baker/def.hpp"
+#include "yaccs/dtype.hpp"
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define SPV_MAGIC_NUMBER 0x07230203
+#define SPV_VERSION_1_6 0x00010600  // target env vulkan1.4
+#define SPV_GENERATOR 0
+#define SPV_HEADER_WORDS 5
+
+enum SpvOp : uint32_t
+{
+    OP_EXT_INST_IMPORT = 11,
+    OP_EXT_INST = 12,
+    OP_MEMORY_MODEL = 14,
+    OP_ENTRY_POINT = 15,
+    OP_EXECUTION_MODE = 16,
+    OP_CAPABILITY = 17,
+    OP_TYPE_VOID = 19,
+    OP_TYPE_BOOL = 20,
+    OP_TYPE_INT = 21,
+    OP_TYPE_FLOAT = 22,
+    OP_TYPE_VECTOR = 23,
+    OP_TYPE_ARRAY = 28,
+    OP_TYPE_RUNTIME_ARRAY = 29,
+    OP_TYPE_STRUCT = 30,
+    OP_TYPE_POINTER = 32,
+    OP_TYPE_FUNCTION = 33,
+    OP_CONSTANT = 43,
+    OP_CONSTANT_COMPOSITE = 44,
+    OP_SPEC_CONSTANT = 50,
+    OP_SPEC_CONSTANT_OP = 52,
+    OP_FUNCTION = 54,
+    OP_FUNCTION_END = 56,
+    OP_FUNCTION_CALL = 57,
+    OP_VARIABLE = 59,
+    OP_LOAD = 61,
+    OP_STORE = 62,
+    OP_ACCESS_CHAIN = 65,
+    OP_DECORATE = 71,
+    OP_MEMBER_DECORATE = 72,
+    OP_COMPOSITE_CONSTRUCT = 80,
+    OP_COMPOSITE_EXTRACT = 81,
+    OP_CONVERT_F_TO_S = 110,
+    OP_CONVERT_S_TO_F = 111,
+    OP_CONVERT_U_TO_F = 112,
+    OP_FCONVERT = 115,
+    OP_IADD = 128,
+    OP_FADD = 129,
+    OP_ISUB = 130,
+    OP_FSUB = 131,
+    OP_IMUL = 132,
+    OP_FMUL = 133,
+    OP_UDIV = 134,
+    OP_FDIV = 136,
+    OP_VECTOR_TIMES_SCALAR = 142,
+    OP_LOGICAL_AND = 167,
+    OP_SELECT = 169,
+    OP_UGREATER_THAN = 172,
+    OP_UGREATER_THAN_EQUAL = 174,
+    OP_ULESS_THAN = 176,
+    OP_BIT_FIELD_S_EXTRACT = 202,
+    OP_BIT_FIELD_U_EXTRACT = 203,
+    OP_CONTROL_BARRIER = 224,
+    OP_LOOP_MERGE = 246,
+    OP_SELECTION_MERGE = 247,
+    OP_LABEL = 248,
+    OP_BRANCH = 249,
+    OP_BRANCH_CONDITIONAL = 250,
+    OP_RETURN = 253,
+    OP_EXECUTION_MODE_ID = 331,
+    OP_GROUP_NON_UNIFORM_FADD = 350,
+    OP_GROUP_NON_UNIFORM_FMAX = 358,
+}; // enum SpvOp
+
+// Operand enumerants, values taken from the SPIR-V specification
+enum SpvEnumerant : uint32_t
+{
+    SPV_ADDRESSING_LOGICAL = 0,
+    SPV_MEMORY_MODEL_GLSL450 = 1,
+    SPV_EXECUTION_MODEL_GLCOMPUTE = 5,
+    SPV_EXECUTION_MODE_LOCAL_SIZE = 17,
+    SPV_EXECUTION_MODE_LOCAL_SIZE_ID = 38,
+    SPV_FUNCTION_CONTROL_NONE = 0,
+    SPV_SELECTION_CONTROL_NONE = 0,
+    SPV_LOOP_CONTROL_NONE = 0,
+    SPV_GROUP_OPERATION_REDUCE = 0,
+    SPV_DECORATION_BUILTIN = 11,
+    SPV_DECORATION_ARRAY_STRIDE = 6,
+    SPV_DECORATION_BINDING = 33,
+    SPV_DECORATION_DESCRIPTOR_SET = 34,
+    SPV_DECORATION_OFFSET = 35,
+}; // enum SpvEnumerant
+
+/**
+ * @brief Append one instruction to a word stream. The leading word
+ * (word count | opcode) is patched in end().
+ */
+struct SpvInst
+{
+    SpvInst(std::vector<uint32_t>& words, SpvOp op);
+    SpvInst& word(uint32_t w);
+    SpvInst& words(const std::vector<id_t>& ws);
+    SpvInst& string(const std::string& str);
+    void end();
+private:
+    std::vector<uint32_t>& words_;
+    size_t begin_;
+    SpvOp op_;
+}; // struct SpvInst
+
+uint32_t as_spv(StorageClass sc);
+uint32_t as_spv(Decoration deco);
+SpvOp as_opcode(BinaryOperator bo);
+SpvOp as_opcode(CmpOp cmp_op);
+SpvOp as_opcode(ConvertOp cvt_op);
+SpvOp as_opcode(GroupOp group_op);
+
+template<typename T>
+uint64_t literal_bits(DType dtype, T value)
+{
+    switch (dtype) {
+    case DT_FLOAT: {
+        float v{static_cast<float>(value)};
+        uint32_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        return bits;
+    }
+    case DT_FLOAT16:
+        return float_to_half(static_cast<float>(value));
+    case DT_DOUBLE: {
+        double v{static_cast<double>(value)};
+        uint64_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        return bits;
+    }
+    case DT_INT32:
+    case DT_UINT32:
+        return static_cast<uint32_t>(value);
+    case DT_INT64:
+    case DT_UINT64:
+        return static_cast<uint64_t>(value);
+    default: assert(false && "Unsupported literal type");
+    }
+
+    return 0; // unreachable, return something to suppress compiler warning
+}
+
+inline bool literal_is_64bit(DType dtype)
+{
+    return dtype == DT_DOUBLE || dtype == DT_INT64 || dtype == DT_UINT64;
+}
+
+template<typename T>
+void push_literal(SpvInst& inst, DType dtype, T value)
+{
+    const auto bits{literal_bits(dtype, value)};
+    inst.word(static_cast<uint32_t>(bits));
+    if (literal_is_64bit(dtype)) {
+        inst.word(static_cast<uint32_t>(bits >> 32));
+    }
+}
+
+#endif // YACCS_CODE_GEN_SPV_H_
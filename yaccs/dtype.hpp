@@ -2,13 +2,14 @@
 #define YACCS_DTYPE_H_
 
 #include <cstdint>
+#include <cstring>
 
 #define DT_FLOAT_BYTES 4
 #define DT_UINT8_BYTES 1
 #define DT_INT8_BYTES 1
 #define DT_UINT16_BYTES 2
 #define DT_INT16_BYTES 2
-#define DT_INT32_BYTES 3
+#define DT_INT32_BYTES 4
 #define DT_INT64_BYTES 8
 #define DT_BOOL_BYTES 1
 #define DT_FLOAT16_BYTES 2
@@ -104,4 +105,101 @@ inline uint32_t dtype_bytes(DType dtype)
     }
 }
 
+inline bool dtype_is_float(DType dtype)
+{
+    return dtype == DT_FLOAT || dtype == DT_FLOAT16 || dtype == DT_DOUBLE;
+}
+
+/**
+ * @brief IEEE754 single to half precision, rounds to nearest even. Out of range
+ * values become infinity.
+ */
+inline uint16_t float_to_half(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign{(bits >> 16) & 0x8000};
+    const uint32_t abs{bits & 0x7fffffff};
+
+    if (abs >= 0x7f800000) {
+        // inf, nan stays quiet nan
+        return static_cast<uint16_t>(sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0));
+    }
+    if (abs >= 0x477ff000) {
+        return static_cast<uint16_t>(sign | 0x7c00);
+    }
+    if (abs < 0x38800000) {
+        // half subnormal or zero, the unit is 2^-24
+        if (abs < 0x33000000) {
+            return static_cast<uint16_t>(sign);
+        }
+        const uint32_t shift{126 - (abs >> 23)};
+        const uint32_t mant{(abs & 0x7fffff) | 0x800000};
+        uint32_t h{mant >> shift};
+        const uint32_t rem{mant & ((1u << shift) - 1)};
+        const uint32_t halfway{1u << (shift - 1)};
+        if (rem > halfway || (rem == halfway && (h & 1))) {
+            ++h;
+        }
+        return static_cast<uint16_t>(sign | h);
+    }
+
+    // rebias the exponent from 127 to 15, a mantissa carry rounds into the exponent
+    uint32_t h{(abs - 0x38000000) >> 13};
+    const uint32_t rem{abs & 0x1fff};
+    if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) {
+        ++h;
+    }
+    return static_cast<uint16_t>(sign | h);
+}
+
+inline float half_to_float(uint16_t value)
+{
+    const uint32_t sign{static_cast<uint32_t>(value & 0x8000) << 16};
+    const uint32_t exp{(value >> 10) & 0x1fu};
+    uint32_t mant{value & 0x3ffu};
+    uint32_t bits{sign};
+
+    if (exp == 0x1f) {
+        bits |= 0x7f800000 | (mant << 13);
+    } else if (exp != 0) {
+        bits |= ((exp + 112) << 23) | (mant << 13);
+    } else if (mant != 0) {
+        // subnormal, normalize into a single precision normal
+        uint32_t e{113};
+        while ((mant & 0x400) == 0) {
+            mant <<= 1;
+            --e;
+        }
+        bits |= (e << 23) | ((mant & 0x3ff) << 13);
+    }
+
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+/**
+ * @brief Single precision to bfloat16, the upper 16 bits rounded to nearest even. NaN
+ * stays a quiet NaN.
+ */
+inline uint16_t float_to_bfloat16(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if ((bits & 0x7fffffff) > 0x7f800000) {
+        return static_cast<uint16_t>((bits >> 16) | 0x40);
+    }
+    bits += 0x7fff + ((bits >> 16) & 1);
+    return static_cast<uint16_t>(bits >> 16);
+}
+
+inline float bfloat16_to_float(uint16_t value)
+{
+    const uint32_t bits{static_cast<uint32_t>(value) << 16};
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
 #endif // YACCS_DTYPE_H_
@@ -0,0 +1,290 @@
+#include "yaccs/graph/fusion.hpp"
+#include <algorithm>
+#include <cassert>
+
+
+int fuse_gemm_relu(Graph& graph)
+{
+    int num_fused{0};
+    for (auto node_id : graph.topo_order()) {
+        auto& relu_node{graph.node(node_id)};
+        if (relu_node.op_type != OT_RELU) {
+            continue;
+        }
+
+        auto& x{graph.value(relu_node.inputs.at(0))};
+        if (x.kind != VK_INTERMEDIATE || x.producer == GRAPH_NO_NODE || x.consumers.size() != 1) {
+            continue;
+        }
+        auto& gemm_node{graph.node(x.producer)};
+        if (gemm_node.op_type != OT_GEMM || gemm_node.dead) {
+            continue;
+        }
+        auto& gemm{std::get<OpGemm>(gemm_node.op)};
+        if (gemm.fused_relu) {
+            continue;
+        }
+
+        // gemm now produces the relu output, x is left without producer and consumers
+        const auto& relu{std::get<OpRelu>(relu_node.op)};
+        auto y_id{relu_node.outputs.at(0)};
+        gemm.fused_relu = true;
+        gemm.Y.tt = relu.Y.tt;
+        gemm_node.outputs.at(0) = y_id;
+        graph.value(y_id).producer = x.producer;
+        x.producer = GRAPH_NO_NODE;
+        x.consumers.clear();
+        relu_node.dead = true;
+        ++num_fused;
+    }
+    return num_fused;
+}
+
+namespace {
+
+// producer of value_id when it is alive and of type op_type
+Node* live_producer(Graph& graph, int value_id, OpType op_type)
+{
+    auto producer{graph.value(value_id).producer};
+    if (producer == GRAPH_NO_NODE) {
+        return nullptr;
+    }
+    auto& node{graph.node(producer)};
+    return node.dead || node.op_type != op_type ? nullptr : &node;
+}
+
+// integer element at offset in data of a quantized tensor or zero point, an omitted
+// zero point is zero
+int quant_value_at_offset(const Tensor& tensor, size_t offset)
+{
+    if (tensor.data.empty()) {
+        return 0;
+    }
+    switch (tensor.tt.dtype) {
+    case DT_INT8:   return tensor.at_offset<DT_INT8>(offset);
+    case DT_UINT8:  return tensor.at_offset<DT_UINT8>(offset);
+    case DT_INT32:  return tensor.at_offset<DT_INT32>(offset);
+    default:        assert(false && "Not implemented");
+    }
+    return 0;   // unreachable, return something to suppress compiler warning
+}
+
+int quant_value_at(const Tensor& tensor, int i)
+{
+    return quant_value_at_offset(tensor, tensor.elem_offset(i));
+}
+
+bool quant_range(const Tensor& zero_point, int& qmin, int& qmax)
+{
+    const auto dtype{zero_point.data.empty() ? DT_UINT8 : zero_point.tt.dtype};
+    if (dtype != DT_INT8 && dtype != DT_UINT8) {
+        return false;
+    }
+    qmin = dtype == DT_INT8 ? -128 : 0;
+    qmax = dtype == DT_INT8 ? 127 : 255;
+    return true;
+}
+
+template<typename OpQdq>
+bool is_per_tensor(const OpQdq& op)
+{
+    return op.scale.tt.num_elems() == 1 && op.scale.tt.dtype == DT_FLOAT;
+}
+
+template<typename OpQ, typename OpDQ>
+bool same_quant_params(const OpQ& q, const OpDQ& dq)
+{
+    return is_per_tensor(q) && is_per_tensor(dq)
+        && q.scale.template at<DT_FLOAT>(0) == dq.scale.template at<DT_FLOAT>(0)
+        && quant_value_at(q.zero_point, 0) == quant_value_at(dq.zero_point, 0);
+}
+
+// DequantizeLinear of a constant, evaluated on the host
+Tensor dequantize(const OpDequantizeLinear& dq)
+{
+    Tensor result;
+    result.tt = dq.X.tt;
+    result.tt.name = dq.Y.tt.name;
+    result.tt.dtype = DT_FLOAT;
+    result.data.resize(result.tt.num_elems() * DT_FLOAT_BYTES);
+
+    // per-axis scales vary along dq.axis
+    const auto axis{dq.axis < 0 ? dq.axis + dq.X.tt.dims : dq.axis};
+    int inner{1};
+    for (int i = axis + 1; i < dq.X.tt.dims; ++i) {
+        inner *= dq.X.tt.shape[i];
+    }
+    const bool per_tensor{dq.scale.tt.num_elems() == 1};
+    int c{0};
+    int inner_left{inner};
+    TensorIterator it{dq.X};
+    for (int i = 0; i < result.tt.num_elems(); ++i, ++it) {
+        const auto q{quant_value_at_offset(dq.X, it.offset()) - quant_value_at(dq.zero_point, c)};
+        result.set<DT_FLOAT>(i, q * dq.scale.at<DT_FLOAT>(c));
+        // c steps every inner elements
+        if (!per_tensor && --inner_left == 0) {
+            inner_left = inner;
+            c = (c + 1) % dq.X.tt.shape[axis];
+        }
+    }
+    return result;
+}
+
+// node_id reads new_value_id at input slot instead of the value it read before
+void rewire_input(Graph& graph, int node_id, size_t slot, int new_value_id)
+{
+    auto& node{graph.node(node_id)};
+    auto& old_consumers{graph.value(node.inputs.at(slot)).consumers};
+    old_consumers.erase(std::find(old_consumers.begin(), old_consumers.end(), node_id));
+    node.inputs.at(slot) = new_value_id;
+    graph.value(new_value_id).consumers.push_back(node_id);
+}
+
+// drop a node whose outputs are no longer read, detaching it from its inputs
+bool remove_if_unused(Graph& graph, Node* node)
+{
+    if (node == nullptr) {
+        return false;
+    }
+    for (auto value_id : node->outputs) {
+        const auto& value{graph.value(value_id)};
+        if (!value.consumers.empty() || value.kind == VK_OUTPUT) {
+            return false;
+        }
+    }
+
+    const int node_id{graph.value(node->outputs.at(0)).producer};
+    for (auto value_id : node->inputs) {
+        auto& consumers{graph.value(value_id).consumers};
+        consumers.erase(std::remove(consumers.begin(), consumers.end(), node_id), consumers.end());
+    }
+    for (auto value_id : node->outputs) {
+        graph.value(value_id).producer = GRAPH_NO_NODE;
+    }
+    node->dead = true;
+    return true;
+}
+
+} // namespace
+
+int fuse_qdq_gemm(Graph& graph)
+{
+    int num_folded{0};
+    for (auto node_id : graph.topo_order()) {
+        if (graph.node(node_id).op_type != OT_GEMM) {
+            continue;
+        }
+        auto& gemm{std::get<OpGemm>(graph.node(node_id).op)};
+        const auto inputs{graph.node(node_id).inputs};
+
+        // constant weights, int8 when they can stay quantized
+        auto b_dq{live_producer(graph, inputs.at(1), OT_DEQUANTIZE_LINEAR)};
+        if (b_dq == nullptr || graph.value(b_dq->inputs.at(0)).kind != VK_INITIALIZER) {
+            continue;
+        }
+        const auto& w_dq{std::get<OpDequantizeLinear>(b_dq->op)};
+
+        // A through QuantizeLinear -> DequantizeLinear with one scale and zero point, or
+        // from a Gemm whose requantize epilogue took that pair and left A on the int8 grid
+        auto a_dq{live_producer(graph, inputs.at(0), OT_DEQUANTIZE_LINEAR)};
+        auto a_q{a_dq != nullptr ? live_producer(graph, a_dq->inputs.at(0), OT_QUANTIZE_LINEAR) : nullptr};
+        auto a_gemm{live_producer(graph, inputs.at(0), OT_GEMM)};
+        const GemmQuantDef* a_requantized{a_gemm != nullptr && std::get<OpGemm>(a_gemm->op).quant.requantize
+            ? &std::get<OpGemm>(a_gemm->op).quant : nullptr};
+        bool int8{a_requantized != nullptr || (a_q != nullptr
+            && same_quant_params(std::get<OpQuantizeLinear>(a_q->op), std::get<OpDequantizeLinear>(a_dq->op))
+            && quant_range(std::get<OpQuantizeLinear>(a_q->op).zero_point, gemm.quant.a_qmin, gemm.quant.a_qmax))};
+
+        // int8 weights need a single zero point and scales along the output columns
+        const auto n{gemm.trans_b ? w_dq.X.tt.shape[0] : w_dq.X.tt.shape[1]};
+        const auto column_axis{gemm.trans_b ? 0 : 1};
+        const auto w_axis{w_dq.axis < 0 ? w_dq.axis + w_dq.X.tt.dims : w_dq.axis};
+        const auto num_scales{w_dq.scale.tt.num_elems()};
+        int qmin, qmax;
+        int8 = int8 && w_dq.X.tt.dims == 2 && quant_range(w_dq.zero_point, qmin, qmax)
+            && w_dq.scale.tt.dtype == DT_FLOAT && (num_scales == 1 || (w_axis == column_axis && num_scales == static_cast<int>(n)));
+        for (int i = 1; int8 && i < w_dq.zero_point.tt.num_elems(); ++i) {
+            int8 = quant_value_at(w_dq.zero_point, i) == quant_value_at(w_dq.zero_point, 0);
+        }
+
+        if (int8) {
+            if (a_requantized != nullptr) {
+                gemm.quant.a_scale = a_requantized->y_scale;
+                gemm.quant.a_zero_point = a_requantized->y_zero_point;
+                gemm.quant.a_qmin = a_requantized->y_qmin;
+                gemm.quant.a_qmax = a_requantized->y_qmax;
+            } else {
+                const auto& a_qop{std::get<OpQuantizeLinear>(a_q->op)};
+                gemm.quant.a_scale = a_qop.scale.at<DT_FLOAT>(0);
+                gemm.quant.a_zero_point = quant_value_at(a_qop.zero_point, 0);
+                gemm.A.tt = a_qop.X.tt;
+                rewire_input(graph, node_id, 0, a_q->inputs.at(0));
+            }
+            gemm.quant.enabled = true;
+            gemm.quant.b_zero_point = quant_value_at(w_dq.zero_point, 0);
+            gemm.quant.b_scale.clear();
+            for (int i = 0; i < num_scales; ++i) {
+                gemm.quant.b_scale.push_back(w_dq.scale.at<DT_FLOAT>(i));
+            }
+            gemm.B = w_dq.X;
+            rewire_input(graph, node_id, 1, b_dq->inputs.at(0));
+        } else {
+            gemm.B = dequantize(w_dq);
+            rewire_input(graph, node_id, 1, b_dq->inputs.at(0));
+        }
+        num_folded += remove_if_unused(graph, b_dq);
+        if (a_dq != nullptr && int8 && a_requantized == nullptr) {
+            num_folded += remove_if_unused(graph, a_dq);
+            num_folded += remove_if_unused(graph, a_q);
+        }
+
+        // constant bias, usually int32 at scale a_scale * b_scale
+        auto c_dq{inputs.size() > 2 ? live_producer(graph, inputs.at(2), OT_DEQUANTIZE_LINEAR) : nullptr};
+        if (c_dq != nullptr && graph.value(c_dq->inputs.at(0)).kind == VK_INITIALIZER) {
+            gemm.C = dequantize(std::get<OpDequantizeLinear>(c_dq->op));
+            rewire_input(graph, node_id, 2, c_dq->inputs.at(0));
+            num_folded += remove_if_unused(graph, c_dq);
+        }
+
+        // QuantizeLinear -> DequantizeLinear on Y, rounds the result onto the int8 grid
+        auto& y{graph.value(graph.node(node_id).outputs.at(0))};
+        if (!int8 || y.kind != VK_INTERMEDIATE || y.consumers.size() != 1) {
+            continue;
+        }
+        auto& y_q{graph.node(y.consumers.at(0))};
+        if (y_q.dead || y_q.op_type != OT_QUANTIZE_LINEAR) {
+            continue;
+        }
+        auto& y_q_out{graph.value(y_q.outputs.at(0))};
+        if (y_q_out.kind != VK_INTERMEDIATE || y_q_out.consumers.size() != 1) {
+            continue;
+        }
+        auto& y_dq{graph.node(y_q_out.consumers.at(0))};
+        const auto& y_qop{std::get<OpQuantizeLinear>(y_q.op)};
+        if (y_dq.dead || y_dq.op_type != OT_DEQUANTIZE_LINEAR
+            || !same_quant_params(y_qop, std::get<OpDequantizeLinear>(y_dq.op))
+            || !quant_range(y_qop.zero_point, gemm.quant.y_qmin, gemm.quant.y_qmax)) {
+            continue;
+        }
+
+        // gemm now produces the DequantizeLinear output, the pair in between goes away
+        const auto y_dq_out_id{y_dq.outputs.at(0)};
+        gemm.quant.requantize = true;
+        gemm.quant.y_scale = y_qop.scale.at<DT_FLOAT>(0);
+        gemm.quant.y_zero_point = quant_value_at(y_qop.zero_point, 0);
+        gemm.Y.tt = std::get<OpDequantizeLinear>(y_dq.op).Y.tt;
+        graph.node(node_id).outputs.at(0) = y_dq_out_id;
+        graph.value(y_dq_out_id).producer = node_id;
+        for (auto qdq_id : {y.consumers.at(0), y_q_out.consumers.at(0)}) {
+            for (auto value_id : graph.node(qdq_id).inputs) {
+                auto& consumers{graph.value(value_id).consumers};
+                consumers.erase(std::remove(consumers.begin(), consumers.end(), qdq_id), consumers.end());
+            }
+            graph.node(qdq_id).dead = true;
+        }
+        y.producer = GRAPH_NO_NODE;
+        y_q_out.producer = GRAPH_NO_NODE;
+        num_folded += 2;
+    }
+    return num_folded;
+}
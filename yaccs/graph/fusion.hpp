@@ -0,0 +1,28 @@
+#ifndef YACCS_GRAPH_FUSION_H_
+#define YACCS_GRAPH_FUSION_H_
+
+#include "yaccs/graph/graph.hpp"
+
+/**
+ * @brief Fold a Relu into the Gemm producing its input when that Gemm output has no
+ * other consumer. The Gemm then writes the Relu output directly, the intermediate
+ * tensor and the barrier between the two layers go away.
+ *
+ * @return number of fused Relu nodes
+ */
+int fuse_gemm_relu(Graph& graph);
+
+/**
+ * @brief Fold QuantizeLinear/DequantizeLinear nodes around a Gemm into the Gemm.
+ *
+ * DequantizeLinear of constant weights and biases is evaluated on the host. When A
+ * also comes through a QuantizeLinear -> DequantizeLinear pair the Gemm runs in int8
+ * (see GemmQuantDef) on the quantized weights, a pair right after the Gemm becomes a
+ * requantize epilogue and the Gemm reading its output stays in int8 as well. Pairs that
+ * do not fit are left in the graph. Run it before fuse_gemm_relu.
+ *
+ * @return number of folded QuantizeLinear/DequantizeLinear nodes
+ */
+int fuse_qdq_gemm(Graph& graph);
+
+#endif // YACCS_GRAPH_FUSION_H_
@@ -0,0 +1,207 @@
+#include "yaccs/graph/graph.hpp"
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <queue>
+
+
+int Graph::add_value(const std::string& name, ValueKind kind)
+{
+    auto find{value_ids_.find(name)};
+    if (find != value_ids_.end()) {
+        return find->second;
+    }
+
+    Value value;
+    value.name = name;
+    value.tt.name = name;
+    value.kind = kind;
+    value.producer = GRAPH_NO_NODE;
+    values_.push_back(value);
+    int value_id{static_cast<int>(values_.size()) - 1};
+    value_ids_.insert(std::make_pair(name, value_id));
+    return value_id;
+}
+
+int Graph::add_node(const std::string& name, OpType op_type,
+    const std::vector<std::string>& inputs, const std::vector<std::string>& outputs)
+{
+    const int node_id{static_cast<int>(nodes_.size())};
+    Node node;
+    node.name = name;
+    node.op_type = op_type;
+    node.dead = false;
+
+    for (const auto& it : inputs) {
+        if (it.empty()) {
+            continue; // omitted optional input
+        }
+        auto value_id{add_value(it)};
+        values_.at(value_id).consumers.push_back(node_id);
+        node.inputs.push_back(value_id);
+    }
+
+    for (const auto& it : outputs) {
+        auto value_id{add_value(it)};
+        auto& value{values_.at(value_id)};
+        assert(value.producer == GRAPH_NO_NODE && "Value produced by more than one node");
+        value.producer = node_id;
+        node.outputs.push_back(value_id);
+    }
+
+    nodes_.push_back(node);
+    return node_id;
+}
+
+void Graph::mark_input(int value_id)
+{
+    values_.at(value_id).kind = VK_INPUT;
+    inputs_.push_back(value_id);
+}
+
+void Graph::mark_output(int value_id)
+{
+    values_.at(value_id).kind = VK_OUTPUT;
+    outputs_.push_back(value_id);
+}
+
+int Graph::find_value(const std::string& name) const
+{
+    auto find{value_ids_.find(name)};
+    if (find == value_ids_.end()) {
+        return GRAPH_NO_NODE;
+    }
+    return find->second;
+}
+
+std::vector<int> Graph::predecessors(int node_id) const
+{
+    std::vector<int> result;
+    for (auto value_id : nodes_.at(node_id).inputs) {
+        auto producer{values_.at(value_id).producer};
+        if (producer != GRAPH_NO_NODE && !nodes_.at(producer).dead
+            && std::find(result.begin(), result.end(), producer) == result.end()) {
+            result.push_back(producer);
+        }
+    }
+    return result;
+}
+
+std::vector<int> Graph::successors(int node_id) const
+{
+    std::vector<int> result;
+    for (auto value_id : nodes_.at(node_id).outputs) {
+        for (auto consumer : values_.at(value_id).consumers) {
+            if (!nodes_.at(consumer).dead
+                && std::find(result.begin(), result.end(), consumer) == result.end()) {
+                result.push_back(consumer);
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<int> Graph::topo_order() const
+{
+    // Kahn's algorithm. Ready nodes are taken smallest id first, so a graph that is
+    // already sorted keeps its file order and the output is deterministic.
+    std::vector<int> in_degree(nodes_.size(), 0);
+    std::priority_queue<int, std::vector<int>, std::greater<int>> ready;
+    size_t num_alive{0};
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (nodes_.at(i).dead) {
+            continue;
+        }
+        ++num_alive;
+        in_degree.at(i) = predecessors(i).size();
+        if (in_degree.at(i) == 0) {
+            ready.push(i);
+        }
+    }
+
+    std::vector<int> order;
+    order.reserve(num_alive);
+    while (!ready.empty()) {
+        auto node_id{ready.top()};
+        ready.pop();
+        order.push_back(node_id);
+        for (auto succ : successors(node_id)) {
+            if (--in_degree.at(succ) == 0) {
+                ready.push(succ);
+            }
+        }
+    }
+
+    assert(order.size() == num_alive && "Cycle detected in graph");
+    return order;
+}
+
+int Graph::eliminate_dead_nodes()
+{
+    // mark nodes reachable backwards from the graph outputs
+    std::vector<bool> live(nodes_.size(), false);
+    std::vector<int> stack;
+    for (auto value_id : outputs_) {
+        auto producer{values_.at(value_id).producer};
+        if (producer != GRAPH_NO_NODE) {
+            stack.push_back(producer);
+        }
+    }
+    while (!stack.empty()) {
+        auto node_id{stack.back()};
+        stack.pop_back();
+        if (live.at(node_id) || nodes_.at(node_id).dead) {
+            continue;
+        }
+        live.at(node_id) = true;
+        for (auto pred : predecessors(node_id)) {
+            stack.push_back(pred);
+        }
+    }
+
+    int num_eliminated{0};
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (!live.at(i) && !nodes_.at(i).dead) {
+            nodes_.at(i).dead = true;
+            ++num_eliminated;
+        }
+    }
+    return num_eliminated;
+}
+
+OpType as_op_type(const std::string& op_type)
+{
+    if (op_type.compare("Gemm") == 0) {
+        return OT_GEMM;
+    } else if (op_type.compare("Relu") == 0) {
+        return OT_RELU;
+    } else if (op_type.compare("QuantizeLinear") == 0) {
+        return OT_QUANTIZE_LINEAR;
+    } else if (op_type.compare("DequantizeLinear") == 0) {
+        return OT_DEQUANTIZE_LINEAR;
+    } else if (op_type.compare("ReduceSum") == 0) {
+        return OT_REDUCE_SUM;
+    } else if (op_type.compare("ReduceMean") == 0) {
+        return OT_REDUCE_MEAN;
+    } else if (op_type.compare("ReduceMax") == 0) {
+        return OT_REDUCE_MAX;
+    } else if (op_type.compare("Softmax") == 0) {
+        return OT_SOFTMAX;
+    }
+    return OT_UNKNOWN;
+}
+
+const char* as_string(OpType op_type)
+{
+    switch (op_type) {
+    case OT_GEMM:       return "Gemm";
+    case OT_RELU:       return "Relu";
+    case OT_QUANTIZE_LINEAR:    return "QuantizeLinear";
+    case OT_DEQUANTIZE_LINEAR:  return "DequantizeLinear";
+    case OT_REDUCE_SUM: return "ReduceSum";
+    case OT_REDUCE_MEAN:    return "ReduceMean";
+    case OT_REDUCE_MAX: return "ReduceMax";
+    case OT_SOFTMAX:    return "Softmax";
+    default:            return "Unknown";
+    }
+}
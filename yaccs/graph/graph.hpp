@@ -0,0 +1,98 @@
+#ifndef YACCS_GRAPH_GRAPH_H_
+#define YACCS_GRAPH_GRAPH_H_
+
+#include "yaccs/onnx/ops.hpp"
+#include "yaccs/tensor.hpp"
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#define GRAPH_NO_NODE -1
+
+enum OpType
+{
+    OT_GEMM,
+    OT_RELU,
+    OT_QUANTIZE_LINEAR,
+    OT_DEQUANTIZE_LINEAR,
+    OT_REDUCE_SUM,
+    OT_REDUCE_MEAN,
+    OT_REDUCE_MAX,
+    OT_SOFTMAX,
+    OT_UNKNOWN,
+}; // enum OpType
+
+enum ValueKind
+{
+    VK_INPUT,           // graph input, bound by the caller
+    VK_OUTPUT,          // graph output, read back by the caller
+    VK_INITIALIZER,     // constant data baked into the module
+    VK_INTERMEDIATE,    // produced and consumed inside the graph
+}; // enum ValueKind
+
+/**
+ * @brief A tensor flowing along the edges of the graph. Use-def chain: at most
+ * one producer node and any number of consumer nodes.
+ */
+struct Value
+{
+    std::string name;
+    TensorType tt;
+    ValueKind kind;
+    int producer;
+    std::vector<int> consumers;
+}; // struct Value
+
+using OpVariant = std::variant<std::monostate, OpGemm, OpRelu, OpQuantizeLinear, OpDequantizeLinear,
+    OpReduce, OpSoftmax>;
+
+struct Node
+{
+    std::string name;
+    OpType op_type;
+    std::vector<int> inputs;    // value ids, empty optional inputs are skipped
+    std::vector<int> outputs;   // value ids
+    OpVariant op;
+    bool dead;
+}; // struct Node
+
+/**
+ * @brief In-memory operator graph sitting between the ONNX frontend and Layer3.
+ * Nodes and values are addressed by their index, node ids follow the order they
+ * were added in (file order for ONNX models).
+ */
+struct Graph
+{
+    int add_value(const std::string& name, ValueKind kind=VK_INTERMEDIATE);
+    int add_node(const std::string& name, OpType op_type,
+        const std::vector<std::string>& inputs, const std::vector<std::string>& outputs);
+    void mark_input(int value_id);
+    void mark_output(int value_id);
+
+    int find_value(const std::string& name) const;
+    const Value& value(int value_id) const { return values_.at(value_id); }
+    Value& value(int value_id) { return values_.at(value_id); }
+    const Node& node(int node_id) const { return nodes_.at(node_id); }
+    Node& node(int node_id) { return nodes_.at(node_id); }
+    size_t num_values() const { return values_.size(); }
+    size_t num_nodes() const { return nodes_.size(); }
+    const std::vector<int>& inputs() const { return inputs_; }
+    const std::vector<int>& outputs() const { return outputs_; }
+
+    std::vector<int> predecessors(int node_id) const;
+    std::vector<int> successors(int node_id) const;
+    std::vector<int> topo_order() const;
+    int eliminate_dead_nodes();
+private:
+    std::vector<Node> nodes_;
+    std::vector<Value> values_;
+    std::unordered_map<std::string, int> value_ids_;
+    std::vector<int> inputs_;
+    std::vector<int> outputs_;
+}; // struct Graph
+
+OpType as_op_type(const std::string& op_type);
+const char* as_string(OpType op_type);
+
+#endif // YACCS_GRAPH_GRAPH_H_
@@ -0,0 +1,90 @@
+#include "yaccs/graph/memory_plan.hpp"
+#include "yaccs/dtype.hpp"
+#include <algorithm>
+
+
+MemoryPlan plan_memory(const Graph& graph, size_t alignment)
+{
+    MemoryPlan plan{};
+
+    const auto order{graph.topo_order()};
+    std::vector<int> position(graph.num_nodes(), -1);
+    for (size_t i = 0; i < order.size(); ++i) {
+        position.at(order.at(i)) = i;
+    }
+
+    // lifetimes of the intermediates
+    for (size_t i = 0; i < graph.num_values(); ++i) {
+        const auto& value{graph.value(i)};
+        if (value.kind != VK_INTERMEDIATE || value.producer == GRAPH_NO_NODE
+            || graph.node(value.producer).dead) {
+            continue;
+        }
+        if (value.tt.is_dynamic()) {
+            ++plan.num_dynamic;  // size unknown until runtime, keeps its own buffer
+            continue;
+        }
+
+        MemorySlot slot{};
+        slot.value_id = i;
+        slot.first = position.at(value.producer);
+        slot.last = slot.first;
+        for (auto consumer : value.consumers) {
+            if (!graph.node(consumer).dead) {
+                slot.last = std::max(slot.last, position.at(consumer));
+            }
+        }
+        const size_t num_bytes{value.tt.num_elems() * dtype_bytes(value.tt.dtype)};
+        slot.size = (num_bytes + alignment - 1) / alignment * alignment;
+        plan.total_size += slot.size;
+        plan.slots.push_back(slot);
+    }
+
+    std::vector<size_t> by_size(plan.slots.size());
+    for (size_t i = 0; i < by_size.size(); ++i) {
+        by_size.at(i) = i;
+    }
+    std::stable_sort(by_size.begin(), by_size.end(), [&plan] (size_t a, size_t b) {
+        return plan.slots.at(a).size > plan.slots.at(b).size;
+    });
+
+    std::vector<const MemorySlot*> placed;
+    for (auto idx : by_size) {
+        auto& slot{plan.slots.at(idx)};
+
+        // placed slots alive at the same time, sorted by offset
+        std::vector<const MemorySlot*> conflicts;
+        for (auto it : placed) {
+            if (it->first <= slot.last && slot.first <= it->last) {
+                conflicts.push_back(it);
+            }
+        }
+        std::sort(conflicts.begin(), conflicts.end(), [] (const MemorySlot* a, const MemorySlot* b) {
+            return a->offset < b->offset;
+        });
+
+        size_t offset{0};
+        for (auto it : conflicts) {
+            if (offset + slot.size <= it->offset) {
+                break;  // fits in the gap below this one
+            }
+            offset = std::max(offset, it->offset + it->size);
+        }
+        slot.offset = offset;
+        plan.arena_size = std::max(plan.arena_size, offset + slot.size);
+        placed.push_back(&slot);
+    }
+
+    return plan;
+}
+
+std::ostream& operator<<(std::ostream& os, const MemoryPlan& plan)
+{
+    os << "Peak activation footprint: " << plan.arena_size << " bytes ("
+        << plan.total_size << " bytes without reuse, "
+        << plan.slots.size() << " intermediate tensors)";
+    if (plan.num_dynamic > 0) {
+        os << ", " << plan.num_dynamic << " dynamic shaped intermediate tensors not planned";
+    }
+    return os;
+}
@@ -0,0 +1,39 @@
+#ifndef YACCS_GRAPH_MEMORY_PLAN_H_
+#define YACCS_GRAPH_MEMORY_PLAN_H_
+
+#include "yaccs/graph/graph.hpp"
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+/**
+ * @brief Placement of one intermediate tensor. first and last are positions in the
+ * topological order, the tensor is alive from its producer to its last consumer.
+ */
+struct MemorySlot
+{
+    int value_id;
+    int first;
+    int last;
+    size_t offset;  // bytes from the start of the arena
+    size_t size;    // bytes
+}; // struct MemorySlot
+
+struct MemoryPlan
+{
+    std::vector<MemorySlot> slots;
+    size_t arena_size;  // peak activation footprint
+    size_t total_size;  // footprint without reuse
+    int num_dynamic;    // dynamic shaped intermediates left out of the arena
+}; // struct MemoryPlan
+
+/**
+ * @brief Assign every static shaped intermediate value of the graph an offset in a single arena.
+ * Values whose lifetimes do not overlap may share memory. Greedy: the largest tensors
+ * are placed first, each at the lowest offset free during its whole lifetime.
+ */
+MemoryPlan plan_memory(const Graph& graph, size_t alignment=16);
+
+std::ostream& operator<<(std::ostream& os, const MemoryPlan& plan);
+
+#endif // YACCS_GRAPH_MEMORY_PLAN_H_
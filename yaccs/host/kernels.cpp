@@ -0,0 +1,530 @@
+#include "yaccs/host/kernels.hpp"
+#include "yaccs/dtype.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <endian.h>
+
+#if defined(__x86_64__)
+#define HOST_X86
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define HOST_NEON
+#include <arm_neon.h>
+#endif
+
+// AVX2 kernels are compiled for their own target and only called after the runtime check
+#define TARGET_AVX2 __attribute__((target("avx2,f16c")))
+
+// edge of the square blocks a transpose copies at a time, see tensor.cpp
+#define TRANSPOSE_BLOCK 32
+
+// x / scale is clamped to this before it is converted to an integer, far outside of the
+// int8 range so saturation is unchanged, and NaN lands on the upper end
+#define QUANTIZE_LIMIT 1024.0f
+
+
+namespace {
+
+float load_f32(const char* src)
+{
+    uint32_t raw;
+    memcpy(&raw, src, sizeof(raw));
+    raw = le32toh(raw);
+    float v;
+    memcpy(&v, &raw, sizeof(v));
+    return v;
+}
+
+void store_f32(char* dst, float v)
+{
+    uint32_t raw;
+    memcpy(&raw, &v, sizeof(raw));
+    raw = htole32(raw);
+    memcpy(dst, &raw, sizeof(raw));
+}
+
+void store_u16(char* dst, uint16_t v)
+{
+    v = htole16(v);
+    memcpy(dst, &v, sizeof(v));
+}
+
+int8_t quantize_scalar(float x, float scale, int zero_point)
+{
+    // the comparisons are the ones of the vector min and max, NaN goes to the limit
+    float q{x / scale};
+    q = q < QUANTIZE_LIMIT ? q : QUANTIZE_LIMIT;
+    q = q > -QUANTIZE_LIMIT ? q : -QUANTIZE_LIMIT;
+    const int v{static_cast<int>(std::nearbyint(q)) + zero_point};
+    return static_cast<int8_t>(std::min(std::max(v, -128), 127));
+}
+
+// rows [r0, r1) and cols [c0, c1) of src
+void transpose_tile_scalar(const char* src, char* dst, uint32_t rows, uint32_t cols,
+    uint32_t r0, uint32_t r1, uint32_t c0, uint32_t c1)
+{
+    for (uint32_t c = c0; c < c1; ++c) {
+        for (uint32_t r = r0; r < r1; ++r) {
+            memcpy(dst + (static_cast<size_t>(c) * rows + r) * DT_FLOAT_BYTES,
+                src + (static_cast<size_t>(r) * cols + c) * DT_FLOAT_BYTES, DT_FLOAT_BYTES);
+        }
+    }
+}
+
+#ifdef HOST_X86
+
+const float* f32_ptr(const char* base, size_t i)
+{
+    return reinterpret_cast<const float*>(base + i * DT_FLOAT_BYTES);
+}
+
+float* f32_ptr(char* base, size_t i)
+{
+    return reinterpret_cast<float*>(base + i * DT_FLOAT_BYTES);
+}
+
+/*
+ * Vector kernels process the longest prefix that fills their vectors and return its
+ * length, the caller finishes the tail with the scalar code.
+ */
+
+size_t scale_sse2(const char* src, char* dst, size_t n, float factor)
+{
+    const __m128 f{_mm_set1_ps(factor)};
+    size_t i{0};
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(f32_ptr(dst, i), _mm_mul_ps(_mm_loadu_ps(f32_ptr(src, i)), f));
+    }
+    return i;
+}
+
+TARGET_AVX2 size_t scale_avx2(const char* src, char* dst, size_t n, float factor)
+{
+    const __m256 f{_mm256_set1_ps(factor)};
+    size_t i{0};
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(f32_ptr(dst, i), _mm256_mul_ps(_mm256_loadu_ps(f32_ptr(src, i)), f));
+    }
+    return i;
+}
+
+void transpose_tile_sse2(const char* src, char* dst, uint32_t rows, uint32_t cols,
+    uint32_t r0, uint32_t r1, uint32_t c0, uint32_t c1)
+{
+    const uint32_t r_end{r0 + (r1 - r0) / 4 * 4};
+    const uint32_t c_end{c0 + (c1 - c0) / 4 * 4};
+    for (uint32_t c = c0; c < c_end; c += 4) {
+        for (uint32_t r = r0; r < r_end; r += 4) {
+            const size_t s{static_cast<size_t>(r) * cols + c};
+            __m128 x0{_mm_loadu_ps(f32_ptr(src, s))};
+            __m128 x1{_mm_loadu_ps(f32_ptr(src, s + cols))};
+            __m128 x2{_mm_loadu_ps(f32_ptr(src, s + 2 * cols))};
+            __m128 x3{_mm_loadu_ps(f32_ptr(src, s + 3 * cols))};
+            _MM_TRANSPOSE4_PS(x0, x1, x2, x3);
+            const size_t d{static_cast<size_t>(c) * rows + r};
+            _mm_storeu_ps(f32_ptr(dst, d), x0);
+            _mm_storeu_ps(f32_ptr(dst, d + rows), x1);
+            _mm_storeu_ps(f32_ptr(dst, d + 2 * rows), x2);
+            _mm_storeu_ps(f32_ptr(dst, d + 3 * rows), x3);
+        }
+    }
+    transpose_tile_scalar(src, dst, rows, cols, r0, r_end, c_end, c1);
+    transpose_tile_scalar(src, dst, rows, cols, r_end, r1, c0, c1);
+}
+
+TARGET_AVX2 void transpose_tile_avx2(const char* src, char* dst, uint32_t rows, uint32_t cols,
+    uint32_t r0, uint32_t r1, uint32_t c0, uint32_t c1)
+{
+    const uint32_t r_end{r0 + (r1 - r0) / 8 * 8};
+    const uint32_t c_end{c0 + (c1 - c0) / 8 * 8};
+    for (uint32_t c = c0; c < c_end; c += 8) {
+        for (uint32_t r = r0; r < r_end; r += 8) {
+            const size_t s{static_cast<size_t>(r) * cols + c};
+            const __m256 x0{_mm256_loadu_ps(f32_ptr(src, s))};
+            const __m256 x1{_mm256_loadu_ps(f32_ptr(src, s + cols))};
+            const __m256 x2{_mm256_loadu_ps(f32_ptr(src, s + 2 * cols))};
+            const __m256 x3{_mm256_loadu_ps(f32_ptr(src, s + 3 * cols))};
+            const __m256 x4{_mm256_loadu_ps(f32_ptr(src, s + 4 * cols))};
+            const __m256 x5{_mm256_loadu_ps(f32_ptr(src, s + 5 * cols))};
+            const __m256 x6{_mm256_loadu_ps(f32_ptr(src, s + 6 * cols))};
+            const __m256 x7{_mm256_loadu_ps(f32_ptr(src, s + 7 * cols))};
+            // interleave pairs of rows, then pairs of pairs, then swap the 128 bit halves
+            const __m256 t0{_mm256_unpacklo_ps(x0, x1)};
+            const __m256 t1{_mm256_unpackhi_ps(x0, x1)};
+            const __m256 t2{_mm256_unpacklo_ps(x2, x3)};
+            const __m256 t3{_mm256_unpackhi_ps(x2, x3)};
+            const __m256 t4{_mm256_unpacklo_ps(x4, x5)};
+            const __m256 t5{_mm256_unpackhi_ps(x4, x5)};
+            const __m256 t6{_mm256_unpacklo_ps(x6, x7)};
+            const __m256 t7{_mm256_unpackhi_ps(x6, x7)};
+            const __m256 u0{_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0))};
+            const __m256 u1{_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2))};
+            const __m256 u2{_mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0))};
+            const __m256 u3{_mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2))};
+            const __m256 u4{_mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0))};
+            const __m256 u5{_mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2))};
+            const __m256 u6{_mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0))};
+            const __m256 u7{_mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2))};
+            const size_t d{static_cast<size_t>(c) * rows + r};
+            _mm256_storeu_ps(f32_ptr(dst, d), _mm256_permute2f128_ps(u0, u4, 0x20));
+            _mm256_storeu_ps(f32_ptr(dst, d + rows), _mm256_permute2f128_ps(u1, u5, 0x20));
+            _mm256_storeu_ps(f32_ptr(dst, d + 2 * rows), _mm256_permute2f128_ps(u2, u6, 0x20));
+            _mm256_storeu_ps(f32_ptr(dst, d + 3 * rows), _mm256_permute2f128_ps(u3, u7, 0x20));
+            _mm256_storeu_ps(f32_ptr(dst, d + 4 * rows), _mm256_permute2f128_ps(u0, u4, 0x31));
+            _mm256_storeu_ps(f32_ptr(dst, d + 5 * rows), _mm256_permute2f128_ps(u1, u5, 0x31));
+            _mm256_storeu_ps(f32_ptr(dst, d + 6 * rows), _mm256_permute2f128_ps(u2, u6, 0x31));
+            _mm256_storeu_ps(f32_ptr(dst, d + 7 * rows), _mm256_permute2f128_ps(u3, u7, 0x31));
+        }
+    }
+    transpose_tile_scalar(src, dst, rows, cols, r0, r_end, c_end, c1);
+    transpose_tile_scalar(src, dst, rows, cols, r_end, r1, c0, c1);
+}
+
+TARGET_AVX2 size_t convert_f16_avx2(const char* src, char* dst, size_t n)
+{
+    size_t i{0};
+    for (; i + 8 <= n; i += 8) {
+        const __m128i h{_mm256_cvtps_ph(_mm256_loadu_ps(f32_ptr(src, i)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)};
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * DT_FLOAT16_BYTES), h);
+    }
+    return i;
+}
+
+// bits rounded so the upper 16 are the bfloat16, sign extended for a saturating pack
+__m128i bf16_bits_sse2(__m128i x)
+{
+    const __m128i abs{_mm_and_si128(x, _mm_set1_epi32(0x7fffffff))};
+    const __m128i is_nan{_mm_cmpgt_epi32(abs, _mm_set1_epi32(0x7f800000))};
+    const __m128i lsb{_mm_and_si128(_mm_srli_epi32(x, 16), _mm_set1_epi32(1))};
+    const __m128i rounded{_mm_add_epi32(x, _mm_add_epi32(lsb, _mm_set1_epi32(0x7fff)))};
+    const __m128i quiet{_mm_or_si128(x, _mm_set1_epi32(0x400000))};
+    const __m128i bits{_mm_or_si128(_mm_and_si128(is_nan, quiet), _mm_andnot_si128(is_nan, rounded))};
+    return _mm_srai_epi32(bits, 16);
+}
+
+size_t convert_bf16_sse2(const char* src, char* dst, size_t n)
+{
+    size_t i{0};
+    for (; i + 8 <= n; i += 8) {
+        const __m128i lo{bf16_bits_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(f32_ptr(src, i))))};
+        const __m128i hi{bf16_bits_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(f32_ptr(src, i + 4))))};
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * DT_BFLOAT16_BYTES), _mm_packs_epi32(lo, hi));
+    }
+    return i;
+}
+
+TARGET_AVX2 size_t convert_bf16_avx2(const char* src, char* dst, size_t n)
+{
+    const __m256i abs_mask{_mm256_set1_epi32(0x7fffffff)};
+    const __m256i inf{_mm256_set1_epi32(0x7f800000)};
+    const __m256i one{_mm256_set1_epi32(1)};
+    const __m256i half{_mm256_set1_epi32(0x7fff)};
+    const __m256i quiet_bit{_mm256_set1_epi32(0x400000)};
+    size_t i{0};
+    for (; i + 8 <= n; i += 8) {
+        const __m256i x{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(f32_ptr(src, i)))};
+        const __m256i is_nan{_mm256_cmpgt_epi32(_mm256_and_si256(x, abs_mask), inf)};
+        const __m256i lsb{_mm256_and_si256(_mm256_srli_epi32(x, 16), one)};
+        const __m256i rounded{_mm256_add_epi32(x, _mm256_add_epi32(lsb, half))};
+        const __m256i bits{_mm256_srai_epi32(
+            _mm256_blendv_epi8(rounded, _mm256_or_si256(x, quiet_bit), is_nan), 16)};
+        const __m128i packed{_mm_packs_epi32(_mm256_castsi256_si128(bits), _mm256_extracti128_si256(bits, 1))};
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * DT_BFLOAT16_BYTES), packed);
+    }
+    return i;
+}
+
+__m128i quantize_i32_sse2(const char* src, __m128 scale, __m128i zero_point)
+{
+    __m128 q{_mm_div_ps(_mm_loadu_ps(reinterpret_cast<const float*>(src)), scale)};
+    q = _mm_max_ps(_mm_min_ps(q, _mm_set1_ps(QUANTIZE_LIMIT)), _mm_set1_ps(-QUANTIZE_LIMIT));
+    // rounds to nearest even under the default MXCSR
+    return _mm_add_epi32(_mm_cvtps_epi32(q), zero_point);
+}
+
+size_t quantize_sse2(const char* src, char* dst, size_t n, float scale, int zero_point)
+{
+    const __m128 s{_mm_set1_ps(scale)};
+    const __m128i zp{_mm_set1_epi32(zero_point)};
+    size_t i{0};
+    for (; i + 16 <= n; i += 16) {
+        const __m128i a{_mm_packs_epi32(quantize_i32_sse2(src + i * DT_FLOAT_BYTES, s, zp),
+            quantize_i32_sse2(src + (i + 4) * DT_FLOAT_BYTES, s, zp))};
+        const __m128i b{_mm_packs_epi32(quantize_i32_sse2(src + (i + 8) * DT_FLOAT_BYTES, s, zp),
+            quantize_i32_sse2(src + (i + 12) * DT_FLOAT_BYTES, s, zp))};
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi16(a, b));
+    }
+    return i;
+}
+
+TARGET_AVX2 __m256i quantize_i32_avx2(const char* src, __m256 scale, __m256i zero_point)
+{
+    __m256 q{_mm256_div_ps(_mm256_loadu_ps(reinterpret_cast<const float*>(src)), scale)};
+    q = _mm256_max_ps(_mm256_min_ps(q, _mm256_set1_ps(QUANTIZE_LIMIT)), _mm256_set1_ps(-QUANTIZE_LIMIT));
+    return _mm256_add_epi32(_mm256_cvtps_epi32(q), zero_point);
+}
+
+TARGET_AVX2 size_t quantize_avx2(const char* src, char* dst, size_t n, float scale, int zero_point)
+{
+    const __m256 s{_mm256_set1_ps(scale)};
+    const __m256i zp{_mm256_set1_epi32(zero_point)};
+    size_t i{0};
+    for (; i + 16 <= n; i += 16) {
+        // the pack works within 128 bit lanes, the permute puts the quads back in order
+        const __m256i words{_mm256_permute4x64_epi64(
+            _mm256_packs_epi32(quantize_i32_avx2(src + i * DT_FLOAT_BYTES, s, zp),
+                quantize_i32_avx2(src + (i + 8) * DT_FLOAT_BYTES, s, zp)), _MM_SHUFFLE(3, 1, 2, 0))};
+        const __m128i bytes{_mm_packs_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1))};
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), bytes);
+    }
+    return i;
+}
+
+#endif // HOST_X86
+
+#ifdef HOST_NEON
+
+float32x4_t load_f32x4(const char* src)
+{
+    return vreinterpretq_f32_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(src)));
+}
+
+void store_f32x4(char* dst, float32x4_t v)
+{
+    vst1q_u8(reinterpret_cast<uint8_t*>(dst), vreinterpretq_u8_f32(v));
+}
+
+size_t scale_neon(const char* src, char* dst, size_t n, float factor)
+{
+    size_t i{0};
+    for (; i + 4 <= n; i += 4) {
+        store_f32x4(dst + i * DT_FLOAT_BYTES, vmulq_n_f32(load_f32x4(src + i * DT_FLOAT_BYTES), factor));
+    }
+    return i;
+}
+
+void transpose_tile_neon(const char* src, char* dst, uint32_t rows, uint32_t cols,
+    uint32_t r0, uint32_t r1, uint32_t c0, uint32_t c1)
+{
+    const uint32_t r_end{r0 + (r1 - r0) / 4 * 4};
+    const uint32_t c_end{c0 + (c1 - c0) / 4 * 4};
+    for (uint32_t c = c0; c < c_end; c += 4) {
+        for (uint32_t r = r0; r < r_end; r += 4) {
+            const size_t s{static_cast<size_t>(r) * cols + c};
+            const float32x4x2_t t01{vtrnq_f32(load_f32x4(src + s * DT_FLOAT_BYTES),
+                load_f32x4(src + (s + cols) * DT_FLOAT_BYTES))};
+            const float32x4x2_t t23{vtrnq_f32(load_f32x4(src + (s + 2 * cols) * DT_FLOAT_BYTES),
+                load_f32x4(src + (s + 3 * cols) * DT_FLOAT_BYTES))};
+            const size_t d{static_cast<size_t>(c) * rows + r};
+            store_f32x4(dst + d * DT_FLOAT_BYTES,
+                vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0])));
+            store_f32x4(dst + (d + rows) * DT_FLOAT_BYTES,
+                vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1])));
+            store_f32x4(dst + (d + 2 * rows) * DT_FLOAT_BYTES,
+                vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0])));
+            store_f32x4(dst + (d + 3 * rows) * DT_FLOAT_BYTES,
+                vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1])));
+        }
+    }
+    transpose_tile_scalar(src, dst, rows, cols, r0, r_end, c_end, c1);
+    transpose_tile_scalar(src, dst, rows, cols, r_end, r1, c0, c1);
+}
+
+size_t convert_f16_neon(const char* src, char* dst, size_t n)
+{
+    size_t i{0};
+    for (; i + 4 <= n; i += 4) {
+        // rounds to nearest even under the default FPCR
+        const float16x4_t h{vcvt_f16_f32(load_f32x4(src + i * DT_FLOAT_BYTES))};
+        vst1_u8(reinterpret_cast<uint8_t*>(dst + i * DT_FLOAT16_BYTES), vreinterpret_u8_f16(h));
+    }
+    return i;
+}
+
+size_t convert_bf16_neon(const char* src, char* dst, size_t n)
+{
+    size_t i{0};
+    for (; i + 4 <= n; i += 4) {
+        const uint32x4_t x{vreinterpretq_u32_f32(load_f32x4(src + i * DT_FLOAT_BYTES))};
+        const uint32x4_t is_nan{vcgtq_u32(vandq_u32(x, vdupq_n_u32(0x7fffffff)), vdupq_n_u32(0x7f800000))};
+        const uint32x4_t lsb{vandq_u32(vshrq_n_u32(x, 16), vdupq_n_u32(1))};
+        const uint32x4_t rounded{vaddq_u32(x, vaddq_u32(lsb, vdupq_n_u32(0x7fff)))};
+        const uint32x4_t bits{vbslq_u32(is_nan, vorrq_u32(x, vdupq_n_u32(0x400000)), rounded)};
+        vst1_u8(reinterpret_cast<uint8_t*>(dst + i * DT_BFLOAT16_BYTES), vreinterpret_u8_u16(vshrn_n_u32(bits, 16)));
+    }
+    return i;
+}
+
+int32x4_t quantize_i32_neon(const char* src, float32x4_t scale, int32x4_t zero_point)
+{
+    const float32x4_t limit{vdupq_n_f32(QUANTIZE_LIMIT)};
+    const float32x4_t neg_limit{vdupq_n_f32(-QUANTIZE_LIMIT)};
+    float32x4_t q{vdivq_f32(load_f32x4(src), scale)};
+    // selects, not vminq, so NaN goes to the limit as on the other paths
+    q = vbslq_f32(vcltq_f32(q, limit), q, limit);
+    q = vbslq_f32(vcgtq_f32(q, neg_limit), q, neg_limit);
+    return vaddq_s32(vcvtnq_s32_f32(q), zero_point);
+}
+
+size_t quantize_neon(const char* src, char* dst, size_t n, float scale, int zero_point)
+{
+    const float32x4_t s{vdupq_n_f32(scale)};
+    const int32x4_t zp{vdupq_n_s32(zero_point)};
+    size_t i{0};
+    for (; i + 8 <= n; i += 8) {
+        const int16x8_t words{vcombine_s16(vqmovn_s32(quantize_i32_neon(src + i * DT_FLOAT_BYTES, s, zp)),
+            vqmovn_s32(quantize_i32_neon(src + (i + 4) * DT_FLOAT_BYTES, s, zp)))};
+        vst1_s8(reinterpret_cast<int8_t*>(dst + i), vqmovn_s16(words));
+    }
+    return i;
+}
+
+#endif // HOST_NEON
+
+SimdLevel detect_simd_level()
+{
+#if defined(HOST_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")) {
+        return SIMD_AVX2;
+    }
+    return SIMD_SSE2;
+#elif defined(HOST_NEON)
+    return SIMD_NEON;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+} // namespace
+
+
+SimdLevel host_simd_level()
+{
+    static const SimdLevel level{detect_simd_level()};
+    return level;
+}
+
+bool simd_supported(SimdLevel level)
+{
+    switch (level) {
+    case SIMD_SCALAR:   return true;
+#if defined(HOST_X86)
+    case SIMD_SSE2:     return true;
+    case SIMD_AVX2:     return host_simd_level() == SIMD_AVX2;
+#elif defined(HOST_NEON)
+    case SIMD_NEON:     return true;
+#endif
+    default:            return false;
+    }
+}
+
+const char* simd_level_name(SimdLevel level)
+{
+    switch (level) {
+    case SIMD_SCALAR:   return "scalar";
+    case SIMD_SSE2:     return "sse2";
+    case SIMD_AVX2:     return "avx2";
+    case SIMD_NEON:     return "neon";
+    default:            return "unknown";
+    }
+}
+
+void scale_f32(const char* src, char* dst, size_t n, float factor, SimdLevel level)
+{
+    assert(simd_supported(level) && "SIMD level not supported by the host");
+
+    size_t i{0};
+    switch (level) {
+#if defined(HOST_X86)
+    case SIMD_SSE2:     i = scale_sse2(src, dst, n, factor); break;
+    case SIMD_AVX2:     i = scale_avx2(src, dst, n, factor); break;
+#elif defined(HOST_NEON)
+    case SIMD_NEON:     i = scale_neon(src, dst, n, factor); break;
+#endif
+    default:            break;
+    }
+    for (; i < n; ++i) {
+        store_f32(dst + i * DT_FLOAT_BYTES, load_f32(src + i * DT_FLOAT_BYTES) * factor);
+    }
+}
+
+void transpose_f32(const char* src, char* dst, uint32_t rows, uint32_t cols, SimdLevel level)
+{
+    assert(simd_supported(level) && "SIMD level not supported by the host");
+
+    for (uint32_t r0 = 0; r0 < rows; r0 += TRANSPOSE_BLOCK) {
+        const uint32_t r1{std::min(rows, r0 + TRANSPOSE_BLOCK)};
+        for (uint32_t c0 = 0; c0 < cols; c0 += TRANSPOSE_BLOCK) {
+            const uint32_t c1{std::min(cols, c0 + TRANSPOSE_BLOCK)};
+            switch (level) {
+#if defined(HOST_X86)
+            case SIMD_SSE2: transpose_tile_sse2(src, dst, rows, cols, r0, r1, c0, c1); break;
+            case SIMD_AVX2: transpose_tile_avx2(src, dst, rows, cols, r0, r1, c0, c1); break;
+#elif defined(HOST_NEON)
+            case SIMD_NEON: transpose_tile_neon(src, dst, rows, cols, r0, r1, c0, c1); break;
+#endif
+            default:        transpose_tile_scalar(src, dst, rows, cols, r0, r1, c0, c1); break;
+            }
+        }
+    }
+}
+
+void convert_f32_to_f16(const char* src, char* dst, size_t n, SimdLevel level)
+{
+    assert(simd_supported(level) && "SIMD level not supported by the host");
+
+    // SSE2 has no conversion, F16C comes with AVX2
+    size_t i{0};
+    switch (level) {
+#if defined(HOST_X86)
+    case SIMD_AVX2:     i = convert_f16_avx2(src, dst, n); break;
+#elif defined(HOST_NEON)
+    case SIMD_NEON:     i = convert_f16_neon(src, dst, n); break;
+#endif
+    default:            break;
+    }
+    for (; i < n; ++i) {
+        store_u16(dst + i * DT_FLOAT16_BYTES, float_to_half(load_f32(src + i * DT_FLOAT_BYTES)));
+    }
+}
+
+void convert_f32_to_bf16(const char* src, char* dst, size_t n, SimdLevel level)
+{
+    assert(simd_supported(level) && "SIMD level not supported by the host");
+
+    size_t i{0};
+    switch (level) {
+#if defined(HOST_X86)
+    case SIMD_SSE2:     i = convert_bf16_sse2(src, dst, n); break;
+    case SIMD_AVX2:     i = convert_bf16_avx2(src, dst, n); break;
+#elif defined(HOST_NEON)
+    case SIMD_NEON:     i = convert_bf16_neon(src, dst, n); break;
+#endif
+    default:            break;
+    }
+    for (; i < n; ++i) {
+        store_u16(dst + i * DT_BFLOAT16_BYTES, float_to_bfloat16(load_f32(src + i * DT_FLOAT_BYTES)));
+    }
+}
+
+void quantize_f32_to_i8(const char* src, char* dst, size_t n, float scale, int zero_point, SimdLevel level)
+{
+    assert(simd_supported(level) && "SIMD level not supported by the host");
+
+    size_t i{0};
+    switch (level) {
+#if defined(HOST_X86)
+    case SIMD_SSE2:     i = quantize_sse2(src, dst, n, scale, zero_point); break;
+    case SIMD_AVX2:     i = quantize_avx2(src, dst, n, scale, zero_point); break;
+#elif defined(HOST_NEON)
+    case SIMD_NEON:     i = quantize_neon(src, dst, n, scale, zero_point); break;
+#endif
+    default:            break;
+    }
+    for (; i < n; ++i) {
+        dst[i] = static_cast<char>(quantize_scalar(load_f32(src + i * DT_FLOAT_BYTES), scale, zero_point));
+    }
+}
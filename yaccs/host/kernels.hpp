@@ -0,0 +1,42 @@
+#ifndef YACCS_HOST_KERNELS_H_
+#define YACCS_HOST_KERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Instruction sets the host kernels are written for. SSE2 and NEON are the
+ * baseline of x86-64 and AArch64, AVX2 (with F16C) is detected at runtime, so one
+ * binary runs the widest kernels of the machine it is on.
+ */
+enum SimdLevel
+{
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2,
+    SIMD_NEON,
+}; // enum SimdLevel
+
+// widest level of this host, detected once
+SimdLevel host_simd_level();
+bool simd_supported(SimdLevel level);
+const char* simd_level_name(SimdLevel level);
+
+/*
+ * Kernels over tensor buffers. Elements are little endian and the buffers need no
+ * alignment. The level defaults to the widest one of the host, a lower level gives the
+ * same result, except for the payload of NaNs, and is there for benchmarks and checks.
+ */
+
+// dst[i] = src[i] * factor, dst may be src
+void scale_f32(const char* src, char* dst, size_t n, float factor, SimdLevel level=host_simd_level());
+// src is rows x cols, dst its cols x rows transpose, both row major
+void transpose_f32(const char* src, char* dst, uint32_t rows, uint32_t cols, SimdLevel level=host_simd_level());
+// rounded to nearest even, out of range values become infinity
+void convert_f32_to_f16(const char* src, char* dst, size_t n, SimdLevel level=host_simd_level());
+void convert_f32_to_bf16(const char* src, char* dst, size_t n, SimdLevel level=host_simd_level());
+// saturate(round(src[i] / scale) + zero_point), rounded to nearest even, as QuantizeLinear
+void quantize_f32_to_i8(const char* src, char* dst, size_t n, float scale, int zero_point,
+    SimdLevel level=host_simd_level());
+
+#endif // YACCS_HOST_KERNELS_H_
@@ -1,13 +1,18 @@
 #include "yaccs/baker/layer3/layer3.hpp"
+#include "yaccs/graph/fusion.hpp"
+#include "yaccs/graph/graph.hpp"
+#include "yaccs/graph/memory_plan.hpp"
 #include "yaccs/utils.hpp"
 #include "yaccs/onnx/ops.hpp"
 #include "yaccs/onnx/parser.hpp"
+#include "yaccs/tuning/tuning_cache.hpp"
 #include <iostream>
 #include <onnx.pb.h>
 #include <unordered_map>
 #include <cassert>
+#include <cstdio>
 #include <cstdlib>
-#include <fstream>
+#include <sstream>
 #include <string>
 
 #define FLAGS_IMPLEMENTATION
@@ -19,6 +24,25 @@ int main(int argc, char** argv)
     Flags::parse(argc, argv)
         ->with_arg<std::string>("output", 'o', "a.spv", "The output spv filename")
         ->with_opt("S", 'S', "Compile only, not assemble")
+        ->with_arg<std::string>("weights", 'w', "",
+            "Place initializers in a storage buffer (set 0, binding 1) and write them to this file")
+        ->with_opt("no-fusion", 'F', "Do not fuse Relu into the preceding Gemm")
+        ->with_opt("multi-dispatch", 'm',
+            "Keep intermediates in storage buffers (set 2) and emit one entry point per layer")
+        ->with_opt("no-subgroup", 'G',
+            "Reduce through a workgroup memory tree instead of subgroup operations, needs a power of two local size")
+        ->with_opt("dynamic-batch", 'd', "Leave batch_size symbolic and read it at runtime, needs -m")
+        ->with_arg<std::string>("gemm-tile", 't', "",
+            "Use the tiled Gemm kernel, tile given as <micro_m>x<micro_n>x<tile_k>, e.g. 2x2x8")
+        ->with_arg<std::string>("unroll", 'u', "1", "Unroll the K loop of the untiled Gemm kernels by this factor")
+        ->with_opt("fp16", 'H', "Convert float initializers to half precision, halves the weight size")
+        ->with_arg<std::string>("fp16-accumulate", 'A', "",
+            "Comma separated Gemm node names accumulating in half precision instead of float, * for all")
+        ->with_arg<std::string>("tuning-cache", 'c', "",
+            "Pick local size and Gemm tile from a cache written by yaccs_autotune")
+        ->with_arg<std::string>("jobs", 'j', "1", "Threads emitting the layer functions, the output does not depend on it")
+        ->with_opt("time-report", 'T', "Print the wall time spent in each compiler phase")
+        ->with_opt("stats", 's', "Print id, intern table, function and section size counters")
         ->set_help("Yaccs compiler");
 
     if (Flags::raw_params().empty()) {
@@ -32,65 +56,136 @@ int main(int argc, char** argv)
     std::string apv_filename{Flags::arg<std::string>("output")};
     std::cout << "Compiling " << onnx_filename << "\n";
 
+    PhaseTimer timer;
     onnx::ModelProto model;
-    std::ifstream ifs{onnx_filename, std::ios::in};
-    if (!ifs.is_open()) {
-        std::cerr << "Can not open file: " << onnx_filename << "\nFailed.\n";
+    if (!load_onnx_model(onnx_filename, model)) {
+        std::cerr << "Can not load model: " << onnx_filename << "\nFailed.\n";
         return 1;
     }
-    model.ParseFromIstream(&ifs);
-    ifs.close();
+    ExternalData external_data{extract_dirname(onnx_filename)};
+    timer.phase_done("parse");
 
-    std::unordered_map<std::string, int> input_dynamic_axes {
-        {"batch_size", 1}
-    };
-    std::unordered_map<std::string, int> output_dynamic_axes {
-        {"batch_size", 1}
-    };
+    std::unordered_map<std::string, int> dynamic_axes{};
+    if (Flags::opt("dynamic-batch")) {
+        if (!Flags::opt("multi-dispatch")) {
+            std::cerr << "Dynamic batch needs multi-dispatch mode (-m)\nFailed.\n";
+            return 1;
+        }
+    } else {
+        dynamic_axes.emplace("batch_size", 1);
+    }
+
+    std::string weights_filename{Flags::arg<std::string>("weights")};
 
     Layer3 program;
     program.set_name(apvasm_filename);
+    program.set_weights_in_buffer(!weights_filename.empty());
+    program.set_multi_dispatch(Flags::opt("multi-dispatch"));
+    program.set_fp16(Flags::opt("fp16"));
+    program.set_subgroup_ops(!Flags::opt("no-subgroup"));
+    std::stringstream fp16_accumulate{Flags::arg<std::string>("fp16-accumulate")};
+    for (std::string op_name; std::getline(fp16_accumulate, op_name, ',');) {
+        if (!op_name.empty()) {
+            program.add_fp16_accumulate(op_name);
+        }
+    }
 
-    // setup input
-    for (const auto& it : model.graph().input()) {
-        if (it.type().has_tensor_type()) {
-            TensorType tt{};
-            tt.name = it.name();
-            tensor_type_from_onnx(it.type().tensor_type(), tt, input_dynamic_axes);
-            program.add_input(tt);
+    std::string gemm_tile_str{Flags::arg<std::string>("gemm-tile")};
+    if (!gemm_tile_str.empty()) {
+        GemmTileDef gemm_tile{};
+        if (sscanf(gemm_tile_str.c_str(), "%dx%dx%d", &gemm_tile.micro_m,
+                &gemm_tile.micro_n, &gemm_tile.tile_k) != 3
+            || gemm_tile.micro_m <= 0 || gemm_tile.micro_n <= 0 || gemm_tile.tile_k <= 0) {
+            std::cerr << "Bad Gemm tile: " << gemm_tile_str << "\nFailed.\n";
+            return 1;
         }
+        GemmConfig config{.local_size_x = program.local_size_x(), .local_size_y = program.local_size_y(),
+            .tile = gemm_tile};
+        if (!config.valid()) {
+            std::cerr << "Bad Gemm tile: " << gemm_tile_str << ", tile_k must be a multiple of the local size "
+                << config.local_size_x << "x" << config.local_size_y << "\nFailed.\n";
+            return 1;
+        }
+        program.set_gemm_tile(gemm_tile);
+    }
+
+    std::string unroll_str{Flags::arg<std::string>("unroll")};
+    int unroll{};
+    if (sscanf(unroll_str.c_str(), "%d", &unroll) != 1 || unroll <= 0) {
+        std::cerr << "Bad unroll factor: " << unroll_str << "\nFailed.\n";
+        return 1;
+    }
+    program.set_unroll(unroll);
+
+    std::string jobs_str{Flags::arg<std::string>("jobs")};
+    int jobs{};
+    if (sscanf(jobs_str.c_str(), "%d", &jobs) != 1 || jobs <= 0) {
+        std::cerr << "Bad number of jobs: " << jobs_str << "\nFailed.\n";
+        return 1;
     }
+    program.set_threads(jobs);
 
-    // setup output
-    for (const auto& it : model.graph().output()) {
-        if (it.type().has_tensor_type()) {
-            TensorType tt{};
-            tt.name = it.name();
-            tensor_type_from_onnx(it.type().tensor_type(), tt, output_dynamic_axes);
-            program.add_output(tt);
+    TuningCache tuning_cache;
+    std::string tuning_cache_filename{Flags::arg<std::string>("tuning-cache")};
+    if (!tuning_cache_filename.empty()) {
+        if (!tuning_cache.load(tuning_cache_filename)) {
+            std::cerr << "Can not load tuning cache: " << tuning_cache_filename << "\nFailed.\n";
+            return 1;
+        }
+        for (const auto& it : tuning_cache.records()) {
+            if (!it.config.valid()) {
+                const auto& tile{it.config.tile};
+                std::cerr << "Bad Gemm tile: " << tile.micro_m << "x" << tile.micro_n << "x" << tile.tile_k
+                    << " at local size " << it.config.local_size_x << "x" << it.config.local_size_y
+                    << " in tuning cache " << tuning_cache_filename << "\nFailed.\n";
+                return 1;
+            }
         }
+        program.set_tuning_cache(&tuning_cache);
     }
 
-    for (const auto& node: model.graph().node()) {
-        if (node.op_type().compare("Gemm") == 0) {
-            OpGemm gemm;
-            gemm_from_onnx(node, model.graph(), gemm);
-            program.add_gemm(gemm);
-        } else if (node.op_type().compare("Relu") == 0) {
-            OpRelu relu;
-            relu_from_onnx(node, relu);
-            program.add_relu(relu);
-        } else {
-            assert(false && "Not supportted operator");
+    timer.restart();
+    Graph graph;
+    graph_from_onnx(model.graph(), graph, dynamic_axes, &external_data);
+    timer.phase_done("frontend");
+
+    // Layer3 has no standalone QuantizeLinear/DequantizeLinear, always fold them
+    fuse_qdq_gemm(graph);
+    for (size_t i = 0; i < graph.num_nodes(); ++i) {
+        const auto& node{graph.node(i)};
+        if (!node.dead && (node.op_type == OT_QUANTIZE_LINEAR || node.op_type == OT_DEQUANTIZE_LINEAR)) {
+            std::cerr << "Can not fold " << (node.op_type == OT_QUANTIZE_LINEAR ? "QuantizeLinear" : "DequantizeLinear")
+                << " " << node.name << " into a Gemm\nFailed.\n";
+            return 1;
         }
     }
+    if (!Flags::opt("no-fusion")) {
+        fuse_gemm_relu(graph);
+    }
+    MemoryPlan memory_plan{plan_memory(graph)};
+    std::cout << memory_plan << "\n";
+    timer.phase_done("passes");
 
+    program.add_graph(graph, &memory_plan);
     program.set_main();
-    program.dump_ir();
+    timer.phase_done("bake");
 
-    if (!Flags::opt("S")) {
-        invoke_spirv_as(apvasm_filename, apv_filename);
-        remove_file(apvasm_filename);
+    if (Flags::opt("S")) {
+        program.dump_ir();
+    } else {
+        program.dump_spv(apv_filename);
+    }
+
+    if (!weights_filename.empty()) {
+        program.dump_weights(weights_filename);
+    }
+    timer.phase_done("emit");
+
+    if (Flags::opt("time-report")) {
+        std::cout << timer;
+    }
+    if (Flags::opt("stats")) {
+        program.dump_stats(std::cout);
     }
     return 0;
 }
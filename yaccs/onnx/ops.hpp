@@ -2,9 +2,34 @@
 #define YACCS_OPS_H_
 
 #include "yaccs/tensor.hpp"
+#include <vector>
 
 struct Op {};
 
+/**
+ * @brief Int8 quantization of a Gemm, folded from QuantizeLinear/DequantizeLinear
+ * nodes by the QDQ fusion pass. real = scale * (q - zero_point).
+ *
+ * A stays in float and is quantized on load, B holds the quantized weights, the
+ * products accumulate in int32.
+ */
+struct GemmQuantDef
+{
+    bool enabled{false};
+    float a_scale{1.0f};
+    int a_zero_point{0};
+    int a_qmin{0};
+    int a_qmax{255};
+    std::vector<float> b_scale;     // a single scale or one per output column
+    int b_zero_point{0};
+    // Y goes through a QuantizeLinear/DequantizeLinear pair in the epilogue
+    bool requantize{false};
+    float y_scale{1.0f};
+    int y_zero_point{0};
+    int y_qmin{0};
+    int y_qmax{255};
+}; // struct GemmQuantDef
+
 
 /**
  * @brief Gemm Operator definition
@@ -23,6 +48,8 @@ struct OpGemm: public Op
     Tensor B;
     Tensor C;
     Tensor Y;
+    bool fused_relu{false};  // Relu applied as epilogue, set by the fusion pass
+    GemmQuantDef quant;
 }; // struct OpGemm
 
 /**
@@ -38,4 +65,65 @@ struct OpRelu: public Op
     Tensor Y;
 }; // struct OpRelu
 
+/**
+ * @brief ReduceSum, ReduceMean and ReduceMax Operator definition, told apart by op_type
+ *
+ * ref: https://onnx.ai/onnx/operators/onnx__ReduceSum.html
+ */
+struct OpReduce: public Op
+{
+    std::string name;
+    std::string op_type;
+    std::vector<int> axes;  // non-negative, sorted
+    int keepdims;
+    Tensor X;
+    Tensor Y;
+}; // struct OpReduce
+
+/**
+ * @brief Softmax Operator definition
+ *
+ * ref: https://onnx.ai/onnx/operators/onnx__Softmax.html
+ */
+struct OpSoftmax: public Op
+{
+    std::string name;
+    std::string op_type;
+    int axis;   // non-negative
+    Tensor X;
+    Tensor Y;
+}; // struct OpSoftmax
+
+/**
+ * @brief QuantizeLinear Operator definition, y = saturate(round(x / y_scale) + y_zero_point)
+ *
+ * ref: https://onnx.ai/onnx/operators/onnx__QuantizeLinear.html
+ */
+struct OpQuantizeLinear: public Op
+{
+    std::string name;
+    std::string op_type;
+    int axis;
+    Tensor X;
+    Tensor scale;
+    Tensor zero_point;  // no data when omitted, y is uint8 then
+    Tensor Y;
+}; // struct OpQuantizeLinear
+
+/**
+ * @brief DequantizeLinear Operator definition, y = (x - x_zero_point) * x_scale
+ *
+ * ref: https://onnx.ai/onnx/operators/onnx__DequantizeLinear.html
+ */
+struct OpDequantizeLinear: public Op
+{
+    std::string name;
+    std::string op_type;
+    int axis;
+    Tensor X;
+    Tensor scale;
+    Tensor zero_point;  // no data when omitted
+    Tensor Y;
+}; // struct OpDequantizeLinear
+
 #endif // YACCS_OPS_H_
@@ -1,6 +1,10 @@
 #include "yaccs/onnx/parser.hpp"
 #include "yaccs/utils.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
 #include <mutex>
+#include <sys/mman.h>
 
 
 class TensorTypeMapper
@@ -54,11 +58,18 @@ void tensor_type_from_onnx(const onnx::TypeProto_Tensor& onnx_tensor, TensorType
     tensor_type.dims = onnx_tensor.shape().dim_size();
     tensor_type.dtype = static_cast<DType>(onnx_tensor.elem_type());
     tensor_type.row_major = true;
+    tensor_type.dynamic_dims = 0;
     for (int i = 0; i < tensor_type.dims; ++i) {
         const auto& dim{onnx_tensor.shape().dim().Get(i)};
         if (!dim.dim_param().empty()) {
-            assert(dynamic_axes.find(dim.dim_param()) != dynamic_axes.end() && "Input param not defined");
-            tensor_type.shape[i] = dynamic_axes.at(dim.dim_param());
+            auto axis{dynamic_axes.find(dim.dim_param())};
+            if (axis != dynamic_axes.end()) {
+                tensor_type.shape[i] = axis->second;
+            } else {
+                // unbound symbolic dim, resolved from the shape header at runtime
+                tensor_type.shape[i] = 1;
+                tensor_type.dynamic_dims |= 1u << i;
+            }
         } else {
             tensor_type.shape[i] = dim.dim_value();
         }
@@ -66,7 +77,64 @@ void tensor_type_from_onnx(const onnx::TypeProto_Tensor& onnx_tensor, TensorType
     TensorTypeMapper::instance()->insert(tensor_type);
 }
 
-void tensor_from_onnx(const onnx::TensorProto& pb_tensor, Tensor* tensor)
+ExternalData::ExternalData(const std::string& base_dir)
+    : base_dir_(base_dir)
+{
+}
+
+bool ExternalData::read(const onnx::TensorProto& pb_tensor, TensorData& data)
+{
+    std::string location;
+    size_t offset{0};
+    size_t length{SIZE_MAX};
+    for (const auto& it : pb_tensor.external_data()) {
+        if (it.key().compare("location") == 0) {
+            location = it.value();
+        } else if (it.key().compare("offset") == 0) {
+            offset = std::stoull(it.value());
+        } else if (it.key().compare("length") == 0) {
+            length = std::stoull(it.value());
+        }
+    }
+    if (location.empty()) {
+        return false;
+    }
+
+    auto found{files_.find(location)};
+    if (found == files_.end()) {
+        auto file{MappedFile::open(location.front() == '/' ? location : base_dir_ + "/" + location)};
+        if (!file) {
+            return false;
+        }
+        found = files_.emplace(location, std::move(file)).first;
+    }
+
+    const auto& file{found->second};
+    if (offset > file->size()) {
+        return false;
+    }
+    if (length == SIZE_MAX) {
+        length = file->size() - offset;
+    }
+    if (length > file->size() - offset) {
+        return false;
+    }
+    // the view keeps the file mapped
+    data = TensorData::view(file->data() + offset, length, file);
+    return true;
+}
+
+bool load_onnx_model(const std::string& filename, onnx::ModelProto& model)
+{
+    auto file{MappedFile::open(filename)};
+    if (!file || file->size() > INT_MAX) {
+        return false;
+    }
+    madvise(const_cast<char*>(file->data()), file->size(), MADV_SEQUENTIAL);
+    return model.ParseFromArray(file->data(), static_cast<int>(file->size()));
+}
+
+void tensor_from_onnx(const onnx::TensorProto& pb_tensor, Tensor* tensor, ExternalData* external_data)
 {
     tensor->tt.name = pb_tensor.name();
     tensor->tt.dtype = static_cast<DType>(pb_tensor.data_type());
@@ -76,11 +144,19 @@ void tensor_from_onnx(const onnx::TensorProto& pb_tensor, Tensor* tensor)
         tensor->tt.shape[i] = pb_tensor.dims().at(i);
     }
     TensorTypeMapper::instance()->insert(tensor->tt);
-    tensor->data.resize(pb_tensor.raw_data().size());
-    memcpy(tensor->data.data(), pb_tensor.raw_data().data(), tensor->data.size());
+    if (pb_tensor.data_location() == onnx::TensorProto_DataLocation_EXTERNAL) {
+        assert(external_data != nullptr && "External data needs the model directory");
+        if (!external_data->read(pb_tensor, tensor->data)) {
+            std::cerr << "Can not read external data of " << pb_tensor.name() << "\n";
+            assert(false && "Bad external data");
+        }
+        return;
+    }
+    tensor->data = TensorData::view(pb_tensor.raw_data().data(), pb_tensor.raw_data().size());
 }
 
-void gemm_from_onnx(const onnx::NodeProto& node, const onnx::GraphProto& graph, OpGemm& gemm)
+void gemm_from_onnx(const onnx::NodeProto& node, const onnx::GraphProto& graph, OpGemm& gemm,
+    ExternalData* external_data)
 {
     assert(node.op_type().compare("Gemm") == 0 && "Not matched operator for Gemm");
 
@@ -114,7 +190,7 @@ void gemm_from_onnx(const onnx::NodeProto& node, const onnx::GraphProto& graph,
         tensors[idx]->tt.name = input;
         for (const auto& it : graph.initializer()) {
             if (input.compare(it.name()) == 0) {
-                tensor_from_onnx(it, tensors[idx]);
+                tensor_from_onnx(it, tensors[idx], external_data);
                 break;
             }
         }
@@ -122,14 +198,29 @@ void gemm_from_onnx(const onnx::NodeProto& node, const onnx::GraphProto& graph,
     }
 
     assert(node.output().size() == 1 && "Bad num of output for Gemm");
+    // Y is M x N, A is M x K (K x M if transA) and B is K x N (N x K if transB)
+    const TensorType* a_tt{&gemm.A.tt};
+    if (gemm.A.data.empty()) {
+        a_tt = TensorTypeMapper::instance()->find(gemm.A.tt.name);
+        assert(a_tt != nullptr && "Bad logic. Ancestor not found.");
+        // later passes read the shape of A from the node itself
+        gemm.A.tt = *a_tt;
+    }
+    // B produced by a node (e.g. DequantizeLinear), its data is filled by a graph pass
+    const TensorType* b_tt{&gemm.B.tt};
+    if (gemm.B.data.empty()) {
+        b_tt = TensorTypeMapper::instance()->find(gemm.B.tt.name);
+        assert(b_tt != nullptr && "Bad logic. Ancestor not found.");
+    }
     gemm.Y.tt.name = node.output().at(0);
-    gemm.Y.tt.dtype = gemm.B.tt.dtype;
-    gemm.Y.tt.dims = gemm.B.tt.dims;
-    gemm.Y.tt.shape[0] = gemm.B.tt.shape[0];
-    if (gemm.trans_b) {
-        gemm.Y.tt.shape[1] = gemm.B.tt.shape[1];
-    } else {
-        gemm.Y.tt.shape[1] = gemm.B.tt.shape[0];
+    gemm.Y.tt.dtype = b_tt->dtype;
+    gemm.Y.tt.dims = 2;
+    gemm.Y.tt.row_major = true;
+    gemm.Y.tt.shape[0] = gemm.trans_a ? a_tt->shape[1] : a_tt->shape[0];
+    gemm.Y.tt.shape[1] = gemm.trans_b ? b_tt->shape[0] : b_tt->shape[1];
+    gemm.Y.tt.dynamic_dims = 0;
+    if (a_tt->dynamic_dims & (1u << (gemm.trans_a ? 1 : 0))) {
+        gemm.Y.tt.dynamic_dims |= 1u;
     }
     TensorTypeMapper::instance()->insert(gemm.Y.tt);
 }
@@ -153,3 +244,271 @@ void relu_from_onnx(const onnx::NodeProto& node, OpRelu& relu)
     relu.Y.tt.name = node.output().at(0);
     tensor_mapper->insert(relu.Y.tt);
 }
+
+// Scale and zero point are initializers, x is either an initializer or produced by a node
+template<typename OpQdq>
+void qdq_inputs_from_onnx(const onnx::NodeProto& node, const onnx::GraphProto& graph, OpQdq& op,
+    ExternalData* external_data)
+{
+    assert(node.input().size() >= 2 && node.input().size() <= 3 && "Bad num of input for QDQ operator");
+    assert(node.output().size() == 1 && "Bad num of output for QDQ operator");
+
+    op.name = node.name();
+    op.op_type = node.op_type();
+    op.axis = 1;
+    for (const auto& attr : node.attribute()) {
+        if (attr.name().compare("axis") == 0) {
+            op.axis = attr.i();
+        } else if (attr.name().compare("saturate") == 0) {
+            continue;   // only affects float8 outputs
+        } else {
+            assert(false && "Unrecognized attribute for QDQ operator");
+        }
+    }
+
+    int idx{0};
+    Tensor* tensors[3]{&op.X, &op.scale, &op.zero_point};
+    for (const auto& input: node.input()) {
+        tensors[idx]->tt.name = input;
+        for (const auto& it : graph.initializer()) {
+            if (input.compare(it.name()) == 0) {
+                tensor_from_onnx(it, tensors[idx], external_data);
+                break;
+            }
+        }
+        ++idx;
+    }
+    assert(!op.scale.data.empty() && "Only constant scales are supported");
+
+    if (op.X.data.empty()) {
+        auto x_def{TensorTypeMapper::instance()->find(op.X.tt.name)};
+        assert(x_def != nullptr && "Bad logic. Ancestor not found.");
+        op.X.tt = *x_def;
+    }
+    op.Y.tt = op.X.tt;
+    op.Y.tt.name = node.output().at(0);
+}
+
+void quantize_linear_from_onnx(const onnx::NodeProto& node, const onnx::GraphProto& graph, OpQuantizeLinear& q,
+    ExternalData* external_data)
+{
+    assert(node.op_type().compare("QuantizeLinear") == 0 && "Not matched operator for QuantizeLinear");
+    qdq_inputs_from_onnx(node, graph, q, external_data);
+    // the zero point decides the output type, uint8 when omitted
+    q.Y.tt.dtype = q.zero_point.data.empty() ? DT_UINT8 : q.zero_point.tt.dtype;
+    TensorTypeMapper::instance()->insert(q.Y.tt);
+}
+
+void dequantize_linear_from_onnx(const onnx::NodeProto& node, const onnx::GraphProto& graph, OpDequantizeLinear& dq,
+    ExternalData* external_data)
+{
+    assert(node.op_type().compare("DequantizeLinear") == 0 && "Not matched operator for DequantizeLinear");
+    qdq_inputs_from_onnx(node, graph, dq, external_data);
+    dq.Y.tt.dtype = dq.scale.tt.dtype;
+    TensorTypeMapper::instance()->insert(dq.Y.tt);
+}
+
+void reduce_from_onnx(const onnx::NodeProto& node, const onnx::GraphProto& graph, OpReduce& reduce)
+{
+    assert(node.input().size() >= 1 && node.input().size() <= 2 && "Bad num of input for Reduce");
+    assert(node.output().size() == 1 && "Bad num of output for Reduce");
+
+    auto tensor_mapper{TensorTypeMapper::instance()};
+    reduce.name = node.name();
+    reduce.op_type = node.op_type();
+    auto x_def{tensor_mapper->find(node.input().at(0))};
+    if (x_def == nullptr) {
+        assert(false && "Bad logic. Ancestor not found.");
+    }
+    reduce.X.tt = *x_def;
+
+    // Setup default attribue. ref: ReduceSum specification
+    reduce.keepdims = 1;
+    int noop_with_empty_axes{0};
+    std::vector<int64_t> axes;
+    for (const auto& attr : node.attribute()) {
+        if (attr.name().compare("keepdims") == 0) {
+            reduce.keepdims = attr.i();
+        } else if (attr.name().compare("noop_with_empty_axes") == 0) {
+            noop_with_empty_axes = attr.i();
+        } else if (attr.name().compare("axes") == 0) {
+            axes.assign(attr.ints().begin(), attr.ints().end());
+        } else {
+            assert(false && "Unrecognized attribute for Reduce");
+        }
+    }
+    // newer opsets take the axes as an input
+    if (node.input().size() > 1 && !node.input().at(1).empty()) {
+        const onnx::TensorProto* pb_axes{nullptr};
+        for (const auto& it : graph.initializer()) {
+            if (node.input().at(1).compare(it.name()) == 0) {
+                pb_axes = &it;
+                break;
+            }
+        }
+        assert(pb_axes != nullptr && pb_axes->data_type() == DT_INT64 && "Only constant axes are supported");
+        if (pb_axes->raw_data().empty()) {
+            axes.assign(pb_axes->int64_data().begin(), pb_axes->int64_data().end());
+        } else {
+            axes.resize(pb_axes->raw_data().size() / DT_INT64_BYTES);
+            memcpy(axes.data(), pb_axes->raw_data().data(), pb_axes->raw_data().size());
+        }
+    }
+    assert((!axes.empty() || noop_with_empty_axes == 0) && "Reduce without axes is not supported");
+    for (int i = 0; i < reduce.X.tt.dims; ++i) {
+        // empty axes reduce over every axis
+        if (axes.empty() || std::find(axes.begin(), axes.end(), i) != axes.end()
+            || std::find(axes.begin(), axes.end(), i - reduce.X.tt.dims) != axes.end()) {
+            reduce.axes.push_back(i);
+        }
+    }
+
+    reduce.Y.tt = reduce.X.tt;
+    reduce.Y.tt.name = node.output().at(0);
+    reduce.Y.tt.dims = 0;
+    reduce.Y.tt.dynamic_dims = 0;
+    for (int i = 0; i < reduce.X.tt.dims; ++i) {
+        const bool reduced{std::find(reduce.axes.begin(), reduce.axes.end(), i) != reduce.axes.end()};
+        if (reduced && !reduce.keepdims) {
+            continue;
+        }
+        if (!reduced && (reduce.X.tt.dynamic_dims & (1u << i))) {
+            reduce.Y.tt.dynamic_dims |= 1u << reduce.Y.tt.dims;
+        }
+        reduce.Y.tt.shape[reduce.Y.tt.dims++] = reduced ? 1 : reduce.X.tt.shape[i];
+    }
+    tensor_mapper->insert(reduce.Y.tt);
+}
+
+void softmax_from_onnx(const onnx::NodeProto& node, OpSoftmax& softmax)
+{
+    assert(node.op_type().compare("Softmax") == 0 && "Not matched operator for Softmax");
+    assert(node.input().size() == 1 && "Bad num of input for Softmax");
+    assert(node.output().size() == 1 && "Bad num of output for Softmax");
+
+    auto tensor_mapper{TensorTypeMapper::instance()};
+    softmax.name = node.name();
+    softmax.op_type = node.op_type();
+    auto x_def{tensor_mapper->find(node.input().at(0))};
+    if (x_def == nullptr) {
+        assert(false && "Bad logic. Ancestor not found.");
+    }
+    softmax.X.tt = *x_def;
+
+    // Setup default attribue. ref: Softmax-13 specification
+    softmax.axis = -1;
+    for (const auto& attr : node.attribute()) {
+        if (attr.name().compare("axis") == 0) {
+            softmax.axis = attr.i();
+        } else {
+            assert(false && "Unrecognized attribute for Softmax");
+        }
+    }
+    if (softmax.axis < 0) {
+        softmax.axis += softmax.X.tt.dims;
+    }
+
+    softmax.Y.tt = softmax.X.tt;
+    softmax.Y.tt.name = node.output().at(0);
+    tensor_mapper->insert(softmax.Y.tt);
+}
+
+void graph_from_onnx(const onnx::GraphProto& pb_graph, Graph& graph,
+    const std::unordered_map<std::string, int>& dynamic_axes, ExternalData* external_data)
+{
+    for (const auto& it : pb_graph.initializer()) {
+        graph.add_value(it.name(), VK_INITIALIZER);
+    }
+
+    for (const auto& it : pb_graph.input()) {
+        if (!it.type().has_tensor_type()) {
+            continue;
+        }
+        auto value_id{graph.find_value(it.name())};
+        if (value_id != GRAPH_NO_NODE && graph.value(value_id).kind == VK_INITIALIZER) {
+            continue; // older exporters also list initializers as graph inputs
+        }
+        value_id = graph.add_value(it.name());
+        tensor_type_from_onnx(it.type().tensor_type(), graph.value(value_id).tt, dynamic_axes);
+        graph.value(value_id).tt.name = it.name();
+        graph.mark_input(value_id);
+    }
+
+    for (const auto& it : pb_graph.output()) {
+        if (!it.type().has_tensor_type()) {
+            continue;
+        }
+        auto value_id{graph.add_value(it.name())};
+        tensor_type_from_onnx(it.type().tensor_type(), graph.value(value_id).tt, dynamic_axes);
+        graph.value(value_id).tt.name = it.name();
+        graph.mark_output(value_id);
+    }
+
+    for (const auto& it : pb_graph.node()) {
+        std::vector<std::string> inputs(it.input().begin(), it.input().end());
+        std::vector<std::string> outputs(it.output().begin(), it.output().end());
+        graph.add_node(it.name(), as_op_type(it.op_type()), inputs, outputs);
+    }
+
+    graph.eliminate_dead_nodes();
+
+    // Operators look up the types of their inputs, parse them in topological order
+    for (auto node_id : graph.topo_order()) {
+        const auto& pb_node{pb_graph.node().Get(node_id)};
+        auto& node{graph.node(node_id)};
+        const TensorType* y_tt{nullptr};
+        switch (node.op_type) {
+        case OT_GEMM: {
+            OpGemm gemm;
+            gemm_from_onnx(pb_node, pb_graph, gemm, external_data);
+            node.op = gemm;
+            y_tt = &std::get<OpGemm>(node.op).Y.tt;
+            break;
+        }
+        case OT_RELU: {
+            OpRelu relu;
+            relu_from_onnx(pb_node, relu);
+            node.op = relu;
+            y_tt = &std::get<OpRelu>(node.op).Y.tt;
+            break;
+        }
+        case OT_QUANTIZE_LINEAR: {
+            OpQuantizeLinear q;
+            quantize_linear_from_onnx(pb_node, pb_graph, q, external_data);
+            node.op = q;
+            y_tt = &std::get<OpQuantizeLinear>(node.op).Y.tt;
+            break;
+        }
+        case OT_DEQUANTIZE_LINEAR: {
+            OpDequantizeLinear dq;
+            dequantize_linear_from_onnx(pb_node, pb_graph, dq, external_data);
+            node.op = dq;
+            y_tt = &std::get<OpDequantizeLinear>(node.op).Y.tt;
+            break;
+        }
+        case OT_REDUCE_SUM:
+        case OT_REDUCE_MEAN:
+        case OT_REDUCE_MAX: {
+            OpReduce reduce;
+            reduce_from_onnx(pb_node, pb_graph, reduce);
+            node.op = reduce;
+            y_tt = &std::get<OpReduce>(node.op).Y.tt;
+            break;
+        }
+        case OT_SOFTMAX: {
+            OpSoftmax softmax;
+            softmax_from_onnx(pb_node, softmax);
+            node.op = softmax;
+            y_tt = &std::get<OpSoftmax>(node.op).Y.tt;
+            break;
+        }
+        default:
+            assert(false && "Not supportted operator");
+        }
+
+        auto& y{graph.value(node.outputs.at(0))};
+        if (y.kind == VK_INTERMEDIATE) {
+            y.tt = *y_tt;
+        }
+    }
+}
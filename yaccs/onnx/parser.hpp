@@ -1,15 +1,52 @@
 #ifndef YACCS_ONNX_PARSER_H_
 #define YACCS_ONNX_PARSER_H_
 
+#include "yaccs/graph/graph.hpp"
 #include "yaccs/tensor.hpp"
 #include "yaccs/onnx/ops.hpp"
+#include "yaccs/utils.hpp"
+#include <memory>
 #include <onnx.pb.h>
+#include <string>
+#include <unordered_map>
+
+
+/**
+ * @brief Initializers stored as ONNX external data. Their files are looked up relative
+ * to the model directory and mapped once, the tensors view the mapped bytes.
+ */
+struct ExternalData
+{
+    explicit ExternalData(const std::string& base_dir);
+    // false when the file can not be mapped or the range exceeds it
+    bool read(const onnx::TensorProto& pb_tensor, TensorData& data);
+private:
+    std::string base_dir_;
+    std::unordered_map<std::string, std::shared_ptr<MappedFile>> files_;
+}; // struct ExternalData
+
+/**
+ * @brief Parse a model from a memory mapped file instead of a stream, the file is read
+ * once and not buffered. Models above 2 GB keep their weights in external data.
+ */
+bool load_onnx_model(const std::string& filename, onnx::ModelProto& model);
 
 
 void tensor_type_from_onnx(const onnx::TypeProto_Tensor& onnx_tensor, TensorType& tensor_type,
     const std::unordered_map<std::string, int>& dynamic_axes);
 
-void gemm_from_onnx(const onnx::NodeProto& node, const onnx::GraphProto& graph, OpGemm& gemm);
+void gemm_from_onnx(const onnx::NodeProto& node, const onnx::GraphProto& graph, OpGemm& gemm,
+    ExternalData* external_data=nullptr);
 void relu_from_onnx(const onnx::NodeProto& node, OpRelu& relu);
 
+/**
+ * @brief Build the graph IR from an ONNX graph. Nodes which do not contribute to any
+ * graph output are eliminated, the rest are parsed into operators in topological order.
+ *
+ * Initializer data is not copied, it views raw_data of pb_graph, which must outlive the
+ * graph, or the mapped external data files.
+ */
+void graph_from_onnx(const onnx::GraphProto& pb_graph, Graph& graph,
+    const std::unordered_map<std::string, int>& dynamic_axes, ExternalData* external_data=nullptr);
+
 #endif // YACCS_ONNX_PARSER_H_
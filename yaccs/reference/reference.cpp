@@ -0,0 +1,452 @@
+#include "yaccs/reference/reference.hpp"
+#include "yaccs/dtype.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+// Gemm blocking, a tile of Y and a slice of K are processed at a time so the rows of
+// B in use stay in cache
+#define GEMM_BLOCK_M 32
+#define GEMM_BLOCK_N 256
+#define GEMM_BLOCK_K 128
+
+
+namespace {
+
+// element at offset in data, see TensorIterator
+float element_at_offset(const Tensor& tensor, size_t offset)
+{
+    switch (tensor.tt.dtype) {
+    case DT_FLOAT:      return tensor.at_offset<DT_FLOAT>(offset);
+    case DT_FLOAT16:    return tensor.at_offset<DT_FLOAT16>(offset);
+    case DT_INT8:       return tensor.at_offset<DT_INT8>(offset);
+    case DT_UINT8:      return tensor.at_offset<DT_UINT8>(offset);
+    case DT_INT32:      return tensor.at_offset<DT_INT32>(offset);
+    default:            assert(false && "Not implemented");
+    }
+
+    return 0.0f; // unreachable, return something to suppress compiler warning
+}
+
+float element(const Tensor& tensor, int i)
+{
+    return element_at_offset(tensor, tensor.elem_offset(i));
+}
+
+// row major float copy of any supported tensor
+std::vector<float> as_floats(const Tensor& tensor)
+{
+    std::vector<float> result(tensor.tt.num_elems());
+    TensorIterator it{tensor};
+    for (size_t i = 0; i < result.size(); ++i, ++it) {
+        result.at(i) = element_at_offset(tensor, it.offset());
+    }
+    return result;
+}
+
+Tensor make_float_tensor(const std::string& name, const std::vector<uint32_t>& shape)
+{
+    Tensor tensor;
+    tensor.tt.name = name;
+    tensor.tt.dtype = DT_FLOAT;
+    tensor.tt.row_major = true;
+    tensor.tt.dims = shape.size();
+    for (size_t i = 0; i < shape.size(); ++i) {
+        tensor.tt.shape.at(i) = shape.at(i);
+    }
+    tensor.data.resize(tensor.tt.num_elems() * DT_FLOAT_BYTES);
+    return tensor;
+}
+
+Tensor from_floats(const std::string& name, const std::vector<uint32_t>& shape, const std::vector<float>& values)
+{
+    auto tensor{make_float_tensor(name, shape)};
+    assert(values.size() == static_cast<size_t>(tensor.tt.num_elems()) && "Bad number of elements");
+    memcpy(tensor.data.data(), values.data(), tensor.data.size());
+    return tensor;
+}
+
+std::vector<uint32_t> shape_of(const Tensor& tensor)
+{
+    return std::vector<uint32_t>(tensor.tt.shape.begin(), tensor.tt.shape.begin() + tensor.tt.dims);
+}
+
+// per tensor parameters have a single element, per axis ones one element per index of axis
+float quant_param(const Tensor& param, const std::vector<uint32_t>& shape, int axis, int i, float missing)
+{
+    if (param.data.empty()) {
+        return missing;
+    }
+    if (param.tt.num_elems() == 1) {
+        return element(param, 0);
+    }
+
+    uint32_t inner{1};
+    for (size_t d = axis + 1; d < shape.size(); ++d) {
+        inner *= shape.at(d);
+    }
+    return element(param, (i / inner) % shape.at(axis));
+}
+
+} // namespace
+
+
+ReferenceExecutor::ReferenceExecutor(int num_threads)
+    : num_threads_(num_threads > 0 ? num_threads : std::max(1u, std::thread::hardware_concurrency()))
+    , gemm_flops_(0)
+{
+}
+
+void ReferenceExecutor::run(const Graph& graph, const std::unordered_map<std::string, Tensor>& inputs)
+{
+    values_.clear();
+    gemm_flops_ = 0;
+    for (auto value_id : graph.inputs()) {
+        const auto& name{graph.value(value_id).name};
+        auto found{inputs.find(name)};
+        assert(found != inputs.end() && "Missing graph input");
+        add_value(found->second);
+    }
+
+    for (auto node_id : graph.topo_order()) {
+        const auto& node{graph.node(node_id)};
+        switch (node.op_type) {
+        case OT_GEMM:   gemm(std::get<OpGemm>(node.op)); break;
+        case OT_RELU:   relu(std::get<OpRelu>(node.op)); break;
+        case OT_REDUCE_SUM:
+        case OT_REDUCE_MEAN:
+        case OT_REDUCE_MAX: reduce(std::get<OpReduce>(node.op)); break;
+        case OT_SOFTMAX:    softmax(std::get<OpSoftmax>(node.op)); break;
+        case OT_QUANTIZE_LINEAR:    quantize_linear(std::get<OpQuantizeLinear>(node.op)); break;
+        case OT_DEQUANTIZE_LINEAR:  dequantize_linear(std::get<OpDequantizeLinear>(node.op)); break;
+        default:        assert(false && "Not supportted operator");
+        }
+    }
+}
+
+const Tensor& ReferenceExecutor::value(const std::string& name) const
+{
+    auto found{values_.find(name)};
+    assert(found != values_.end() && "Value not computed");
+    return found->second;
+}
+
+Tensor ReferenceExecutor::operand(const Tensor& tensor) const
+{
+    // computed values win, initializers carry their data in the operator
+    auto found{values_.find(tensor.tt.name)};
+    if (found != values_.end()) {
+        return found->second;
+    }
+    assert(!tensor.data.empty() && "Operand neither computed nor constant");
+    return tensor;
+}
+
+void ReferenceExecutor::add_value(Tensor tensor)
+{
+    // contiguous float from here on
+    if (tensor.tt.dtype != DT_FLOAT) {
+        tensor = from_floats(tensor.tt.name, shape_of(tensor), as_floats(tensor));
+    }
+    tensor = tensor.materialize();
+    auto name{tensor.tt.name};
+    values_.insert_or_assign(name, std::move(tensor));
+}
+
+void ReferenceExecutor::parallel_for(int num_tasks, const std::function<void(int)>& task) const
+{
+    const int num_workers{std::min(num_threads_, num_tasks)};
+    if (num_workers <= 1) {
+        for (int i = 0; i < num_tasks; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    // tasks are taken in order from a shared counter, cheap ones do not leave threads idle
+    std::atomic<int> next{0};
+    std::vector<std::thread> workers;
+    workers.reserve(num_workers);
+    for (int w = 0; w < num_workers; ++w) {
+        workers.emplace_back([&] {
+            for (int i = next++; i < num_tasks; i = next++) {
+                task(i);
+            }
+        });
+    }
+    for (auto& it : workers) {
+        it.join();
+    }
+}
+
+void ReferenceExecutor::gemm(const OpGemm& gemm)
+{
+    assert(!gemm.quant.enabled && "Quantized Gemm, evaluate the graph before fuse_qdq_gemm");
+
+    const auto A{operand(gemm.A)};
+    const auto B{operand(gemm.B)};
+    const auto A_data{as_floats(A)};
+    const auto B_data{as_floats(B)};
+    const uint32_t M{gemm.trans_a ? A.tt.shape[1] : A.tt.shape[0]};
+    const uint32_t K{gemm.trans_a ? A.tt.shape[0] : A.tt.shape[1]};
+    const uint32_t N{gemm.trans_b ? B.tt.shape[0] : B.tt.shape[1]};
+    assert(K == (gemm.trans_b ? B.tt.shape[1] : B.tt.shape[0]) && "Gemm inner dimensions differ");
+
+    // pack A as M x K and B as K x N row major, the inner loop then runs over contiguous rows
+    std::vector<float> a(static_cast<size_t>(M) * K);
+    std::vector<float> b(static_cast<size_t>(K) * N);
+    for (uint32_t i = 0; i < M; ++i) {
+        for (uint32_t k = 0; k < K; ++k) {
+            a[i * K + k] = gemm.trans_a ? A_data[k * M + i] : A_data[i * K + k];
+        }
+    }
+    for (uint32_t k = 0; k < K; ++k) {
+        for (uint32_t j = 0; j < N; ++j) {
+            b[k * N + j] = gemm.trans_b ? B_data[j * K + k] : B_data[k * N + j];
+        }
+    }
+
+    // C broadcasts unidirectionally: a scalar, a row of N, a column of M or M x N
+    std::vector<float> c;
+    uint32_t c_rows{1}, c_cols{1};
+    if (!gemm.C.tt.name.empty()) {
+        const auto C{operand(gemm.C)};
+        c = as_floats(C);
+        c_cols = C.tt.dims > 0 ? C.tt.shape[C.tt.dims - 1] : 1;
+        c_rows = C.tt.dims > 1 ? C.tt.shape[C.tt.dims - 2] : 1;
+    }
+
+    auto Y{make_float_tensor(gemm.Y.tt.name, {M, N})};
+    auto y{reinterpret_cast<float*>(Y.data.data())};
+    const uint32_t tiles_m{(M + GEMM_BLOCK_M - 1) / GEMM_BLOCK_M};
+    const uint32_t tiles_n{(N + GEMM_BLOCK_N - 1) / GEMM_BLOCK_N};
+    parallel_for(tiles_m * tiles_n, [&] (int tile) {
+        const uint32_t i0{tile / tiles_n * GEMM_BLOCK_M};
+        const uint32_t j0{tile % tiles_n * GEMM_BLOCK_N};
+        const uint32_t i1{std::min(M, i0 + GEMM_BLOCK_M)};
+        const uint32_t j1{std::min(N, j0 + GEMM_BLOCK_N)};
+        for (uint32_t i = i0; i < i1; ++i) {
+            std::fill(y + i * N + j0, y + i * N + j1, 0.0f);
+        }
+        for (uint32_t k0 = 0; k0 < K; k0 += GEMM_BLOCK_K) {
+            const uint32_t k1{std::min(K, k0 + GEMM_BLOCK_K)};
+            for (uint32_t i = i0; i < i1; ++i) {
+                float* y_row{y + i * N};
+                for (uint32_t k = k0; k < k1; ++k) {
+                    const float a_ik{a[i * K + k]};
+                    const float* b_row{b.data() + k * N};
+                    for (uint32_t j = j0; j < j1; ++j) {
+                        y_row[j] += a_ik * b_row[j];
+                    }
+                }
+            }
+        }
+        for (uint32_t i = i0; i < i1; ++i) {
+            for (uint32_t j = j0; j < j1; ++j) {
+                float v{gemm.alpha * y[i * N + j]};
+                if (!c.empty()) {
+                    v += gemm.beta * c[(c_rows > 1 ? i * c_cols : 0) + (c_cols > 1 ? j : 0)];
+                }
+                y[i * N + j] = gemm.fused_relu ? std::max(v, 0.0f) : v;
+            }
+        }
+    });
+
+    gemm_flops_ += 2.0 * M * N * K;
+    add_value(std::move(Y));
+}
+
+void ReferenceExecutor::relu(const OpRelu& relu)
+{
+    const auto X{operand(relu.X)};
+    auto values{as_floats(X)};
+    for (auto& it : values) {
+        it = std::max(it, 0.0f);
+    }
+    add_value(from_floats(relu.Y.tt.name, shape_of(X), values));
+}
+
+void ReferenceExecutor::reduce(const OpReduce& reduce)
+{
+    const auto X{operand(reduce.X)};
+    const auto x{as_floats(X)};
+    const bool max{reduce.op_type.compare("ReduceMax") == 0};
+    const bool mean{reduce.op_type.compare("ReduceMean") == 0};
+
+    // reduced axes keep extent 1 in the output index, keepdims only changes the shape
+    std::vector<uint32_t> kept_shape;
+    std::vector<uint32_t> y_shape;
+    uint32_t count{1};
+    for (int d = 0; d < X.tt.dims; ++d) {
+        const bool reduced{std::find(reduce.axes.begin(), reduce.axes.end(), d) != reduce.axes.end()};
+        kept_shape.push_back(reduced ? 1 : X.tt.shape[d]);
+        count *= reduced ? X.tt.shape[d] : 1;
+        if (!reduced || reduce.keepdims) {
+            y_shape.push_back(kept_shape.back());
+        }
+    }
+
+    uint32_t y_elems{1};
+    for (auto it : kept_shape) {
+        y_elems *= it;
+    }
+    std::vector<float> y(y_elems, max ? -std::numeric_limits<float>::infinity() : 0.0f);
+    for (size_t i = 0; i < x.size(); ++i) {
+        // flat index of X to flat index of Y, innermost axis first
+        size_t rest{i}, y_index{0}, y_stride{1};
+        for (int d = X.tt.dims - 1; d >= 0; --d) {
+            const size_t coord{rest % X.tt.shape[d]};
+            rest /= X.tt.shape[d];
+            y_index += (kept_shape.at(d) == 1 ? 0 : coord) * y_stride;
+            y_stride *= kept_shape.at(d);
+        }
+        y.at(y_index) = max ? std::max(y.at(y_index), x.at(i)) : y.at(y_index) + x.at(i);
+    }
+    if (mean) {
+        for (auto& it : y) {
+            it /= count;
+        }
+    }
+    add_value(from_floats(reduce.Y.tt.name, y_shape, y));
+}
+
+void ReferenceExecutor::softmax(const OpSoftmax& softmax)
+{
+    const auto X{operand(softmax.X)};
+    auto y{as_floats(X)};
+    uint32_t outer{1}, inner{1};
+    for (int d = 0; d < softmax.axis; ++d) {
+        outer *= X.tt.shape[d];
+    }
+    for (int d = softmax.axis + 1; d < X.tt.dims; ++d) {
+        inner *= X.tt.shape[d];
+    }
+    const uint32_t n{X.tt.shape[softmax.axis]};
+
+    for (uint32_t o = 0; o < outer; ++o) {
+        for (uint32_t in = 0; in < inner; ++in) {
+            float* base{y.data() + o * n * inner + in};
+            float row_max{-std::numeric_limits<float>::infinity()};
+            for (uint32_t j = 0; j < n; ++j) {
+                row_max = std::max(row_max, base[j * inner]);
+            }
+            float sum{0.0f};
+            for (uint32_t j = 0; j < n; ++j) {
+                base[j * inner] = std::exp(base[j * inner] - row_max);
+                sum += base[j * inner];
+            }
+            for (uint32_t j = 0; j < n; ++j) {
+                base[j * inner] /= sum;
+            }
+        }
+    }
+    add_value(from_floats(softmax.Y.tt.name, shape_of(X), y));
+}
+
+void ReferenceExecutor::quantize_linear(const OpQuantizeLinear& quantize)
+{
+    const auto X{operand(quantize.X)};
+    const auto shape{shape_of(X)};
+    const int axis{quantize.axis < 0 ? quantize.axis + X.tt.dims : quantize.axis};
+    // the zero point type selects the range, uint8 when it is omitted
+    const bool is_signed{!quantize.zero_point.data.empty() && quantize.zero_point.tt.dtype == DT_INT8};
+    const float qmin{is_signed ? -128.0f : 0.0f};
+    const float qmax{is_signed ? 127.0f : 255.0f};
+
+    // quantized values are kept as float, they are exact
+    if (is_signed && X.tt.dtype == DT_FLOAT && quantize.scale.tt.num_elems() == 1) {
+        const auto q{X.quantize(element(quantize.scale, 0), static_cast<int>(element(quantize.zero_point, 0)))};
+        add_value(from_floats(quantize.Y.tt.name, shape, as_floats(q)));
+        return;
+    }
+    auto y{as_floats(X)};
+    for (size_t i = 0; i < y.size(); ++i) {
+        const float scale{quant_param(quantize.scale, shape, axis, i, 1.0f)};
+        const float zero_point{quant_param(quantize.zero_point, shape, axis, i, 0.0f)};
+        y.at(i) = std::min(std::max(std::nearbyint(y.at(i) / scale) + zero_point, qmin), qmax);
+    }
+    add_value(from_floats(quantize.Y.tt.name, shape, y));
+}
+
+void ReferenceExecutor::dequantize_linear(const OpDequantizeLinear& dequantize)
+{
+    const auto X{operand(dequantize.X)};
+    const auto shape{shape_of(X)};
+    const int axis{dequantize.axis < 0 ? dequantize.axis + X.tt.dims : dequantize.axis};
+
+    auto y{as_floats(X)};
+    for (size_t i = 0; i < y.size(); ++i) {
+        const float scale{quant_param(dequantize.scale, shape, axis, i, 1.0f)};
+        const float zero_point{quant_param(dequantize.zero_point, shape, axis, i, 0.0f)};
+        y.at(i) = (y.at(i) - zero_point) * scale;
+    }
+    add_value(from_floats(dequantize.Y.tt.name, shape, y));
+}
+
+std::vector<char> pack_tensor(const Tensor& tensor)
+{
+    const uint32_t dims{static_cast<uint32_t>(tensor.tt.dims)};
+    const auto data_offset{tensor_data_offset(tensor.tt.dims)};
+    std::vector<char> buffer(data_offset + tensor.data.size(), 0);
+    memcpy(buffer.data(), &dims, sizeof(dims));
+    memcpy(buffer.data() + sizeof(uint32_t), tensor.tt.shape.data(), dims * sizeof(uint32_t));
+    memcpy(buffer.data() + data_offset, tensor.data.data(), tensor.data.size());
+    return buffer;
+}
+
+Tensor unpack_tensor(const std::vector<char>& buffer, const std::string& name, DType dtype)
+{
+    Tensor tensor;
+    tensor.tt.name = name;
+    tensor.tt.dtype = dtype;
+    tensor.tt.row_major = true;
+    if (buffer.size() < sizeof(uint32_t)) {
+        return tensor;
+    }
+
+    uint32_t dims{};
+    memcpy(&dims, buffer.data(), sizeof(dims));
+    assert(dims <= tensor.tt.shape.size() && buffer.size() >= tensor_data_offset(dims) && "Bad tensor buffer");
+    tensor.tt.dims = dims;
+    memcpy(tensor.tt.shape.data(), buffer.data() + sizeof(uint32_t), dims * sizeof(uint32_t));
+
+    // the buffer may be larger than the tensor, e.g. sized for the largest batch
+    const auto data_offset{tensor_data_offset(dims)};
+    const size_t data_size{std::min<size_t>(buffer.size() - data_offset, tensor.tt.num_elems() * dtype_bytes(dtype))};
+    tensor.data.assign(buffer.begin() + data_offset, buffer.begin() + data_offset + data_size);
+    return tensor;
+}
+
+CompareResult compare_tensors(const Tensor& expected, const Tensor& actual)
+{
+    CompareResult result{.shape_matched = expected.tt.dims == actual.tt.dims,
+        .max_abs_error = 0.0f, .max_rel_error = 0.0f, .worst_index = -1};
+    for (int d = 0; d < expected.tt.dims && result.shape_matched; ++d) {
+        result.shape_matched = expected.tt.shape[d] == actual.tt.shape[d];
+    }
+    const size_t expected_bytes{expected.tt.num_elems() * dtype_bytes(expected.tt.dtype)};
+    const size_t actual_bytes{actual.tt.num_elems() * dtype_bytes(actual.tt.dtype)};
+    if (!result.shape_matched || expected.data.size() < expected_bytes || actual.data.size() < actual_bytes) {
+        result.shape_matched = false;
+        return result;
+    }
+
+    TensorIterator expected_it{expected};
+    TensorIterator actual_it{actual};
+    for (int i = 0; i < expected.tt.num_elems(); ++i, ++expected_it, ++actual_it) {
+        const float e{element_at_offset(expected, expected_it.offset())};
+        const float a{element_at_offset(actual, actual_it.offset())};
+        const float abs_error{std::fabs(e - a)};
+        // NaN compares false, count it as the worst error
+        if (!(abs_error <= result.max_abs_error)) {
+            result.max_abs_error = std::isnan(abs_error) ? std::numeric_limits<float>::infinity() : abs_error;
+            result.worst_index = i;
+        }
+        result.max_rel_error = std::max(result.max_rel_error, abs_error / std::max(1.0f, std::fabs(e)));
+    }
+    return result;
+}
@@ -0,0 +1,63 @@
+#ifndef YACCS_REFERENCE_REFERENCE_H_
+#define YACCS_REFERENCE_REFERENCE_H_
+
+#include "yaccs/graph/graph.hpp"
+#include "yaccs/tensor.hpp"
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Largest difference between an expected and an actual tensor. The errors are
+ * only meaningful when the shapes matched.
+ */
+struct CompareResult
+{
+    bool shape_matched;
+    float max_abs_error;
+    float max_rel_error;    // relative to max(1, |expected|), absolute for small values
+    int worst_index;    // flat index of the largest absolute error, -1 when empty
+}; // struct CompareResult
+
+/**
+ * @brief CPU evaluation of the graphs Layer3 lowers, the numerical oracle for the
+ * generated shaders and a throughput baseline for them. Every value is computed in
+ * float. Gemm is blocked over output tiles which are spread over the worker threads.
+ *
+ * Quantized Gemms are not evaluated, run on the graph before fuse_qdq_gemm instead,
+ * QuantizeLinear and DequantizeLinear are evaluated as nodes.
+ */
+struct ReferenceExecutor
+{
+    // 0 threads uses every hardware thread
+    explicit ReferenceExecutor(int num_threads=0);
+    // inputs by value name, shapes may differ from the graph in the dynamic axes
+    void run(const Graph& graph, const std::unordered_map<std::string, Tensor>& inputs);
+    const Tensor& value(const std::string& name) const;
+    int num_threads() const { return num_threads_; }
+    // multiply-adds of the Gemms in the last run
+    double gemm_flops() const { return gemm_flops_; }
+private:
+    int num_threads_;
+    double gemm_flops_;
+    std::unordered_map<std::string, Tensor> values_;
+
+    Tensor operand(const Tensor& tensor) const;
+    void add_value(Tensor tensor);
+    void parallel_for(int num_tasks, const std::function<void(int)>& task) const;
+
+    void gemm(const OpGemm& gemm);
+    void relu(const OpRelu& relu);
+    void reduce(const OpReduce& reduce);
+    void softmax(const OpSoftmax& softmax);
+    void quantize_linear(const OpQuantizeLinear& quantize);
+    void dequantize_linear(const OpDequantizeLinear& dequantize);
+}; // struct ReferenceExecutor
+
+// host side layout of a tensor buffer: dims, shape[dims], data at the next 16 bytes boundary
+std::vector<char> pack_tensor(const Tensor& tensor);
+Tensor unpack_tensor(const std::vector<char>& buffer, const std::string& name, DType dtype=DT_FLOAT);
+CompareResult compare_tensors(const Tensor& expected, const Tensor& actual);
+
+#endif // YACCS_REFERENCE_REFERENCE_H_
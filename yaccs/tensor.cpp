@@ -1,5 +1,6 @@
 #include "yaccs/tensor.hpp"
 #include "yaccs/dtype.hpp"
+#include "yaccs/host/kernels.hpp"
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
@@ -8,8 +9,127 @@
 #include <ios>
 #include <utility>
 
+// edge of the square blocks a transpose copies at a time, 32 rows of 32 float
+// elements of source and destination fit in L1
+#define TRANSPOSE_BLOCK 32
+
+
+namespace {
+
+// dst is rows x cols, src is its cols x rows transpose, both row major
+template<size_t ELEM_BYTES>
+void transpose_blocked(const char* src, char* dst, uint32_t rows, uint32_t cols)
+{
+    for (uint32_t r0 = 0; r0 < rows; r0 += TRANSPOSE_BLOCK) {
+        const uint32_t r1{std::min(rows, r0 + TRANSPOSE_BLOCK)};
+        for (uint32_t c0 = 0; c0 < cols; c0 += TRANSPOSE_BLOCK) {
+            const uint32_t c1{std::min(cols, c0 + TRANSPOSE_BLOCK)};
+            for (uint32_t r = r0; r < r1; ++r) {
+                for (uint32_t c = c0; c < c1; ++c) {
+                    memcpy(dst + (static_cast<size_t>(r) * cols + c) * ELEM_BYTES,
+                        src + (static_cast<size_t>(c) * rows + r) * ELEM_BYTES, ELEM_BYTES);
+                }
+            }
+        }
+    }
+}
+
+// the last two dims of a contiguous buffer swapped, the layout transpose() makes
+bool is_transposed_matrix(const Tensor& tensor)
+{
+    const int dims{tensor.tt.dims};
+    if (dims < 2 || tensor.strides[dims - 2] != 1 || tensor.strides[dims - 1] != tensor.tt.shape[dims - 2]) {
+        return false;
+    }
+    size_t stride{static_cast<size_t>(tensor.tt.shape[dims - 2]) * tensor.tt.shape[dims - 1]};
+    for (int d = dims - 3; d >= 0; --d) {
+        if (tensor.strides[d] != stride) {
+            return false;
+        }
+        stride *= tensor.tt.shape[d];
+    }
+    return true;
+}
+
+} // namespace
+
+
+TensorIterator::TensorIterator(const Tensor& tensor)
+    : shape_(tensor.tt.shape)
+    , strides_(tensor.strides)
+    , index_{}
+    , dims_(tensor.tt.dims)
+    , offset_(0)
+{
+    if (tensor.is_contiguous()) {
+        uint32_t stride{1};
+        for (int d = dims_ - 1; d >= 0; --d) {
+            strides_[d] = stride;
+            stride *= shape_[d];
+        }
+    }
+}
+
+TensorData::TensorData(size_t size, char value)
+{
+    adopt(std::make_shared<std::vector<char>>(size, value));
+}
+
+TensorData TensorData::view(const char* data, size_t size, std::shared_ptr<const void> owner)
+{
+    TensorData result;
+    result.owner_ = std::move(owner);
+    result.data_ = data;
+    result.size_ = size;
+    return result;
+}
+
+char* TensorData::data()
+{
+    return own().data();
+}
+
+char TensorData::at(size_t i) const
+{
+    assert(i < size_ && "Tensor data out of range");
+    return data_[i];
+}
+
+char& TensorData::at(size_t i)
+{
+    return own().at(i);
+}
+
+void TensorData::resize(size_t size, char value)
+{
+    auto& bytes{own()};
+    bytes.resize(size, value);
+    data_ = bytes.data();
+    size_ = bytes.size();
+}
+
+void TensorData::adopt(std::shared_ptr<std::vector<char>> bytes)
+{
+    data_ = bytes->data();
+    size_ = bytes->size();
+    bytes_ = std::move(bytes);
+    owner_.reset();
+}
+
+std::vector<char>& TensorData::own()
+{
+    if (!bytes_ || is_shared()) {
+        adopt(std::make_shared<std::vector<char>>(data_, data_ + size_));
+    }
+    return *bytes_;
+}
+
 TensorType::TensorType()
-    : dims(0)
+    : shape{}
+    , dtype(DT_UNDEFINED)
+    , dims(0)
+    , row_major(false)
+    , dynamic_dims(0)
 {}
 
 TensorType::TensorType(const TensorType& tt)
@@ -19,6 +139,7 @@ TensorType::TensorType(const TensorType& tt)
     dtype = tt.dtype;
     dims = tt.dims;
     row_major = tt.row_major;
+    dynamic_dims = tt.dynamic_dims;
 }
 
 TensorType::TensorType(TensorType&& tt)
@@ -29,6 +150,7 @@ TensorType::TensorType(TensorType&& tt)
     dtype = tt.dtype;
     dims = tt.dims;
     row_major = tt.row_major;
+    dynamic_dims = tt.dynamic_dims;
     // clear
     // memset(tt.shape, 0, MAX_TENSOR_DIMS * sizeof(tt.shape[0]));
     tt.shape.fill(0);
@@ -36,6 +158,7 @@ TensorType::TensorType(TensorType&& tt)
     tt.dtype = DT_UNDEFINED;
     tt.dims = 0;
     tt.row_major = false;
+    tt.dynamic_dims = 0;
 }
 
 TensorType& TensorType::operator=(const TensorType& tt)
@@ -45,6 +168,7 @@ TensorType& TensorType::operator=(const TensorType& tt)
     dtype = tt.dtype;
     dims = tt.dims;
     row_major = tt.row_major;
+    dynamic_dims = tt.dynamic_dims;
     return *this;
 }
 
@@ -57,16 +181,23 @@ TensorType& TensorType::operator=(TensorType&& tt)
         dtype = tt.dtype;
         dims = tt.dims;
         row_major = tt.row_major;
+        dynamic_dims = tt.dynamic_dims;
         // clear
         tt.shape.fill(0);
         tt.name = "";
         tt.dtype = DT_UNDEFINED;
         tt.dims = 0;
         tt.row_major = false;
+        tt.dynamic_dims = 0;
     }
     return *this;
 }
 
+bool TensorType::is_dynamic() const
+{
+    return dynamic_dims != 0;
+}
+
 int TensorType::num_elems() const
 {
     int num_elems{1};
@@ -76,48 +207,174 @@ int TensorType::num_elems() const
     return num_elems;
 }
 
-int TensorType::transposed_idx(uint32_t i) const
+bool Tensor::is_contiguous() const
 {
-    if (!row_major && dims > 1) {
-        uint32_t c{i / shape.at(1)};
-        uint32_t r{i % shape.at(1)};
-        i = r * shape.at(0) + c;
+    return strides == Shape{};
+}
+
+size_t Tensor::elem_offset(uint32_t i) const
+{
+    if (is_contiguous()) {
+        return i;
+    }
+
+    size_t offset{0};
+    for (int d = tt.dims - 1; d >= 0; --d) {
+        offset += static_cast<size_t>(i % tt.shape[d]) * strides[d];
+        i /= tt.shape[d];
     }
-    return i;
+    return offset;
 }
 
 Tensor Tensor::transpose() const
 {
     assert(tt.dims > 1 && "Bad transpose operation");
 
-    Tensor result;
-    result.tt.name = tt.name;
-    result.tt.dtype = tt.dtype;
-    result.tt.dims = tt.dims;
+    // same buffer, the last two dims and their strides swapped
+    Tensor result{*this};
+    if (is_contiguous()) {
+        uint32_t stride{1};
+        for (int d = tt.dims - 1; d >= 0; --d) {
+            result.strides[d] = stride;
+            stride *= tt.shape[d];
+        }
+    }
     result.tt.row_major = !tt.row_major;
-    result.tt.shape = tt.shape;
     std::swap(result.tt.shape.at(tt.dims - 2), result.tt.shape.at(tt.dims - 1));
-    result.data = data;
+    std::swap(result.strides.at(tt.dims - 2), result.strides.at(tt.dims - 1));
+    return result;
+}
+
+Tensor Tensor::reshape(const std::vector<uint32_t>& shape) const
+{
+    // a strided view has to be laid out row major first
+    Tensor result{is_contiguous() ? *this : materialize()};
+    result.tt.dims = shape.size();
+    result.tt.shape.fill(0);
+    std::copy(shape.begin(), shape.end(), result.tt.shape.begin());
+    result.tt.dynamic_dims = 0;
+    assert(result.tt.num_elems() == tt.num_elems() && "Bad reshape operation");
+    return result;
+}
+
+Tensor Tensor::materialize() const
+{
+    if (is_contiguous() && scale == 1.0f) {
+        return *this;
+    }
+
+    Tensor result;
+    result.tt = tt;
+    result.tt.row_major = true;
+    const auto elem_bytes{dtype_bytes(tt.dtype)};
+    const auto num_elems{tt.num_elems()};
+    result.data.resize(num_elems * elem_bytes);
+    auto dst{result.data.data()};
+    if (is_transposed_matrix(*this)) {
+        // the common case, a transposed weight matrix, is copied in blocks
+        const uint32_t rows{tt.shape[tt.dims - 2]};
+        const uint32_t cols{tt.shape[tt.dims - 1]};
+        const size_t matrix_bytes{static_cast<size_t>(rows) * cols * elem_bytes};
+        const size_t num_matrices{rows * cols > 0 ? num_elems / (rows * cols) : 0};
+        for (size_t b = 0; b < num_matrices; ++b) {
+            const auto src_matrix{data.data() + b * matrix_bytes};
+            const auto dst_matrix{dst + b * matrix_bytes};
+            switch (elem_bytes) {
+            case 1: transpose_blocked<1>(src_matrix, dst_matrix, rows, cols); break;
+            case 2: transpose_blocked<2>(src_matrix, dst_matrix, rows, cols); break;
+            // the source matrix is cols x rows
+            case 4: transpose_f32(src_matrix, dst_matrix, cols, rows); break;
+            case 8: transpose_blocked<8>(src_matrix, dst_matrix, rows, cols); break;
+            default: assert(false && "Not implement");
+            }
+        }
+    } else {
+        TensorIterator it{*this};
+        for (int i = 0; i < num_elems; ++i, ++it) {
+            memcpy(dst + i * elem_bytes, data.data() + it.offset() * elem_bytes, elem_bytes);
+        }
+    }
+
+    // contiguous now, the scale is applied in place
+    if (scale != 1.0f) {
+        switch (tt.dtype) {
+        case DT_FLOAT:
+            scale_f32(dst, dst, num_elems, scale);
+            break;
+        case DT_FLOAT16:
+            for (int i = 0; i < num_elems; ++i) {
+                result.set<DT_FLOAT16>(i, result.at_offset<DT_FLOAT16>(i) * scale);
+            }
+            break;
+        default:
+            assert(false && "Not implement");
+        }
+    }
     return result;
 }
 
 void Tensor::mul(float x)
 {
-    int num_elems{1};
-    for (int i = 0; i < tt.dims; ++i) {
-        num_elems *= tt.shape[i];
+    // applied when the elements are read
+    assert((x == 1.0f || tt.dtype == DT_FLOAT || tt.dtype == DT_FLOAT16) && "Not implement");
+    scale *= x;
+}
+
+Tensor Tensor::cast(DType dtype) const
+{
+    if (dtype == tt.dtype) {
+        return *this;
     }
 
-    switch (tt.dtype) {
-    case DT_FLOAT:
-        for (int i = 0; i < num_elems; ++i) {
-            auto v{at<DT_FLOAT>(i)};            
-            set<DT_FLOAT>(i, v * x);            
+    Tensor result;
+    result.tt = tt;
+    result.tt.dtype = dtype;
+    result.tt.row_major = true;
+    result.data.resize(tt.num_elems() * dtype_bytes(dtype));
+    if (tt.dtype == DT_FLOAT && (dtype == DT_FLOAT16 || dtype == DT_BFLOAT16)) {
+        // float weights, the common case, are converted a vector at a time
+        const auto src{materialize()};
+        if (dtype == DT_FLOAT16) {
+            convert_f32_to_f16(src.data.data(), result.data.data(), tt.num_elems());
+        } else {
+            convert_f32_to_bf16(src.data.data(), result.data.data(), tt.num_elems());
+        }
+        return result;
+    }
+
+    TensorIterator it{*this};
+    for (int i = 0; i < tt.num_elems(); ++i, ++it) {
+        float v{};
+        switch (tt.dtype) {
+        case DT_FLOAT:      v = at_offset<DT_FLOAT>(it.offset()); break;
+        case DT_FLOAT16:    v = at_offset<DT_FLOAT16>(it.offset()); break;
+        case DT_BFLOAT16:   v = at_offset<DT_BFLOAT16>(it.offset()); break;
+        default:            assert(false && "Not implement");
+        }
+
+        switch (dtype) {
+        case DT_FLOAT:      result.set<DT_FLOAT>(i, v); break;
+        case DT_FLOAT16:    result.set<DT_FLOAT16>(i, v); break;
+        case DT_BFLOAT16:   result.set<DT_BFLOAT16>(i, v); break;
+        default:            assert(false && "Not implement");
         }
-        break;
-    default:
-        assert(false && "Not implement");
     }
+    return result;
+}
+
+Tensor Tensor::quantize(float scale, int zero_point) const
+{
+    assert(tt.dtype == DT_FLOAT && "Not implement");
+    assert(zero_point >= -128 && zero_point <= 127 && "Bad int8 zero point");
+
+    const auto src{materialize()};
+    Tensor result;
+    result.tt = tt;
+    result.tt.dtype = DT_INT8;
+    result.tt.row_major = true;
+    result.data.resize(tt.num_elems() * DT_INT8_BYTES);
+    quantize_f32_to_i8(src.data.data(), result.data.data(), tt.num_elems(), scale, zero_point);
+    return result;
 }
 
 std::ostream& operator<<(std::ostream& os, const Tensor& tensor)
@@ -147,6 +404,13 @@ std::ostream& operator<<(std::ostream& os, const Tensor& tensor)
             if ((i + 1) % std::max(1u, tensor.tt.shape[1]) == 0) os << "\n";
         }
         break;
+    case DT_FLOAT16:
+        for (int i = 0; i < num_elems; ++i) {
+            os << std::setw(8) << std::fixed << std::setprecision(5)
+                << tensor.at<DT_FLOAT16>(i) << ", ";
+            if ((i + 1) % std::max(1u, tensor.tt.shape[1]) == 0) os << "\n";
+        }
+        break;
     default:
         assert(false && "Not implemented");
     }
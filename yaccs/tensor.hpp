@@ -5,7 +5,9 @@
 #include <array>
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <endian.h>
+#include <memory>
 #include <ostream>
 #include <string>
 #include <vector>
@@ -15,61 +17,219 @@ using Shape = std::array<uint32_t, 6>;
 struct TensorType
 {
     TensorType();
-    int transposed_idx(uint32_t i) const;
     TensorType(const TensorType& tt);
     TensorType(TensorType&& tt);
     TensorType& operator=(const TensorType& tt);
     TensorType& operator=(TensorType&& tt);
     int num_elems() const;
+    bool is_dynamic() const;
 
     Shape shape;
     std::string name;
     DType dtype;
     int dims;
-    bool row_major;
+    bool row_major;     // false for transposed views, the layout itself is in Tensor::strides
+    // bit i set: dim i is symbolic and only known at runtime, shape[i] holds 1
+    uint32_t dynamic_dims;
 }; // struct TensorType
 
+/**
+ * @brief Bytes of a tensor in a reference counted buffer. Copies share the buffer, the
+ * first mutable access of a shared buffer copies it (copy on write). The buffer is
+ * either owned or a view of memory kept alive by an owner, e.g. a mapped weights file.
+ */
+struct TensorData
+{
+    TensorData() = default;
+    TensorData(size_t size, char value=0);
+    // owner may be null when the viewed memory outlives the tensor by contract
+    static TensorData view(const char* data, size_t size, std::shared_ptr<const void> owner=nullptr);
+    bool is_view() const { return data_ != nullptr && !bytes_; }
+    // another TensorData references the same owned bytes
+    bool is_shared() const { return bytes_.use_count() > 1; }
+
+    const char* data() const { return data_; }
+    char* data();
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const char* begin() const { return data_; }
+    const char* end() const { return data_ + size_; }
+    char at(size_t i) const;
+    char& at(size_t i);
+    void resize(size_t size, char value=0);
+    template<typename It>
+    void assign(It first, It last);
+private:
+    std::shared_ptr<std::vector<char>> bytes_;  // owned bytes, shared between copies
+    std::shared_ptr<const void> owner_;         // keeps the viewed bytes alive
+    const char* data_{nullptr};
+    size_t size_{0};
+
+    void adopt(std::shared_ptr<std::vector<char>> bytes);
+    std::vector<char>& own();
+}; // struct TensorData
+
+template<typename It>
+void TensorData::assign(It first, It last)
+{
+    adopt(std::make_shared<std::vector<char>>(first, last));
+}
+
+/**
+ * @brief A tensor value and the layout of its elements in data. Strides are in
+ * elements per logical dim, all zero means contiguous row major. Float elements are
+ * multiplied by scale when read, so transpose, mul and reshape are views of the same
+ * buffer and the elements are only computed once, when they are emitted.
+ */
 struct Tensor
 {
     TensorType tt;
-    std::vector<char> data;
+    TensorData data;
+    Shape strides{};
+    float scale{1.0f};
 
+    bool is_contiguous() const;
+    // offset in elements of the logical element i
+    size_t elem_offset(uint32_t i) const;
     Tensor transpose() const;
+    Tensor reshape(const std::vector<uint32_t>& shape) const;
+    // contiguous row major copy with the scale applied, the tensor itself when it is one
+    Tensor materialize() const;
+    // element-wise conversion between DT_FLOAT, DT_FLOAT16 and DT_BFLOAT16, the result is contiguous
+    Tensor cast(DType dtype) const;
+    // per tensor QuantizeLinear of a float tensor to DT_INT8, the result is contiguous
+    Tensor quantize(float scale, int zero_point) const;
     void mul(float x);
     template<DType DT>
     void set(int i, float x);
+    // element at offset in data (see TensorIterator), scaled
+    template<DType DT>
+    auto at_offset(size_t offset) const;
     template<DType DT>
-    auto at(int i) const;
+    auto at(int i) const { return at_offset<DT>(elem_offset(i)); }
     template<DType DT>
     auto at(int i0, int i1) const;
 }; // struct Tensor
 
+/**
+ * @brief Offsets in data of the elements of a tensor in logical row major order. The
+ * strides are followed with additions, there is no division per element as in
+ * Tensor::elem_offset. Advancing past the last element wraps to the first.
+ */
+struct TensorIterator
+{
+    explicit TensorIterator(const Tensor& tensor);
+    size_t offset() const { return offset_; }
+    TensorIterator& operator++();
+private:
+    Shape shape_;
+    Shape strides_;
+    Shape index_;
+    int dims_;
+    size_t offset_;
+}; // struct TensorIterator
+
+inline TensorIterator& TensorIterator::operator++()
+{
+    for (int d = dims_ - 1; d >= 0; --d) {
+        offset_ += strides_[d];
+        if (++index_[d] < shape_[d]) {
+            return *this;
+        }
+        offset_ -= static_cast<size_t>(shape_[d]) * strides_[d];
+        index_[d] = 0;
+    }
+    return *this;
+}
+
 template<>
 inline void Tensor::set<DT_FLOAT>(int i, float x)
 {
-    uint32_t v{*reinterpret_cast<uint32_t*>(&x)};
-    *reinterpret_cast<uint32_t*>(data.data() + tt.transposed_idx(i) * DT_FLOAT_BYTES) = htole32(v);
+    assert(scale == 1.0f && "Write to a scaled view");
+    uint32_t v;
+    memcpy(&v, &x, sizeof(v));
+    v = htole32(v);
+    memcpy(data.data() + elem_offset(i) * DT_FLOAT_BYTES, &v, sizeof(v));
+}
+
+template<>
+inline auto Tensor::at_offset<DT_FLOAT>(size_t offset) const
+{
+    uint32_t raw;
+    memcpy(&raw, data.data() + offset * DT_FLOAT_BYTES, sizeof(raw));
+    raw = le32toh(raw);
+    float v;
+    memcpy(&v, &raw, sizeof(v));
+    return v * scale;
+}
+
+template<>
+inline void Tensor::set<DT_FLOAT16>(int i, float x)
+{
+    assert(scale == 1.0f && "Write to a scaled view");
+    uint16_t v{htole16(float_to_half(x))};
+    memcpy(data.data() + elem_offset(i) * DT_FLOAT16_BYTES, &v, sizeof(v));
+}
+
+template<>
+inline auto Tensor::at_offset<DT_FLOAT16>(size_t offset) const
+{
+    uint16_t raw;
+    memcpy(&raw, data.data() + offset * DT_FLOAT16_BYTES, sizeof(raw));
+    return half_to_float(le16toh(raw)) * scale;
+}
+
+template<>
+inline void Tensor::set<DT_BFLOAT16>(int i, float x)
+{
+    assert(scale == 1.0f && "Write to a scaled view");
+    uint16_t v{htole16(float_to_bfloat16(x))};
+    memcpy(data.data() + elem_offset(i) * DT_BFLOAT16_BYTES, &v, sizeof(v));
+}
+
+template<>
+inline auto Tensor::at_offset<DT_BFLOAT16>(size_t offset) const
+{
+    uint16_t raw;
+    memcpy(&raw, data.data() + offset * DT_BFLOAT16_BYTES, sizeof(raw));
+    return bfloat16_to_float(le16toh(raw)) * scale;
 }
 
 template<>
-inline auto Tensor::at<DT_FLOAT>(int i) const
+inline auto Tensor::at_offset<DT_INT8>(size_t offset) const
 {
-    auto raw{le32toh(*reinterpret_cast<const uint32_t*>(data.data() + tt.transposed_idx(i) * DT_FLOAT_BYTES))};
-    float v{*reinterpret_cast<float*>(&raw)};
-    return v;
+    return static_cast<int32_t>(static_cast<int8_t>(data.at(offset)));
+}
+
+template<>
+inline auto Tensor::at_offset<DT_UINT8>(size_t offset) const
+{
+    return static_cast<int32_t>(static_cast<uint8_t>(data.at(offset)));
+}
+
+template<>
+inline auto Tensor::at_offset<DT_INT32>(size_t offset) const
+{
+    uint32_t raw;
+    memcpy(&raw, data.data() + offset * DT_INT32_BYTES, sizeof(raw));
+    return static_cast<int32_t>(le32toh(raw));
 }
 
 template<>
 inline auto Tensor::at<DT_FLOAT>(int i0, int i1) const
 {
-    if (tt.row_major) {
-        return at<DT_FLOAT>(i0 * tt.shape[tt.dims - 1] + i1);
-    } else {
-        /// TODO: Cache killer
-        return at<DT_FLOAT>(i1 * tt.shape[tt.dims - 2] + i0);
-    }
+    return at<DT_FLOAT>(i0 * tt.shape[tt.dims - 1] + i1);
 }
 
 std::ostream& operator<<(std::ostream& os, const Tensor& tensor);
 
+/**
+ * @brief Byte offset of the data in a tensor buffer. The buffer holds dims and
+ * shape[dims], the data follows at the next 16 bytes boundary.
+ */
+inline uint32_t tensor_data_offset(int dims)
+{
+    return (sizeof(uint32_t) * (1 + dims) + 15) / 16 * 16;
+}
+
 #endif // YACCS_TENSOR_H_
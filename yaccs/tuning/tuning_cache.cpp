@@ -0,0 +1,92 @@
+#include "yaccs/tuning/tuning_cache.hpp"
+#include <fstream>
+#include <sstream>
+
+
+bool GemmConfig::valid() const
+{
+    if (local_size_x <= 0 || local_size_y <= 0) {
+        return false;
+    }
+    if (tile.micro_m == 0 && tile.micro_n == 0 && tile.tile_k == 0) {
+        return true; // naive kernel
+    }
+    return tile.micro_m > 0 && tile.micro_n > 0 && tile.tile_k > 0
+        && tile.tile_k % local_size_x == 0 && tile.tile_k % local_size_y == 0;
+}
+
+bool GemmKey::operator==(const GemmKey& other) const
+{
+    return m == other.m && n == other.n && k == other.k && dtype == other.dtype;
+}
+
+bool TuningCache::load(const std::string& filename)
+{
+    std::ifstream ifs{filename};
+    if (!ifs.is_open()) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (line.empty() || line.front() == '#') {
+            continue;
+        }
+
+        std::istringstream iss{line};
+        std::string kind;
+        int dtype{};
+        TuningRecord record{};
+        iss >> kind >> record.key.m >> record.key.n >> record.key.k >> dtype
+            >> record.config.local_size_x >> record.config.local_size_y
+            >> record.config.tile.micro_m >> record.config.tile.micro_n >> record.config.tile.tile_k
+            >> record.time_us;
+        if (iss.fail() || kind.compare("gemm") != 0) {
+            return false;
+        }
+        record.key.dtype = static_cast<DType>(dtype);
+        update(record);
+    }
+    return true;
+}
+
+bool TuningCache::save(const std::string& filename) const
+{
+    std::ofstream ofs{filename, std::ios::out | std::ios::trunc};
+    if (!ofs.is_open()) {
+        return false;
+    }
+
+    ofs << "# yaccs tuning cache\n"
+        << "# gemm m n k dtype local_size_x local_size_y micro_m micro_n tile_k time_us\n";
+    for (const auto& it : records_) {
+        ofs << "gemm " << it.key.m << " " << it.key.n << " " << it.key.k << " " << it.key.dtype
+            << " " << it.config.local_size_x << " " << it.config.local_size_y
+            << " " << it.config.tile.micro_m << " " << it.config.tile.micro_n << " " << it.config.tile.tile_k
+            << " " << it.time_us << "\n";
+    }
+    return ofs.good();
+}
+
+const TuningRecord* TuningCache::find(const GemmKey& key) const
+{
+    for (const auto& it : records_) {
+        if (it.key == key) {
+            return &it;
+        }
+    }
+    return nullptr;
+}
+
+void TuningCache::update(const TuningRecord& record)
+{
+    for (auto& it : records_) {
+        if (it.key == record.key) {
+            if (record.time_us < it.time_us) {
+                it = record;
+            }
+            return;
+        }
+    }
+    records_.push_back(record);
+}
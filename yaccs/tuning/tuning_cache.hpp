@@ -0,0 +1,69 @@
+#ifndef YACCS_TUNING_TUNING_CACHE_H_
+#define YACCS_TUNING_TUNING_CACHE_H_
+
+#include "yaccs/dtype.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Tiling of the shared-memory Gemm kernel. Each invocation accumulates a
+ * micro_m x micro_n register tile, a workgroup stages (local_size_x * micro_m) x tile_k
+ * of A and tile_k x (local_size_y * micro_n) of B in workgroup memory per step.
+ * micro_m == 0 selects the naive kernel.
+ */
+struct GemmTileDef
+{
+    int micro_m;
+    int micro_n;
+    int tile_k;
+}; // struct GemmTileDef
+
+struct GemmConfig
+{
+    int local_size_x;
+    int local_size_y;
+    GemmTileDef tile;
+
+    // a tiled kernel stages tile_k columns, a multiple of both local sizes
+    bool valid() const;
+}; // struct GemmConfig
+
+struct GemmKey
+{
+    uint32_t m;
+    uint32_t n;
+    uint32_t k;
+    DType dtype;
+
+    bool operator==(const GemmKey& other) const;
+}; // struct GemmKey
+
+struct TuningRecord
+{
+    GemmKey key;
+    GemmConfig config;
+    double time_us;     // best measured dispatch time
+}; // struct TuningRecord
+
+/**
+ * @brief Best Gemm configuration found by yaccs_autotune per (M, N, K, dtype). Stored
+ * as a text file, one record per line:
+ *
+ *     gemm <m> <n> <k> <dtype> <local_size_x> <local_size_y> <micro_m> <micro_n> <tile_k> <time_us>
+ *
+ * Lines starting with '#' are comments.
+ */
+struct TuningCache
+{
+    bool load(const std::string& filename);
+    bool save(const std::string& filename) const;
+    const TuningRecord* find(const GemmKey& key) const;
+    // keep the faster of the new and the cached record
+    void update(const TuningRecord& record);
+    const std::vector<TuningRecord>& records() const { return records_; }
+private:
+    std::vector<TuningRecord> records_;
+}; // struct TuningCache
+
+#endif // YACCS_TUNING_TUNING_CACHE_H_
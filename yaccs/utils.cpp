@@ -3,9 +3,12 @@
 #include <cstddef>
 #include <cstdio>
 #include <cstring>
+#include <fcntl.h>
+#include <iomanip>
 #include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
-#include <sys/wait.h>
 
 std::string extract_filename(const std::string& path)
 {
@@ -27,22 +30,87 @@ std::string extract_filename(const std::string& path)
     }
 }
 
-bool invoke_spirv_as(const std::string& spvasm, const std::string& out_file)
+std::string extract_dirname(const std::string& path)
 {
-    auto child_pid{fork()};
-    if (child_pid == 0) {
-        // child process
-        execlp("spirv-as", "spirv-as", spvasm.c_str(), "--target-env", "vulkan1.4", "-o", out_file.c_str(), NULL);
-    } else {
-        // parent process
-        int status{0};
-        waitpid(child_pid, &status, 0);
+    auto last_slash_pos{path.rfind("/")};
+    if (last_slash_pos == std::string::npos) {
+        return ".";
+    }
+    return last_slash_pos == 0 ? "/" : path.substr(0, last_slash_pos);
+}
+
+MappedFile::MappedFile(const char* data, size_t size)
+    : data_(data)
+    , size_(size)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& filename)
+{
+    int fd{::open(filename.c_str(), O_RDONLY)};
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    const size_t size{static_cast<size_t>(st.st_size)};
+    void* data{nullptr};
+    if (size > 0) {
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd); // the mapping stays valid
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+    return std::shared_ptr<MappedFile>(new MappedFile(static_cast<const char*>(data), size));
+}
+
+PhaseTimer::PhaseTimer()
+    : clock_(std::chrono::steady_clock::now())
+{
+}
+
+void PhaseTimer::restart()
+{
+    clock_ = std::chrono::steady_clock::now();
+}
+
+void PhaseTimer::phase_done(const std::string& name)
+{
+    auto now{std::chrono::steady_clock::now()};
+    phases_.emplace_back(name, std::chrono::duration<double, std::milli>(now - clock_).count());
+    clock_ = now;
+}
+
+double PhaseTimer::total_ms() const
+{
+    double total{0.0};
+    for (const auto& it : phases_) {
+        total += it.second;
     }
-    return true;
+    return total;
 }
 
-bool remove_file(const std::string& filename)
+std::ostream& operator<<(std::ostream& os, const PhaseTimer& timer)
 {
-    remove(filename.c_str());
-    return true;
+    const auto flags{os.flags()};
+    os << "Time report:\n" << std::fixed << std::setprecision(3);
+    for (const auto& it : timer.phases()) {
+        os << "  " << std::left << std::setw(12) << it.first << std::right << std::setw(12) << it.second << " ms\n";
+    }
+    os << "  " << std::left << std::setw(12) << "total" << std::right << std::setw(12) << timer.total_ms() << " ms\n";
+    os.flags(flags);
+    return os;
 }
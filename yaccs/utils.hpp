@@ -1,7 +1,13 @@
 #ifndef YACCS_UTILS_H_
 #define YACCS_UTILS_H_
 
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <ostream>
 #include <string>
+#include <utility>
+#include <vector>
 
 #define DEF_SINGLETON(classname)                                                \
 public:                                                                         \
@@ -24,7 +30,45 @@ private:
 
 
 std::string extract_filename(const std::string& path);
-bool invoke_spirv_as(const std::string& spvasm, const std::string& out_file);
-bool remove_file(const std::string& filename);
+// directory part of a path, "." when there is none
+std::string extract_dirname(const std::string& path);
+
+/**
+ * @brief Read only memory map of a whole file, unmapped when the last reference
+ * goes away.
+ */
+struct MappedFile
+{
+    // nullptr when the file can not be opened or mapped
+    static std::shared_ptr<MappedFile> open(const std::string& filename);
+    ~MappedFile();
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+private:
+    const char* data_;
+    size_t size_;
+
+    MappedFile(const char* data, size_t size);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+}; // struct MappedFile
+
+/**
+ * @brief Wall time of consecutive phases, a phase lasts from the end of the previous
+ * one (or the last restart) to its phase_done call.
+ */
+struct PhaseTimer
+{
+    PhaseTimer();
+    void restart();
+    void phase_done(const std::string& name);
+    const std::vector<std::pair<std::string, double>>& phases() const { return phases_; }  // milliseconds
+    double total_ms() const;
+private:
+    std::chrono::steady_clock::time_point clock_;
+    std::vector<std::pair<std::string, double>> phases_;
+}; // struct PhaseTimer
+
+std::ostream& operator<<(std::ostream& os, const PhaseTimer& timer);
 
 #endif // YACCS_UTILS_H_